@@ -0,0 +1,386 @@
+// ------------------------------------------------------------
+// Micro-benchmarks for the analyzer's hot functions
+//
+// Build (needs Google Benchmark installed):
+//   g++ -std=c++17 -O2 bench/benchmarks.cpp -lbenchmark -lpthread -o yt_bench
+// (add -DWITH_ZLIB -lz / -DWITH_ZSTD -lzstd for compressed data/ files, see README.md)
+// Run from the folder that holds "data/" to include the real
+// Kaggle files, and keep JSON results for diffing versions:
+//   ./yt_bench --benchmark_out=bench.json --benchmark_out_format=json
+// Two result files can be compared with Google Benchmark's
+// tools/compare.py.
+// ------------------------------------------------------------
+#define YT_ANALYZER_NO_MAIN
+#include "../src/main.cpp"
+
+#include <benchmark/benchmark.h>
+#include <random>
+
+// ------------------------------------------------------------
+// Synthetic data shaped like the Kaggle files
+// ------------------------------------------------------------
+const vector<string> BENCH_WORDS = {"music", "gaming", "comedy", "news", "sports", "vlog", "funny", "trailer",
+                                    "official", "video", "live", "cover", "remix", "tutorial", "review", "2018"};
+
+string syntheticTag(mt19937 &rng) {
+    return BENCH_WORDS[rng() % BENCH_WORDS.size()] + " " + BENCH_WORDS[rng() % BENCH_WORDS.size()];
+}
+
+// One CSV record with `tagCount` tags and a description of about `descriptionBytes`.
+string syntheticLine(mt19937 &rng, int tagCount, size_t descriptionBytes) {
+    string tags;
+    for (int t = 0; t < tagCount; ++t) tags += (t ? "|\"\"" : "\"\"") + syntheticTag(rng) + "\"\"";
+    if (tags.empty()) tags = "[none]";
+    string description;
+    while (description.size() < descriptionBytes) description += BENCH_WORDS[rng() % BENCH_WORDS.size()] + " ";
+    uint64_t views = rng() % 5000000, likes = views ? rng() % (views / 20 + 1) : 0;
+    return "vid" + to_string(rng() % 100000) + ",17.14.11,\"Title " + to_string(rng() % 1000) + ", with comma\",\"Channel\",10," +
+           "2017-11-13T17:13:01.000Z,\"" + tags + "\"," + to_string(views) + "," + to_string(likes) + ",12,34," +
+           "https://i.ytimg.com/vi/x/default.jpg,False,False,False,\"" + description + "\"";
+}
+
+// Whether the text of the tables from data/ has been freed since
+// they were loaded, see realVideos().
+bool realTextReset = true;
+
+// Replaces the text of the previous synthetic table, so the arenas
+// and title pool do not keep growing from one benchmark to the next.
+VideoTable syntheticVideos(size_t rows, int tagCount) {
+    mt19937 rng(42);
+    resetLoadedText();
+    realTextReset = true;
+    trainStringSymbols([&] {
+        SymbolSample sample;
+        while (!sample.full()) sample.add(syntheticTag(rng));
+        return sample.strings;
+    });
+    VideoTable videos(rows);
+    for (auto &v : videos) {
+        vector<string> tags;
+        for (int t = 0; t < tagCount; ++t) tags.push_back(syntheticTag(rng));
+        v.tags = tagArenas.append(encodeTags(tags));
+        v.title = titlePool.intern("Title " + to_string(rng() % 100000));
+        v.views = rng() % 5000000;
+        v.likes = rng() % 250000;
+        v.dislikes = rng() % 25000;
+        v.comments = rng() % 50000;
+        v.ratio = v.views == 0.0 ? 0.0 : v.likes / v.views;
+    }
+    return videos;
+}
+
+const vector<string> BENCH_SELECTED_TAGS = {"music", "gaming"};
+
+// ------------------------------------------------------------
+// Parsing
+// ------------------------------------------------------------
+void BM_ParseCSVLine(benchmark::State &state) {
+    mt19937 rng(1);
+    string line = syntheticLine(rng, 8, state.range(0));
+    for (auto _ : state) benchmark::DoNotOptimize(parseCSVLine(line));
+    state.SetBytesProcessed(state.iterations() * line.size());
+}
+BENCHMARK(BM_ParseCSVLine)->RangeMultiplier(4)->Range(64, 16 << 10);
+
+void BM_Split(benchmark::State &state) {
+    mt19937 rng(2);
+    string tags;
+    for (int t = 0; t < state.range(0); ++t) tags += (t ? "|" : "") + syntheticTag(rng);
+    for (auto _ : state) benchmark::DoNotOptimize(split(tags, '|'));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Split)->RangeMultiplier(4)->Range(1, 64);
+
+void BM_ParseNumber(benchmark::State &state) {
+    mt19937 rng(3);
+    vector<string> numbers(1024);
+    for (auto &n : numbers) n = to_string(rng() % 100000000);
+    size_t i = 0;
+    for (auto _ : state) benchmark::DoNotOptimize(stod(numbers[i++ % numbers.size()]));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseNumber);
+
+void BM_ParsePublishTime(benchmark::State &state) {
+    mt19937 rng(5);
+    vector<string> stamps(1024);
+    for (auto &s : stamps) {
+        unsigned year = 10 + rng() % 10, month = 1 + rng() % 12, day = 1 + rng() % 28;
+        unsigned hour = rng() % 24, minute = rng() % 60, second = rng() % 60;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "20%02u-%02u-%02uT%02u:%02u:%02u.000Z", year, month, day, hour, minute, second);
+        s = buf;
+    }
+    size_t i = 0;
+    int64_t seconds = 0;
+    for (auto _ : state) benchmark::DoNotOptimize(parsePublishTime(stamps[i++ % stamps.size()], seconds));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParsePublishTime);
+
+void BM_ParseVideoRecord(benchmark::State &state) {
+    mt19937 rng(4);
+    string line = syntheticLine(rng, state.range(0), 512);
+    Video video;
+    // Titles and descriptions are not kept: the arenas would grow with every iteration.
+    for (auto _ : state) benchmark::DoNotOptimize(parseVideoRecord(line, video, false));
+    state.SetBytesProcessed(state.iterations() * line.size());
+}
+BENCHMARK(BM_ParseVideoRecord)->RangeMultiplier(4)->Range(1, 64);
+
+// ------------------------------------------------------------
+// Matching and analysis, by row count and tags per video
+// ------------------------------------------------------------
+void BM_TagMatch(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(state.range(0), state.range(1));
+    vector<TagMatcher> matchers(BENCH_SELECTED_TAGS.begin(), BENCH_SELECTED_TAGS.end());
+    for (auto _ : state) {
+        size_t matches = 0;
+        for (const auto &v : videos)
+            for (const auto &matcher : matchers) matches += matcher.count(v.tags);
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_HeapRanking(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(state.range(0), state.range(1));
+    for (auto _ : state) benchmark::DoNotOptimize(analyzeWithHeap(videos, BENCH_SELECTED_TAGS, false));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_HashAggregation(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(state.range(0), state.range(1));
+    for (auto _ : state) benchmark::DoNotOptimize(analyzeWithHashTable(videos, BENCH_SELECTED_TAGS, false));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void tableSizes(benchmark::internal::Benchmark *b) {
+    for (long rows : {1 << 10, 1 << 14, 1 << 18})
+        for (long tags : {1, 8, 32}) b->Args({rows, tags});
+    // The analyses scan on worker threads, so measure wall time.
+    b->ArgNames({"rows", "tags"})->Unit(benchmark::kMicrosecond)->UseRealTime();
+}
+BENCHMARK(BM_TagMatch)->Apply(tableSizes);
+BENCHMARK(BM_HeapRanking)->Apply(tableSizes);
+BENCHMARK(BM_HashAggregation)->Apply(tableSizes);
+
+// ------------------------------------------------------------
+// Top-K by score: the stored ratio column against a compiled
+// expression-template score and the interpreted fallback
+// ------------------------------------------------------------
+enum ScoreMode { SCORE_STORED, SCORE_COMPILED, SCORE_INTERPRETED };
+
+void BM_TopKScore(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(state.range(0), 1);
+    VideoIndex index = buildVideoIndex(videos);
+    vector<uint32_t> rows(videos.size());
+    for (size_t i = 0; i < rows.size(); ++i) rows[i] = i;
+    // "(likes - dislikes) / views" has a compiled form; "... * 1" does not.
+    const char *formulas[] = {"ratio", "(likes - dislikes) / views", "(likes - dislikes) / views * 1"};
+    ScoreProgram order = parseQuery(string("order by ") + formulas[state.range(1)]).order;
+    for (auto _ : state) benchmark::DoNotOptimize(rankRows(index, rows, order, 10, true));
+    state.SetItemsProcessed(state.iterations() * rows.size());
+}
+BENCHMARK(BM_TopKScore)
+    ->ArgsProduct({{1 << 14, 1 << 18}, {SCORE_STORED, SCORE_COMPILED, SCORE_INTERPRETED}})
+    ->ArgNames({"rows", "mode"})
+    ->Unit(benchmark::kMicrosecond);
+
+// Top 10 by ratio for a tag: lookup + heap over every tagged row against the
+// early-terminating merge of impact-ordered postings.
+void BM_TagTopK(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(state.range(0), 8);
+    VideoIndex index = buildVideoIndex(videos);
+    Query q = parseQuery("tags:music order by ratio limit 10");
+    ScoreProgram ratio = ScoreProgram::column(QCOL_RATIO);
+    size_t postingsRead = 0;
+    for (auto _ : state) {
+        if (state.range(1)) benchmark::DoNotOptimize(impactTopK(index, q, 10, postingsRead));
+        else benchmark::DoNotOptimize(rankRows(index, lookupTags(index, q.tags), ratio, 10, true));
+    }
+    state.SetItemsProcessed(state.iterations() * videos.size());
+}
+BENCHMARK(BM_TagTopK)
+    ->ArgsProduct({{1 << 14, 1 << 18}, {0, 1}})
+    ->ArgNames({"rows", "impact"})
+    ->Unit(benchmark::kMicrosecond);
+
+// Full ordering for deep pages: radix sort against std::stable_sort on the same keys.
+void BM_SortRows(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(state.range(0), 1);
+    VideoIndex index = buildVideoIndex(videos);
+    vector<uint32_t> rows(videos.size());
+    for (size_t i = 0; i < rows.size(); ++i) rows[i] = i;
+    ScoreProgram order = ScoreProgram::column(QCOL_RATIO);
+    for (auto _ : state) benchmark::DoNotOptimize(sortRows(index, rows, order, true));
+    state.SetItemsProcessed(state.iterations() * rows.size());
+}
+BENCHMARK(BM_SortRows)->RangeMultiplier(8)->Range(1 << 12, 1 << 21)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_StableSortRows(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(state.range(0), 1);
+    for (auto _ : state) {
+        vector<uint32_t> rows(videos.size());
+        for (size_t i = 0; i < rows.size(); ++i) rows[i] = i;
+        stable_sort(rows.begin(), rows.end(), [&](uint32_t a, uint32_t b) { return videos[a].ratio > videos[b].ratio; });
+        benchmark::DoNotOptimize(rows);
+    }
+    state.SetItemsProcessed(state.iterations() * videos.size());
+}
+BENCHMARK(BM_StableSortRows)->RangeMultiplier(8)->Range(1 << 12, 1 << 21)->Unit(benchmark::kMillisecond);
+
+// views >= 1M as a bitmap from the bit slices against a batch filter over every row.
+void BM_RangePredicate(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(state.range(0), 1);
+    VideoIndex index = buildVideoIndex(videos);
+    Predicate p{QCOL_VIEWS, OP_GE, 1000000};
+    for (auto _ : state) {
+        if (state.range(1)) {
+            benchmark::DoNotOptimize(bitSlicePredicate(index, p));
+            continue;
+        }
+        vector<uint32_t> sel(index.rows);
+        for (size_t i = 0; i < sel.size(); ++i) sel[i] = i;
+        size_t out = 0;
+        for (size_t begin = 0; begin < sel.size(); begin += QUERY_BATCH_ROWS) {
+            size_t n = applyPredicate(index, p, sel.data() + begin, min(QUERY_BATCH_ROWS, sel.size() - begin));
+            memmove(sel.data() + out, sel.data() + begin, n * sizeof(uint32_t));
+            out += n;
+        }
+        sel.resize(out);
+        benchmark::DoNotOptimize(sel);
+    }
+    state.SetItemsProcessed(state.iterations() * videos.size());
+}
+BENCHMARK(BM_RangePredicate)
+    ->ArgsProduct({{1 << 16, 1 << 20}, {0, 1}})
+    ->ArgNames({"rows", "bitsliced"})
+    ->Unit(benchmark::kMicrosecond);
+
+// Description search over the arenas against a per-row lowercase copy and string::find.
+void BM_DescriptionSearch(benchmark::State &state) {
+    mt19937 rng(9);
+    VideoTable videos = syntheticVideos(1 << 16, 1);
+    for (auto &v : videos) {
+        string description;
+        while (description.size() < 512) description += BENCH_WORDS[rng() % BENCH_WORDS.size()] + " ";
+        v.description = descriptionArenas.append(description + "Remix-" + to_string(rng() % 1000));
+    }
+    VideoIndex index = buildVideoIndex(videos);
+    vector<string> patterns = {"remix-42", "remix-7 "};
+    patterns.resize(state.range(0));
+    size_t bytes = 0;
+    for (const auto &v : videos) bytes += v.description.length;
+    for (auto _ : state) {
+        if (!state.range(1)) {
+            benchmark::DoNotOptimize(lookupDescriptions(index, patterns));
+            continue;
+        }
+        vector<uint32_t> rows;
+        for (size_t row = 0; row < videos.size(); ++row) {
+            string text = descriptionArenas.str(videos[row].description);
+            transform(text.begin(), text.end(), text.begin(), ::tolower);
+            for (const auto &p : patterns)
+                if (text.find(p) != string::npos) {
+                    rows.push_back(row);
+                    break;
+                }
+        }
+        benchmark::DoNotOptimize(rows);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_DescriptionSearch)
+    ->ArgsProduct({{1, 2}, {0, 1}})
+    ->ArgNames({"patterns", "naive"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Writing every row of a result to /dev/null through ResultWriter in each
+// format, against the same listing through an ofstream.
+void BM_WriteResults(benchmark::State &state) {
+    VideoTable videos = syntheticVideos(1 << 16, 1);
+    RankedRows ranked;
+    for (uint32_t row = 0; row < videos.size(); ++row) ranked.push_back({videos[row].ratio, row});
+    for (auto _ : state) {
+        if (state.range(0) == 3) {
+            ofstream out("/dev/null");
+            for (size_t i = 0; i < ranked.size(); ++i) {
+                const Video &v = videos[ranked[i].second];
+                out << i + 1 << ". " << titlePool.str(v.title) << " [" << countryCodes.name(v.country) << "] (views: " << v.views
+                    << ", likes: " << v.likes << ", ratio: " << v.ratio << ", score: " << ranked[i].first << ")\n";
+            }
+            continue;
+        }
+        ResultWriter out("/dev/null");
+        writeRankedRows(out, static_cast<ResultFormat>(state.range(0)), videos, ranked, 1, true);
+    }
+    state.SetItemsProcessed(state.iterations() * ranked.size());
+}
+BENCHMARK(BM_WriteResults)->DenseRange(0, 3)->ArgName("format")->Unit(benchmark::kMillisecond);
+
+// ------------------------------------------------------------
+// The same paths over the real files in data/, when present
+// ------------------------------------------------------------
+// The tables of data/, loaded again once synthetic tables have
+// replaced their text.
+const VideoTable &realVideos() {
+    static VideoTable videos;
+    if (realTextReset) {
+        // Silence the loader's progress output.
+        streambuf *saved = cout.rdbuf(nullptr);
+        videos = VideoTable();
+        resetLoadedText();
+        videos = loadAllDatasets("data");
+        cout.rdbuf(saved);
+        realTextReset = false;
+    }
+    return videos;
+}
+
+void registerRealDataBenchmarks() {
+    if (!fs::exists("data") || realVideos().empty()) return;
+
+    static vector<string> lines;
+    for (const auto &entry : fs::directory_iterator("data")) {
+        if (!endsWith(entry.path().string(), ".csv")) continue;
+        LineReader reader(entry.path().string());
+        string line;
+        reader.next(line); // skip header
+        while (lines.size() < 4096 && reader.next(line)) lines.push_back(line);
+        break;
+    }
+
+    if (!lines.empty()) {
+        benchmark::RegisterBenchmark("BM_ParseVideoRecord/real", [](benchmark::State &state) {
+            Video video;
+            size_t i = 0, bytes = 0;
+            for (auto _ : state) {
+                const string &line = lines[i++ % lines.size()];
+                bytes += line.size();
+                benchmark::DoNotOptimize(parseVideoRecord(line, video, false));
+            }
+            state.SetBytesProcessed(bytes);
+        });
+    }
+    benchmark::RegisterBenchmark("BM_HeapRanking/real", [](benchmark::State &state) {
+        const VideoTable &videos = realVideos();
+        for (auto _ : state) benchmark::DoNotOptimize(analyzeWithHeap(videos, BENCH_SELECTED_TAGS, false));
+        state.SetItemsProcessed(state.iterations() * videos.size());
+    })->Unit(benchmark::kMillisecond)->UseRealTime();
+    benchmark::RegisterBenchmark("BM_HashAggregation/real", [](benchmark::State &state) {
+        const VideoTable &videos = realVideos();
+        for (auto _ : state) benchmark::DoNotOptimize(analyzeWithHashTable(videos, BENCH_SELECTED_TAGS, false));
+        state.SetItemsProcessed(state.iterations() * videos.size());
+    })->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    registerRealDataBenchmarks();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
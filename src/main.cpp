@@ -3,253 +3,7561 @@
 #include <sstream>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include <algorithm>
 #include <filesystem>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <map>
+#include <iterator>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <string_view>
+#include <charconv>
+#include <limits>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <cerrno>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define ASYNC_IO_URING
+#endif
+
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define PERF_COUNTERS
+#endif
+
+// Compressed inputs are opt-in, as they need extra libraries:
+// -DWITH_ZLIB -lz for .csv.gz, -DWITH_ZSTD -lzstd for .csv.zst.
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#define GZIP_FRAMES
+#endif
+
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#define ZSTD_FRAMES
+#endif
+
+#if defined(__linux__) && __has_include(<linux/mempolicy.h>)
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#define NUMA_BINDING
+#endif
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
 
 using namespace std;
 namespace fs = std::filesystem;
 using namespace std::chrono;
 
+// ------------------------------------------------------------
+// Location of a text value stored out of line in a TextArenas
+// ------------------------------------------------------------
+struct TextRef {
+    uint64_t offset = 0;
+    uint32_t arena = 0;
+    uint32_t length = 0;
+};
+
+// ------------------------------------------------------------
+// Status columns of the Kaggle files, as bits of Video::flags
+// ------------------------------------------------------------
+enum VideoFlag : uint8_t { FLAG_COMMENTS_DISABLED = 1, FLAG_RATINGS_DISABLED = 2, FLAG_VIDEO_REMOVED = 4 };
+const int VIDEO_FLAG_COUNT = 3;
+const char *const VIDEO_FLAG_NAMES[VIDEO_FLAG_COUNT] = {"comments_disabled", "ratings_disabled", "video_error_or_removed"};
+
 // ------------------------------------------------------------
 // Structure to hold video data
 // ------------------------------------------------------------
 struct Video {
-    string title;
-    vector<string> tags;
+    uint32_t title = 0;  // id in titlePool, only resolved for rows that are printed
+    uint16_t country = 0; // id in countryCodes of the dataset's code, e.g. "US"
+    TextRef tags;        // compressed tag list in tagArenas, see encodeTags()
+    TextRef description; // in descriptionArenas
     double views;
     double likes;
+    double dislikes;
+    double comments;
     double ratio;
+    uint8_t flags = 0;        // VideoFlag bits
+    int64_t publishTime = 0;  // seconds since 1970-01-01 UTC, 0 if unknown
+    int32_t trendingDay = 0;  // days since 1970-01-01, 0 if unknown
+    double hoursToTrend = 0;  // derived, see hoursToTrend()
+};
+
+// ------------------------------------------------------------
+// Memory accounting per subsystem
+//
+// Every heap allocation is tagged with the subsystem active on
+// the allocating thread (see MemoryScope) through a small header
+// in front of the block, so live bytes stay attributed to their
+// owner when objects are moved between containers. Large
+// huge-page allocations are tracked the same way.
+//
+// Counters are per thread: each thread owns a cache-line aligned
+// block that only it writes, so new/delete never contend. Blocks
+// sit on a lock-free list and are summed by the reports; a block
+// is handed to the next new thread once its owner exits. Peaks
+// are sampled: a thread re-sums its subsystem only after its own
+// live bytes grew by PEAK_SAMPLE_BYTES since the last sample.
+// ------------------------------------------------------------
+enum MemorySubsystem : uint8_t {
+    MEM_OTHER = 0,
+    MEM_LOADER,
+    MEM_TITLES,
+    MEM_TAGS,
+    MEM_DICTIONARY,
+    MEM_INDEXES,
+    MEM_HEAP_ANALYSIS,
+    MEM_HASH_ANALYSIS,
+    MEM_EXPORT,
+    MEM_TRACING,
+    MEM_QUERY,
+    MEM_DESCRIPTIONS,
+    MEM_SUBSYSTEM_COUNT
+};
+
+const char *const MEMORY_SUBSYSTEM_NAMES[MEM_SUBSYSTEM_COUNT] = {
+    "other", "loader", "titles", "tags", "dictionary", "indexes", "heap_analysis", "hash_analysis", "export",
+    "tracing", "query", "descriptions"};
+
+const long long PEAK_SAMPLE_BYTES = 256 * 1024;
+
+struct MemoryCounters {
+    long long liveBytes = 0;
+    long long peakBytes = 0;
+    long long liveAllocations = 0;
+    long long allocations = 0;
+};
+
+// Written only by the owning thread, with relaxed load/store pairs
+// rather than read-modify-writes; reports read them concurrently.
+struct alignas(64) ThreadMemoryCounters {
+    atomic<long long> liveBytes[MEM_SUBSYSTEM_COUNT];
+    atomic<long long> liveAllocations[MEM_SUBSYSTEM_COUNT];
+    atomic<long long> allocations[MEM_SUBSYSTEM_COUNT];
+    long long sampledBytes[MEM_SUBSYSTEM_COUNT];
+    atomic<bool> inUse;
+    ThreadMemoryCounters *next;
+};
+
+struct alignas(64) PeakCounter {
+    atomic<long long> bytes{0};
+};
+
+atomic<ThreadMemoryCounters *> threadMemoryCounters{nullptr};
+PeakCounter memoryPeaks[MEM_SUBSYSTEM_COUNT];
+// Used with atomic adds by threads whose own block is already
+// released (frees from later thread_local destructors).
+ThreadMemoryCounters exitedThreadCounters{};
+thread_local MemorySubsystem currentSubsystem = MEM_OTHER;
+thread_local ThreadMemoryCounters *threadCounters = nullptr;
+thread_local bool threadCountersReleased = false;
+
+long long sumLiveBytes(MemorySubsystem subsystem) {
+    long long live = exitedThreadCounters.liveBytes[subsystem].load(memory_order_relaxed);
+    for (ThreadMemoryCounters *b = threadMemoryCounters.load(memory_order_acquire); b; b = b->next)
+        live += b->liveBytes[subsystem].load(memory_order_relaxed);
+    return live;
+}
+
+void samplePeak(MemorySubsystem subsystem) {
+    long long live = sumLiveBytes(subsystem);
+    long long peak = memoryPeaks[subsystem].bytes.load(memory_order_relaxed);
+    while (live > peak && !memoryPeaks[subsystem].bytes.compare_exchange_weak(peak, live, memory_order_relaxed)) {
+    }
+}
+
+// Returns the block back to the pool when its thread exits.
+struct ThreadCountersLease {
+    ~ThreadCountersLease() {
+        if (!threadCounters) return;
+        threadCounters->inUse.store(false, memory_order_release);
+        threadCounters = nullptr;
+        threadCountersReleased = true;
+    }
+};
+
+ThreadMemoryCounters *acquireThreadCounters() {
+    static_assert(is_trivially_destructible<ThreadMemoryCounters>::value, "blocks are never freed");
+    thread_local ThreadCountersLease lease;
+    (void)lease;
+    for (ThreadMemoryCounters *b = threadMemoryCounters.load(memory_order_acquire); b; b = b->next) {
+        bool idle = false;
+        if (!b->inUse.load(memory_order_relaxed) && b->inUse.compare_exchange_strong(idle, true, memory_order_acquire))
+            return b;
+    }
+    // malloc rather than new: this runs inside operator new.
+    void *raw = nullptr;
+    if (posix_memalign(&raw, alignof(ThreadMemoryCounters), sizeof(ThreadMemoryCounters)) != 0) abort();
+    memset(raw, 0, sizeof(ThreadMemoryCounters));
+    auto *b = static_cast<ThreadMemoryCounters *>(raw);
+    b->inUse.store(true, memory_order_relaxed);
+    b->next = threadMemoryCounters.load(memory_order_relaxed);
+    while (!threadMemoryCounters.compare_exchange_weak(b->next, b, memory_order_release, memory_order_relaxed)) {
+    }
+    return b;
+}
+
+void addRelaxed(atomic<long long> &counter, long long delta) {
+    counter.store(counter.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+void recordAllocation(MemorySubsystem subsystem, size_t bytes) {
+    if (!threadCounters && !threadCountersReleased) threadCounters = acquireThreadCounters();
+    ThreadMemoryCounters *c = threadCounters;
+    if (!c) {
+        exitedThreadCounters.liveBytes[subsystem].fetch_add(bytes, memory_order_relaxed);
+        exitedThreadCounters.liveAllocations[subsystem].fetch_add(1, memory_order_relaxed);
+        exitedThreadCounters.allocations[subsystem].fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    addRelaxed(c->liveBytes[subsystem], static_cast<long long>(bytes));
+    addRelaxed(c->liveAllocations[subsystem], 1);
+    addRelaxed(c->allocations[subsystem], 1);
+    long long live = c->liveBytes[subsystem].load(memory_order_relaxed);
+    if (live - c->sampledBytes[subsystem] >= PEAK_SAMPLE_BYTES) {
+        c->sampledBytes[subsystem] = live;
+        samplePeak(subsystem);
+    }
+}
+
+void recordFree(MemorySubsystem subsystem, size_t bytes) {
+    ThreadMemoryCounters *c = threadCounters;
+    if (!c) {
+        exitedThreadCounters.liveBytes[subsystem].fetch_sub(bytes, memory_order_relaxed);
+        exitedThreadCounters.liveAllocations[subsystem].fetch_sub(1, memory_order_relaxed);
+        return;
+    }
+    addRelaxed(c->liveBytes[subsystem], -static_cast<long long>(bytes));
+    addRelaxed(c->liveAllocations[subsystem], -1);
+    long long live = c->liveBytes[subsystem].load(memory_order_relaxed);
+    if (live < c->sampledBytes[subsystem]) c->sampledBytes[subsystem] = live;
+}
+
+MemoryCounters memoryCounters(MemorySubsystem subsystem) {
+    samplePeak(subsystem);
+    MemoryCounters total;
+    auto add = [&](const ThreadMemoryCounters &b) {
+        total.liveBytes += b.liveBytes[subsystem].load(memory_order_relaxed);
+        total.liveAllocations += b.liveAllocations[subsystem].load(memory_order_relaxed);
+        total.allocations += b.allocations[subsystem].load(memory_order_relaxed);
+    };
+    add(exitedThreadCounters);
+    for (ThreadMemoryCounters *b = threadMemoryCounters.load(memory_order_acquire); b; b = b->next) add(*b);
+    total.peakBytes = max(memoryPeaks[subsystem].bytes.load(memory_order_relaxed), total.liveBytes);
+    return total;
+}
+
+// Attributes allocations made by this thread to a subsystem until
+// the scope ends.
+class MemoryScope {
+public:
+    explicit MemoryScope(MemorySubsystem subsystem) : saved(currentSubsystem) { currentSubsystem = subsystem; }
+    ~MemoryScope() { currentSubsystem = saved; }
+
+    MemoryScope(const MemoryScope &) = delete;
+    MemoryScope &operator=(const MemoryScope &) = delete;
+
+private:
+    MemorySubsystem saved;
+};
+
+struct alignas(16) AllocationHeader {
+    size_t size;
+    MemorySubsystem subsystem;
+};
+
+void *operator new(size_t bytes) {
+    auto *header = static_cast<AllocationHeader *>(malloc(bytes + sizeof(AllocationHeader)));
+    if (!header) throw bad_alloc();
+    header->size = bytes;
+    header->subsystem = currentSubsystem;
+    recordAllocation(header->subsystem, bytes);
+    return header + 1;
+}
+
+void operator delete(void *p) noexcept {
+    if (!p) return;
+    // Through an integer so inlined deletes of arrays are not
+    // flagged as indexing before their first element.
+    auto *header = reinterpret_cast<AllocationHeader *>(reinterpret_cast<uintptr_t>(p) - sizeof(AllocationHeader));
+    recordFree(header->subsystem, header->size);
+    free(header);
+}
+
+void *operator new[](size_t bytes) { return ::operator new(bytes); }
+void operator delete[](void *p) noexcept { ::operator delete(p); }
+void operator delete(void *p, size_t) noexcept { ::operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { ::operator delete(p); }
+
+string formatBytes(long long bytes) {
+    const char *units[] = {"B", "KB", "MB", "GB"};
+    double value = static_cast<double>(bytes);
+    int unit = 0;
+    while (unit < 3 && (value >= 1024.0 || value <= -1024.0)) {
+        value /= 1024.0;
+        ++unit;
+    }
+    ostringstream out;
+    out.setf(ios::fixed);
+    out.precision(unit == 0 ? 0 : 1);
+    out << value << " " << units[unit];
+    return out.str();
+}
+
+void printMemoryReport() {
+    cout << "Memory by subsystem (live / peak / live allocs / total allocs):\n";
+    for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i) {
+        MemoryCounters c = memoryCounters(static_cast<MemorySubsystem>(i));
+        if (c.allocations == 0) continue;
+        cout << " - " << MEMORY_SUBSYSTEM_NAMES[i] << ": " << formatBytes(c.liveBytes) << " / "
+             << formatBytes(c.peakBytes) << " / " << c.liveAllocations << " / " << c.allocations << "\n";
+    }
+}
+
+bool exportMemoryReport(const string &filename) {
+    ofstream out(filename);
+    if (!out.is_open()) {
+        cerr << "Error: Could not write " << filename << endl;
+        return false;
+    }
+    out << "{\n  \"subsystems\": [\n";
+    for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i) {
+        MemoryCounters c = memoryCounters(static_cast<MemorySubsystem>(i));
+        out << "    {\"name\": \"" << MEMORY_SUBSYSTEM_NAMES[i] << "\", \"live_bytes\": " << c.liveBytes
+            << ", \"peak_bytes\": " << c.peakBytes << ", \"live_allocations\": " << c.liveAllocations
+            << ", \"allocations\": " << c.allocations << "}" << (i + 1 < MEM_SUBSYSTEM_COUNT ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+// ------------------------------------------------------------
+// Pipeline tracing
+//
+// TraceSpan records a named, timed span into a ring buffer owned
+// by the current thread; recording takes no locks. Each thread's
+// buffer is registered once on a lock-free list, and
+// exportTrace writes every buffered span as Chrome Trace Event
+// JSON, which chrome://tracing and Perfetto display as
+// per-thread timelines.
+// ------------------------------------------------------------
+const size_t TRACE_RING_EVENTS = 4096;
+
+struct TraceEvent {
+    const char *name;
+    long long startNs;
+    long long durationNs;
+};
+
+struct TraceBuffer {
+    TraceEvent events[TRACE_RING_EVENTS];
+    atomic<size_t> count{0};
+    int threadId = 0;
+    TraceBuffer *next = nullptr;
+};
+
+const steady_clock::time_point traceEpoch = steady_clock::now();
+atomic<TraceBuffer *> traceBuffers{nullptr};
+atomic<int> traceThreadCount{0};
+
+long long traceNow() {
+    return duration_cast<nanoseconds>(steady_clock::now() - traceEpoch).count();
+}
+
+TraceBuffer &threadTraceBuffer() {
+    // Buffers outlive their threads so spans survive until exported.
+    thread_local TraceBuffer *buffer = [] {
+        MemoryScope scope(MEM_TRACING);
+        auto *b = new TraceBuffer;
+        b->threadId = ++traceThreadCount;
+        b->next = traceBuffers.load(memory_order_relaxed);
+        while (!traceBuffers.compare_exchange_weak(b->next, b, memory_order_release, memory_order_relaxed)) {
+        }
+        return b;
+    }();
+    return *buffer;
+}
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name) : name(name), start(traceNow()) {}
+
+    ~TraceSpan() {
+        TraceBuffer &buffer = threadTraceBuffer();
+        size_t n = buffer.count.load(memory_order_relaxed);
+        buffer.events[n % TRACE_RING_EVENTS] = {name, start, traceNow() - start};
+        buffer.count.store(n + 1, memory_order_release);
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    long long start;
+};
+
+bool exportTrace(const string &filename) {
+    ofstream out(filename);
+    if (!out.is_open()) {
+        cerr << "Error: Could not write " << filename << endl;
+        return false;
+    }
+    out.setf(ios::fixed);
+    out.precision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (TraceBuffer *b = traceBuffers.load(memory_order_acquire); b; b = b->next) {
+        size_t n = b->count.load(memory_order_acquire);
+        for (size_t i = n > TRACE_RING_EVENTS ? n - TRACE_RING_EVENTS : 0; i < n; ++i) {
+            const TraceEvent &e = b->events[i % TRACE_RING_EVENTS];
+            out << (first ? "\n" : ",\n") << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                << b->threadId << ", \"ts\": " << e.startNs / 1000.0 << ", \"dur\": " << e.durationNs / 1000.0 << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+// ------------------------------------------------------------
+// Metrics
+//
+// HDR-style log-linear histograms: values below 64 are counted
+// exactly, and every power of two above that is split into 32
+// linear sub-buckets, so quantiles are within ~3% of the true
+// value. Recording is a few relaxed atomic adds. Snapshots are
+// rendered in the Prometheus text format as summaries.
+// ------------------------------------------------------------
+const int HISTOGRAM_SUB_BITS = 6;
+const size_t HISTOGRAM_HALF = size_t(1) << (HISTOGRAM_SUB_BITS - 1);
+const size_t HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 2) * HISTOGRAM_HALF;
+
+int highestBit(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(v);
+#else
+    int bit = 0;
+    while (v >>= 1) ++bit;
+    return bit;
+#endif
+}
+
+class Histogram {
+public:
+    void record(uint64_t value) {
+        counts[bucketOf(value)].fetch_add(1, memory_order_relaxed);
+        total.fetch_add(1, memory_order_relaxed);
+        sum.fetch_add(value, memory_order_relaxed);
+        uint64_t seenMax = maxValue.load(memory_order_relaxed);
+        while (value > seenMax && !maxValue.compare_exchange_weak(seenMax, value, memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+    uint64_t valueSum() const { return sum.load(memory_order_relaxed); }
+
+    // Highest value equivalent to the q-quantile (0 when empty).
+    uint64_t quantile(double q) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(q * n + 0.5)), seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            seen += counts[i].load(memory_order_relaxed);
+            if (seen >= rank) return min(bucketUpperBound(i), maxValue.load(memory_order_relaxed));
+        }
+        return maxValue.load(memory_order_relaxed);
+    }
+
+private:
+    atomic<uint64_t> counts[HISTOGRAM_BUCKETS] = {};
+    atomic<uint64_t> total{0}, sum{0}, maxValue{0};
+
+    static size_t bucketOf(uint64_t v) {
+        if (v < 2 * HISTOGRAM_HALF) return v;
+        int shift = highestBit(v) - (HISTOGRAM_SUB_BITS - 1);
+        return shift * HISTOGRAM_HALF + (v >> shift);
+    }
+
+    static uint64_t bucketUpperBound(size_t i) {
+        if (i < 2 * HISTOGRAM_HALF) return i;
+        size_t shift = i / HISTOGRAM_HALF - 1;
+        uint64_t top = i % HISTOGRAM_HALF + HISTOGRAM_HALF;
+        return ((top + 1) << shift) - 1;
+    }
+};
+
+struct AnalysisMetrics {
+    Histogram latencyMicros, rowsScanned, matches;
+};
+
+struct Metrics {
+    Histogram loadMicros;
+    AnalysisMetrics heap, hashTable, query;
+};
+
+Metrics metrics;
+
+void recordAnalysis(AnalysisMetrics &m, long long micros, size_t rows, size_t matches) {
+    m.latencyMicros.record(static_cast<uint64_t>(max(0LL, micros)));
+    m.rowsScanned.record(rows);
+    m.matches.record(matches);
+}
+
+// Appends one histogram as a Prometheus summary. `scale` converts
+// recorded units (e.g. microseconds to seconds).
+void appendSummary(ostringstream &out, const string &name, const string &labels, const Histogram &h, double scale) {
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    string sep = labels.empty() ? "" : ",";
+    for (double q : quantiles)
+        out << name << "{" << labels << sep << "quantile=\"" << q << "\"} " << h.quantile(q) * scale << "\n";
+    string braces = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << braces << " " << h.valueSum() * scale << "\n";
+    out << name << "_count" << braces << " " << h.count() << "\n";
+}
+
+string renderMetrics() {
+    ostringstream out;
+    out.precision(9);
+    out << "# HELP yt_load_duration_seconds Time to load all datasets.\n";
+    out << "# TYPE yt_load_duration_seconds summary\n";
+    appendSummary(out, "yt_load_duration_seconds", "", metrics.loadMicros, 1e-6);
+
+    const pair<const char *, const AnalysisMetrics *> analyses[] = {{"heap", &metrics.heap},
+                                                                   {"hash_table", &metrics.hashTable},
+                                                                   {"query", &metrics.query}};
+    const struct {
+        const char *name, *help;
+        const Histogram AnalysisMetrics::*histogram;
+        double scale;
+    } series[] = {
+        {"yt_analysis_latency_seconds", "Analysis latency.", &AnalysisMetrics::latencyMicros, 1e-6},
+        {"yt_analysis_rows_scanned", "Rows scanned per analysis.", &AnalysisMetrics::rowsScanned, 1.0},
+        {"yt_analysis_matches", "Tag matches found per analysis.", &AnalysisMetrics::matches, 1.0},
+    };
+    for (const auto &metric : series) {
+        out << "# HELP " << metric.name << " " << metric.help << "\n";
+        out << "# TYPE " << metric.name << " summary\n";
+        for (const auto &a : analyses)
+            appendSummary(out, metric.name, string("analysis=\"") + a.first + "\"", a.second->*metric.histogram, metric.scale);
+    }
+    return out.str();
+}
+
+// Rewrites the metrics file atomically (textfile-collector style).
+string metricsFile;
+
+void publishMetrics() {
+    if (metricsFile.empty()) return;
+    string tmp = metricsFile + ".tmp";
+    {
+        ofstream out(tmp);
+        out << renderMetrics();
+        if (!out) {
+            cerr << "Error: Could not write " << tmp << endl;
+            return;
+        }
+    }
+    error_code ec;
+    fs::rename(tmp, metricsFile, ec);
+    if (ec) cerr << "Error: Could not replace " << metricsFile << ": " << ec.message() << endl;
+}
+
+// Serves the metrics over HTTP on 127.0.0.1:port from a
+// background thread; every request gets the current snapshot.
+bool startMetricsServer(int port) {
+#ifdef _WIN32
+    cerr << "Error: --metrics-port is not supported on Windows, use --metrics-file\n";
+    (void)port;
+    return false;
+#else
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0) return false;
+    int yes = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (::bind(server, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(server, 16) != 0) {
+        cerr << "Error: Could not listen on 127.0.0.1:" << port << endl;
+        ::close(server);
+        return false;
+    }
+    thread([server] {
+        while (true) {
+            int client = accept(server, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            char request[1024];
+            if (recv(client, request, sizeof(request), 0) >= 0) {
+                string body = renderMetrics();
+                string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                                  to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+                for (size_t sent = 0; sent < response.size();) {
+                    ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0) break;
+                    sent += n;
+                }
+            }
+            ::close(client);
+        }
+    }).detach();
+    cout << "Serving metrics on http://127.0.0.1:" << port << "/metrics\n";
+    return true;
+#endif
+}
+
+// ------------------------------------------------------------
+// Huge-page backed memory
+//
+// Large column buffers are placed on 2 MB pages so random probes
+// into them do not thrash the TLB. Explicit huge pages
+// (MAP_HUGETLB) are tried first, then transparent huge pages via
+// madvise(MADV_HUGEPAGE); small requests, and systems without
+// either, use the regular heap.
+// ------------------------------------------------------------
+const size_t HUGE_PAGE_BYTES = 2 << 20;
+
+// Owning subsystem of each live huge-page mapping, for accounting.
+mutex hugePageLock;
+unordered_map<void *, MemorySubsystem> hugePageOwners;
+
+void *trackHugePages(void *p, size_t bytes) {
+    MemorySubsystem owner = currentSubsystem;
+    recordAllocation(owner, bytes);
+    lock_guard<mutex> lock(hugePageLock);
+    hugePageOwners[p] = owner;
+    return p;
+}
+
+void *hugePageAlloc(size_t bytes) {
+#ifndef _WIN32
+    if (bytes >= HUGE_PAGE_BYTES) {
+        size_t rounded = (bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+#ifdef MAP_HUGETLB
+        void *p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) return trackHugePages(p, rounded);
+#endif
+        // Over-allocate so the region can be trimmed to a 2 MB boundary.
+        void *raw = mmap(nullptr, rounded + HUGE_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw bad_alloc();
+        uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = (begin + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+        if (aligned > begin) munmap(raw, aligned - begin);
+        munmap(reinterpret_cast<void *>(aligned + rounded), begin + HUGE_PAGE_BYTES - aligned);
+#ifdef MADV_HUGEPAGE
+        madvise(reinterpret_cast<void *>(aligned), rounded, MADV_HUGEPAGE);
+#endif
+        return trackHugePages(reinterpret_cast<void *>(aligned), rounded);
+    }
+#endif
+    return ::operator new(bytes);
+}
+
+void hugePageFree(void *p, size_t bytes) {
+#ifndef _WIN32
+    if (bytes >= HUGE_PAGE_BYTES) {
+        size_t rounded = (bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+        {
+            lock_guard<mutex> lock(hugePageLock);
+            auto it = hugePageOwners.find(p);
+            if (it != hugePageOwners.end()) {
+                recordFree(it->second, rounded);
+                hugePageOwners.erase(it);
+            }
+        }
+        munmap(p, rounded);
+        return;
+    }
+#endif
+    ::operator delete(p);
+}
+
+template <typename T>
+struct HugePageAllocator {
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(hugePageAlloc(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { hugePageFree(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const HugePageAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U> &) const { return false; }
+};
+
+using ByteBuffer = vector<char, HugePageAllocator<char>>;
+
+// ------------------------------------------------------------
+// Columns
+//
+// A huge-page vector that can instead view values owned by a
+// mapping (a shared-memory dataset, see attachSharedDataset), so
+// attached instances read rows and indexes in place. Any
+// non-const access to a viewed column first copies it into
+// storage of its own. A writable view (a block built in place,
+// see placeOnNumaNodes) is only copied to change its size.
+// ------------------------------------------------------------
+template <typename T>
+class Column {
+public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    Column() = default;
+    explicit Column(size_t n) : store(n) { sync(); }
+    Column(const Column &other) : store(other.begin(), other.end()) { sync(); }
+    Column(Column &&other) noexcept { swap(other); }
+    Column &operator=(Column other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    // Views values[0, n); `owner` keeps them alive.
+    void adopt(const T *values, size_t n, shared_ptr<const void> owner, bool writable = false) {
+        Store().swap(store);
+        first = const_cast<T *>(values);
+        count = n;
+        keeper = move(owner);
+        inPlace = writable;
+    }
+    bool isView() const { return keeper != nullptr; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T *data() const { return first; }
+    const T *begin() const { return first; }
+    const T *end() const { return first + count; }
+    const T &operator[](size_t i) const { return first[i]; }
+    const T &back() const { return first[count - 1]; }
+
+    T *data() { return own(); }
+    T *begin() { return own(); }
+    T *end() { return own() + count; }
+    T &operator[](size_t i) { return own()[i]; }
+    T &back() { return own()[count - 1]; }
+
+    void push_back(const T &value) { change([&] { store.push_back(value); }); }
+    void push_back(T &&value) { change([&] { store.push_back(move(value)); }); }
+    void reserve(size_t n) { change([&] { store.reserve(n); }); }
+    void resize(size_t n) { change([&] { store.resize(n); }); }
+    void resize(size_t n, const T &value) { change([&] { store.resize(n, value); }); }
+    void assign(size_t n, const T &value) { change([&] { store.assign(n, value); }); }
+    template <typename It>
+    void assign(It from, It to) { change([&] { store.assign(from, to); }); }
+    template <typename It>
+    void insert(const T *at, It from, It to) {
+        size_t pos = at - first;
+        change([&] { store.insert(store.begin() + pos, from, to); });
+    }
+    void clear() { change([&] { store.clear(); }); }
+
+    void swap(Column &other) noexcept {
+        store.swap(other.store);
+        std::swap(first, other.first);
+        std::swap(count, other.count);
+        keeper.swap(other.keeper);
+        std::swap(inPlace, other.inPlace);
+    }
+
+private:
+    using Store = vector<T, HugePageAllocator<T>>;
+
+    void sync() {
+        first = store.data();
+        count = store.size();
+    }
+
+    T *own() {
+        if (keeper && !inPlace) copyToStore();
+        return first;
+    }
+
+    template <typename F>
+    void change(F f) {
+        if (keeper) copyToStore();
+        f();
+        sync();
+    }
+
+    void copyToStore() {
+        Store copy(first, first + count);
+        store.swap(copy);
+        keeper.reset();
+        inPlace = false;
+        sync();
+    }
+
+    Store store;
+    T *first = nullptr;
+    size_t count = 0;
+    shared_ptr<const void> keeper; // the mapping of a viewed column
+    bool inPlace = false;          // the view is writable
+};
+
+using VideoTable = Column<Video>;
+
+// ------------------------------------------------------------
+// Append-only text arenas
+//
+// Titles and descriptions are the widest CSV fields and are only
+// scanned or printed, so rows do not own them as strings. Each
+// loading thread appends to its own huge-page arena,
+// NUL-separated, and the row keeps a TextRef. Arenas are reserved
+// up front and never reallocate, so stored text stays put and
+// appends need no lock; only opening a new arena does. Text owned
+// elsewhere (a mapped dataset file or shared-memory dataset) can
+// be adopted as a read-only arena, so rows point straight into
+// the mapping and its pages are only read when a value is used.
+// ------------------------------------------------------------
+class TextArenas {
+public:
+    static const size_t ARENA_BYTES = 16 << 20;
+    static const uint32_t MAX_ARENAS = 4096;
+
+    explicit TextArenas(MemorySubsystem owner, size_t bytes = ARENA_BYTES) : subsystem(owner), arenaBytes(bytes) {}
+
+    TextRef append(const char *text, size_t length) {
+        if (length == 0) return TextRef();
+        if (length > UINT32_MAX) length = UINT32_MAX;
+        MemoryScope scope(subsystem);
+        ThreadArena &current = threadArena();
+        if (current.owner != this || current.arena == nullptr || current.epoch != epoch ||
+            current.arena->capacity() - current.arena->size() < length + 1)
+            open(current, length + 1);
+        TextRef ref;
+        ref.arena = current.id;
+        ref.offset = current.arena->size();
+        ref.length = static_cast<uint32_t>(length);
+        current.arena->insert(current.arena->end(), text, text + length);
+        current.arena->push_back('\0');
+        return ref;
+    }
+
+    TextRef append(const string &text) { return append(text.data(), text.size()); }
+
+    // Registers `text` as a read-only arena; `owner` keeps it alive.
+    // `encoded` marks an arena of stringSymbols codes rather than text.
+    uint32_t adopt(const char *text, shared_ptr<const void> owner, bool encoded = false) {
+        lock_guard<mutex> guard(lock);
+        uint32_t id = arenaCount.load(memory_order_relaxed);
+        if (id == MAX_ARENAS) throw runtime_error("text arenas exhausted");
+        bases[id] = text;
+        codes[id] = encoded;
+        owners.push_back(move(owner));
+        arenaCount.store(id + 1, memory_order_release);
+        return id;
+    }
+
+    const char *data(const TextRef &ref) const { return bases[ref.arena] + ref.offset; }
+    string_view view(const TextRef &ref) const { return ref.length ? string_view(data(ref), ref.length) : string_view(); }
+    string str(const TextRef &ref) const { return string(view(ref)); }
+
+    uint32_t count() const { return arenaCount.load(memory_order_acquire); }
+
+    // Frees every arena and releases adopted ones, invalidating all
+    // TextRefs into them. Only while no other thread uses the arenas.
+    void reset() {
+        lock_guard<mutex> guard(lock);
+        for (uint32_t id = 0; id < arenaCount.load(memory_order_relaxed); ++id) {
+            arenas[id].reset();
+            bases[id] = nullptr;
+            codes[id] = false;
+        }
+        vector<shared_ptr<const void>>().swap(owners);
+        arenaCount.store(0, memory_order_release);
+        ++epoch; // threads' open arenas are gone
+    }
+
+    // Whether `arena` was registered through adopt(), and with `encoded` set.
+    bool adopted(uint32_t arena) const { return arenas[arena] == nullptr; }
+    bool encoded(uint32_t arena) const { return codes[arena]; }
+
+private:
+    struct ThreadArena {
+        const TextArenas *owner = nullptr;
+        ByteBuffer *arena = nullptr;
+        uint32_t id = 0;
+        uint64_t epoch = 0;
+    };
+
+    // The calling thread's open arena in this instance; a thread
+    // keeps one per instance so loading titles and descriptions
+    // side by side does not keep reopening arenas.
+    ThreadArena &threadArena() {
+        thread_local ThreadArena current[4];
+        for (auto &slot : current)
+            if (slot.owner == this || slot.owner == nullptr) return slot;
+        return current[0];
+    }
+
+    void open(ThreadArena &current, size_t bytes) {
+        lock_guard<mutex> guard(lock);
+        uint32_t id = arenaCount.load(memory_order_relaxed);
+        if (id == MAX_ARENAS) throw runtime_error("text arenas exhausted");
+        arenas[id].reset(new ByteBuffer());
+        arenas[id]->reserve(max(bytes, arenaBytes));
+        bases[id] = arenas[id]->data();
+        arenaCount.store(id + 1, memory_order_release);
+        current.owner = this;
+        current.arena = arenas[id].get();
+        current.id = id;
+        current.epoch = epoch;
+    }
+
+    MemorySubsystem subsystem;
+    size_t arenaBytes;
+    mutex lock;
+    unique_ptr<ByteBuffer> arenas[MAX_ARENAS];
+    const char *bases[MAX_ARENAS] = {};
+    bool codes[MAX_ARENAS] = {};
+    vector<shared_ptr<const void>> owners;
+    atomic<uint32_t> arenaCount{0};
+    uint64_t epoch = 0; // bumped by reset()
+};
+
+TextArenas titleArenas(MEM_TITLES, 1 << 20); // compressed titles that cannot stay in place
+TextArenas descriptionArenas(MEM_DESCRIPTIONS);
+TextArenas tagArenas(MEM_TAGS, 1 << 20);      // compressed tag lists
+
+// ------------------------------------------------------------
+// Symbol table string compression (FSST)
+//
+// Titles and tags are short, so block compressors gain little on
+// them and would have to decode a whole block to read one string.
+// As in FSST (Boncz, Neumann and Leis, VLDB 2020), a table of up
+// to 254 symbols of 1-8 bytes is trained on a sample, and every
+// string is encoded on its own as one-byte codes: a symbol,
+// ESCAPE followed by a literal byte, or END closing one string of
+// a list. Any single string decodes without its neighbours at one
+// 8-byte store per code. Encoding is a greedy longest match, so
+// equal strings always get equal codes.
+// ------------------------------------------------------------
+const size_t SYMBOL_SAMPLE_BYTES = 64 << 10;
+
+class SymbolTable {
+public:
+    static const unsigned MAX_SYMBOLS = 254;
+    static const uint8_t CODE_END = 254, CODE_ESCAPE = 255;
+
+    SymbolTable() { index(); }
+
+    // Rebuilds the table in a few rounds of encoding the sample and
+    // keeping the symbols, and pairs of adjacent symbols, that cover
+    // the most sample bytes.
+    void train(const vector<string> &sample) {
+        count = 0;
+        index();
+        for (int round = 0; round < 5; ++round) {
+            unordered_map<string, uint64_t> frequency;
+            for (const auto &text : sample) {
+                const char *p = text.data(), *end = p + text.size();
+                string previous;
+                while (p < end) {
+                    int code = longestMatch(p, end - p);
+                    string unit = code < 0 ? string(1, *p) : string(p, lengths[code]);
+                    p += unit.size();
+                    ++frequency[unit];
+                    if (!previous.empty() && previous.size() + unit.size() <= 8) ++frequency[previous + unit];
+                    previous = move(unit);
+                }
+            }
+            vector<pair<uint64_t, string>> candidates;
+            for (auto &entry : frequency) candidates.push_back({entry.second * entry.first.size(), entry.first});
+            // Highest gain first; ties broken by bytes so training is deterministic.
+            sort(candidates.begin(), candidates.end(), [](const pair<uint64_t, string> &a, const pair<uint64_t, string> &b) {
+                return a.first != b.first ? a.first > b.first : a.second < b.second;
+            });
+            count = static_cast<unsigned>(min<size_t>(candidates.size(), MAX_SYMBOLS));
+            for (unsigned c = 0; c < count; ++c) {
+                symbols[c] = 0;
+                memcpy(&symbols[c], candidates[c].second.data(), candidates[c].second.size());
+                lengths[c] = static_cast<uint8_t>(candidates[c].second.size());
+            }
+            index();
+        }
+    }
+
+    // Replaces the table with n symbols stored elsewhere, as read
+    // through symbol() and length() from the table that encoded them.
+    void load(const uint64_t *stored, const uint8_t *storedLengths, unsigned n) {
+        count = n < MAX_SYMBOLS ? n : MAX_SYMBOLS;
+        for (unsigned c = 0; c < count; ++c) {
+            symbols[c] = stored[c];
+            lengths[c] = storedLengths[c];
+        }
+        index();
+    }
+
+    // Appends the codes of `text` to `out`.
+    void encode(string_view text, string &out) const {
+        const char *p = text.data(), *end = p + text.size();
+        while (p < end) {
+            int code = longestMatch(p, end - p);
+            if (code < 0) {
+                out += static_cast<char>(CODE_ESCAPE);
+                out += *p++;
+            } else {
+                out += static_cast<char>(code);
+                p += lengths[code];
+            }
+        }
+    }
+
+    // Appends the text of codes[0, n), which must not contain END.
+    void decode(const char *codes, size_t n, string &out) const {
+        size_t used = out.size();
+        out.resize(used + n * 8);
+        char *dst = &out[used];
+        for (size_t i = 0; i < n; ++i) {
+            uint8_t code = static_cast<uint8_t>(codes[i]);
+            if (code == CODE_ESCAPE) {
+                *dst++ = codes[++i];
+            } else {
+                memcpy(dst, &symbols[code], 8);
+                dst += lengths[code];
+            }
+        }
+        out.resize(dst - out.data());
+    }
+
+    unsigned size() const { return count; }
+    const char *symbol(uint8_t code) const { return reinterpret_cast<const char *>(&symbols[code]); }
+    unsigned length(uint8_t code) const { return lengths[code]; }
+
+    // Whether both tables give every code the same symbol.
+    bool sameSymbols(const SymbolTable &other) const {
+        if (count != other.count) return false;
+        for (unsigned c = 0; c < count; ++c)
+            if (symbols[c] != other.symbols[c] || lengths[c] != other.lengths[c]) return false;
+        return true;
+    }
+
+    // Whether codes[0, n) read from elsewhere end on a whole code,
+    // so decode() stays within them.
+    static bool complete(const char *codes, size_t n) {
+        size_t i = 0;
+        while (i < n) i += static_cast<uint8_t>(codes[i]) == CODE_ESCAPE ? 2 : 1;
+        return i == n;
+    }
+
+private:
+    // Code of the longest symbol that prefixes p[0, left), or -1.
+    int longestMatch(const char *p, size_t left) const {
+        uint64_t word = 0;
+        memcpy(&word, p, min<size_t>(left, 8));
+        for (uint8_t code : byFirstByte[static_cast<uint8_t>(*p)]) {
+            unsigned n = lengths[code];
+            uint64_t mask = n == 8 ? ~0ULL : (1ULL << (n * 8)) - 1;
+            if (n <= left && ((word ^ symbols[code]) & mask) == 0) return code;
+        }
+        return -1;
+    }
+
+    void index() {
+        for (auto &codes : byFirstByte) codes.clear();
+        for (unsigned c = 0; c < count; ++c) byFirstByte[symbols[c] & 0xFF].push_back(static_cast<uint8_t>(c));
+        for (auto &codes : byFirstByte)
+            sort(codes.begin(), codes.end(), [&](uint8_t a, uint8_t b) {
+                return lengths[a] != lengths[b] ? lengths[a] > lengths[b] : a < b;
+            });
+    }
+
+    uint64_t symbols[256] = {}; // little-endian bytes, zero padded
+    uint8_t lengths[256] = {};
+    unsigned count = 0;
+    vector<uint8_t> byFirstByte[256]; // longest first
+};
+
+// Shared by every title and tag; trained once per run by the first
+// loader to call trainStringSymbols (until then every byte is escaped).
+SymbolTable stringSymbols;
+once_flag stringSymbolsTrained; // one flag for every Sample type
+
+template <typename Sample>
+void trainStringSymbols(Sample sample) {
+    call_once(stringSymbolsTrained, [&] { stringSymbols.train(sample()); });
+}
+
+// Strings collected for training, up to SYMBOL_SAMPLE_BYTES.
+struct SymbolSample {
+    vector<string> strings;
+    size_t bytes = 0;
+
+    bool full() const { return bytes >= SYMBOL_SAMPLE_BYTES; }
+    void add(string_view text) {
+        if (full()) return;
+        strings.emplace_back(text);
+        bytes += text.size();
+    }
 };
 
-// ------------------------------------------------------------
-// Utility: split string by a delimiter
-// ------------------------------------------------------------
-vector<string> split(const string &s, char delim) {
-    vector<string> elems;
-    stringstream ss(s);
-    string item;
-    while (getline(ss, item, delim)) {
-        if (!item.empty())
-            elems.push_back(item);
+// ------------------------------------------------------------
+// Encoded tag lists: each tag's codes followed by END
+// ------------------------------------------------------------
+string encodeTags(const vector<string> &tags) {
+    string codes;
+    for (const auto &tag : tags) {
+        stringSymbols.encode(tag, codes);
+        codes += static_cast<char>(SymbolTable::CODE_END);
+    }
+    return codes;
+}
+
+// Calls f(string_view) for each tag of an encoded list, in order.
+template <typename F>
+void forEachTag(const TextRef &ref, F f) {
+    thread_local string tag;
+    const char *codes = tagArenas.data(ref);
+    size_t begin = 0;
+    for (size_t i = 0; i < ref.length; ++i) {
+        uint8_t code = static_cast<uint8_t>(codes[i]);
+        if (code == SymbolTable::CODE_ESCAPE) {
+            ++i;
+        } else if (code == SymbolTable::CODE_END) {
+            tag.clear();
+            stringSymbols.decode(codes + begin, i - begin, tag);
+            f(string_view(tag));
+            begin = i + 1;
+        }
+    }
+}
+
+vector<string> decodeTags(const TextRef &ref) {
+    vector<string> tags;
+    forEachTag(ref, [&](string_view tag) { tags.emplace_back(tag); });
+    return tags;
+}
+
+// ------------------------------------------------------------
+// Substring matching on encoded tags
+//
+// The KMP automaton of the pattern is lifted from bytes to codes:
+// for every state and symbol the table holds the state after the
+// symbol's bytes, with MATCHED set if the pattern ends inside
+// them. Each tag of an encoded list is then matched at one table
+// lookup per code, without decoding. State m (the pattern length)
+// absorbs the rest of a tag that already matched. Patterns longer
+// than MAX_PATTERN decode the tags and search the text instead.
+// ------------------------------------------------------------
+class TagMatcher {
+public:
+    static const size_t MAX_PATTERN = 256;
+
+    explicit TagMatcher(const string &pattern) : text(pattern), m(pattern.size()) {
+        if (m == 0 || m > MAX_PATTERN) return;
+        // Byte automaton (states 0..m, m = matched).
+        vector<uint32_t> dfa((m + 1) * 256, 0);
+        dfa[static_cast<uint8_t>(pattern[0])] = 1;
+        for (size_t j = 1, x = 0; j < m; ++j) {
+            for (int c = 0; c < 256; ++c) dfa[j * 256 + c] = dfa[x * 256 + c];
+            dfa[j * 256 + static_cast<uint8_t>(pattern[j])] = static_cast<uint32_t>(j + 1);
+            x = dfa[x * 256 + static_cast<uint8_t>(pattern[j])];
+        }
+        byteNext.assign((m + 1) * 256, static_cast<uint32_t>(m));
+        codeNext.assign((m + 1) * 256, static_cast<uint32_t>(m));
+        for (size_t state = 0; state < m; ++state) {
+            for (int c = 0; c < 256; ++c) {
+                uint32_t next = dfa[state * 256 + c];
+                byteNext[state * 256 + c] = next == m ? (MATCHED | static_cast<uint32_t>(m)) : next;
+            }
+            for (unsigned code = 0; code < stringSymbols.size(); ++code) {
+                uint32_t s = static_cast<uint32_t>(state);
+                const char *bytes = stringSymbols.symbol(static_cast<uint8_t>(code));
+                for (unsigned k = 0; k < stringSymbols.length(static_cast<uint8_t>(code)) && s != m; ++k)
+                    s = dfa[s * 256 + static_cast<uint8_t>(bytes[k])];
+                codeNext[state * 256 + code] = s == m ? (MATCHED | s) : s;
+            }
+        }
+    }
+
+    // Number of tags in an encoded list that contain the pattern.
+    size_t count(const TextRef &ref) const {
+        size_t matches = 0;
+        if (m == 0 || m > MAX_PATTERN) {
+            forEachTag(ref, [&](string_view tag) { matches += tag.find(text) != string_view::npos; });
+            return matches;
+        }
+        const char *codes = tagArenas.data(ref);
+        uint32_t state = 0;
+        for (size_t i = 0; i < ref.length; ++i) {
+            uint8_t code = static_cast<uint8_t>(codes[i]);
+            uint32_t next;
+            if (code == SymbolTable::CODE_END) {
+                state = 0;
+                continue;
+            } else if (code == SymbolTable::CODE_ESCAPE) {
+                next = byteNext[state * 256 + static_cast<uint8_t>(codes[++i])];
+            } else {
+                next = codeNext[state * 256 + code];
+            }
+            matches += next >> 31;
+            state = next & ~MATCHED;
+        }
+        return matches;
+    }
+
+private:
+    static const uint32_t MATCHED = 1u << 31;
+
+    string text;
+    size_t m;
+    vector<uint32_t> byteNext, codeNext; // [state * 256 + byte or code]
+};
+
+// ------------------------------------------------------------
+// Interned strings
+//
+// The same video trends on many days and in several countries
+// under an identical title, so titles are hash-consed into a pool
+// and rows keep a 32-bit id: equal titles have equal ids. Each
+// distinct title is stored once, in place in a mapped file where
+// possible (already compressed, in a .ytc file) and otherwise
+// compressed with stringSymbols into the pool's TextArenas. Lookups are spread over SHARDS separately
+// locked hash tables so parser threads rarely wait on each other;
+// compressed entries are found by the hash of their text and
+// compared decoded, so a value interned before the symbols were
+// trained still matches later copies of it. Ids index entries
+// kept in fixed-size chunks that never move, so resolving an id
+// takes no lock. Id 0 is the empty string.
+// ------------------------------------------------------------
+class StringPool {
+public:
+    static const unsigned SHARDS = 64;
+    static const uint32_t CHUNK_IDS = 1 << 16;
+    static const uint32_t MAX_CHUNKS = 1 << 16;
+
+    StringPool(TextArenas &storage, MemorySubsystem owner) : text(storage), subsystem(owner) {}
+    ~StringPool() {
+        for (uint32_t c = adoptedChunks; c < MAX_CHUNKS; ++c) delete[] chunks[c].load(memory_order_relaxed);
+    }
+
+    StringPool(const StringPool &) = delete;
+    StringPool &operator=(const StringPool &) = delete;
+
+    // Id of `value`. For a new value `inPlace` is called and may
+    // return a TextRef in an adopted arena holding exactly the
+    // value's bytes, or its stringSymbols codes if the arena was
+    // adopted as encoded; if it returns an empty ref, the value is
+    // compressed into the pool's own arenas instead.
+    template <typename InPlace>
+    uint32_t intern(string_view value, InPlace inPlace) {
+        if (value.empty()) return 0;
+        MemoryScope scope(subsystem);
+        thread_local string scratch;
+        size_t key = hash<string_view>()(value);
+        Shard &shard = shards[key % SHARDS];
+        lock_guard<mutex> guard(shard.lock);
+        auto it = shard.raw.find(value);
+        if (it != shard.raw.end()) return it->second;
+        for (auto range = shard.coded.equal_range(key); range.first != range.second; ++range.first)
+            if (view(range.first->second, scratch) == value) return range.first->second;
+
+        uint32_t id = next.fetch_add(1, memory_order_relaxed);
+        if (id / CHUNK_IDS >= MAX_CHUNKS) throw runtime_error("string pool exhausted");
+        TextRef &ref = slot(id);
+        ref = inPlace();
+        if (ref.length != 0 && !text.encoded(ref.arena)) {
+            shard.raw.emplace(text.view(ref), id);
+        } else if (ref.length != 0) {
+            shard.coded.emplace(key, id);
+        } else {
+            scratch.clear();
+            stringSymbols.encode(value, scratch);
+            ref = text.append(scratch);
+            shard.coded.emplace(key, id);
+        }
+        return id;
+    }
+
+    uint32_t intern(string_view value) {
+        return intern(value, [] { return TextRef(); });
+    }
+
+    // Takes over the n entries of a pool stored elsewhere (a shared
+    // dataset), id i at entries[i], in place; their text must be in
+    // adopted arenas and `owner` keeps them alive. Only for an empty
+    // pool. Ids interned later start at the next chunk and are not
+    // deduplicated against the adopted values.
+    void adopt(const TextRef *entries, uint32_t n, shared_ptr<const void> owner) {
+        if (size() != 1 || adoptedChunks) throw runtime_error("string pool is not empty");
+        uint32_t used = (n + CHUNK_IDS - 1) / CHUNK_IDS;
+        if (used >= MAX_CHUNKS) throw runtime_error("string pool exhausted");
+        for (uint32_t c = 0; c < used; ++c)
+            chunks[c].store(const_cast<TextRef *>(entries) + size_t(c) * CHUNK_IDS, memory_order_release);
+        adoptedChunks = used;
+        adoptedOwner = move(owner);
+        next.store(max<uint32_t>(used * CHUNK_IDS, 1), memory_order_release);
+    }
+
+    // Text of `id`; compressed entries are decoded into `scratch`.
+    string_view view(uint32_t id, string &scratch) const {
+        if (id == 0) return string_view();
+        const TextRef &ref = chunks[id / CHUNK_IDS].load(memory_order_acquire)[id % CHUNK_IDS];
+        if (text.adopted(ref.arena) && !text.encoded(ref.arena)) return text.view(ref);
+        scratch.clear();
+        stringSymbols.decode(text.data(ref), ref.length, scratch);
+        return scratch;
+    }
+
+    string str(uint32_t id) const {
+        string scratch;
+        return string(view(id, scratch));
+    }
+
+    // Every id handed out so far is below size().
+    uint32_t size() const { return next.load(memory_order_acquire); }
+
+    // Forgets every value but the empty string; the caller resets the
+    // text arenas. Only while no other thread uses the pool.
+    void reset() {
+        for (auto &shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            shard.raw.clear();
+            shard.coded.clear();
+        }
+        for (uint32_t c = 0; c < MAX_CHUNKS; ++c) {
+            if (c >= adoptedChunks) delete[] chunks[c].load(memory_order_relaxed);
+            chunks[c].store(nullptr, memory_order_relaxed);
+        }
+        adoptedChunks = 0;
+        adoptedOwner.reset();
+        next.store(1, memory_order_release);
+    }
+
+private:
+    struct Shard {
+        mutex lock;
+        unordered_map<string_view, uint32_t> raw;     // entries in place, by text
+        unordered_multimap<size_t, uint32_t> coded; // compressed entries, by hash of their text
+    };
+
+    TextRef &slot(uint32_t id) {
+        atomic<TextRef *> &chunk = chunks[id / CHUNK_IDS];
+        TextRef *p = chunk.load(memory_order_acquire);
+        if (!p) {
+            TextRef *fresh = new TextRef[CHUNK_IDS];
+            if (chunk.compare_exchange_strong(p, fresh, memory_order_acq_rel))
+                p = fresh;
+            else
+                delete[] fresh;
+        }
+        return p[id % CHUNK_IDS];
+    }
+
+    TextArenas &text;
+    MemorySubsystem subsystem;
+    Shard shards[SHARDS];
+    atomic<TextRef *> chunks[MAX_CHUNKS] = {}; // text in an adopted arena, else symbol codes
+    atomic<uint32_t> next{1};
+    uint32_t adoptedChunks = 0; // chunks [0, adoptedChunks) are entries owned by adoptedOwner
+    shared_ptr<const void> adoptedOwner;
+};
+
+StringPool titlePool(titleArenas, MEM_TITLES);
+
+// Frees every title, tag list and description loaded so far, so the
+// datasets can be loaded again from scratch; rows referring to them
+// must be dropped first. Country codes and the symbols are kept.
+void resetLoadedText() {
+    titlePool.reset();
+    titleArenas.reset();
+    descriptionArenas.reset();
+    tagArenas.reset();
+}
+
+// ------------------------------------------------------------
+// Dataset country codes
+//
+// A run sees a handful of codes, one per dataset file, so rows
+// keep a 16-bit id. Id 0 is the empty code of rows whose dataset
+// has none. Codes are never removed, so references stay valid.
+// ------------------------------------------------------------
+class CountryCodes {
+public:
+    CountryCodes() { intern(string()); }
+
+    uint16_t intern(const string &code) {
+        lock_guard<mutex> guard(lock);
+        auto it = ids.find(code);
+        if (it != ids.end()) return it->second;
+        if (names.size() > UINT16_MAX) throw runtime_error("too many country codes");
+        uint16_t id = static_cast<uint16_t>(names.size());
+        names.push_back(code);
+        ids.emplace(code, id);
+        return id;
+    }
+
+    const string &name(uint16_t id) const {
+        lock_guard<mutex> guard(lock);
+        return names[id];
+    }
+
+    size_t size() const {
+        lock_guard<mutex> guard(lock);
+        return names.size();
+    }
+
+private:
+    mutable mutex lock;
+    deque<string> names;
+    unordered_map<string, uint16_t> ids;
+};
+
+CountryCodes countryCodes;
+
+// ------------------------------------------------------------
+// dTLB miss counter for the calling thread (Linux perf events).
+// Reports -1 where hardware counters are unavailable.
+// ------------------------------------------------------------
+class DtlbMissCounter {
+public:
+    DtlbMissCounter() {
+#ifdef PERF_COUNTERS
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1; // include worker threads started while counting
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    ~DtlbMissCounter() {
+#ifdef PERF_COUNTERS
+        if (fd >= 0) ::close(fd);
+#endif
+    }
+
+    DtlbMissCounter(const DtlbMissCounter &) = delete;
+    DtlbMissCounter &operator=(const DtlbMissCounter &) = delete;
+
+    long long read() const {
+#ifdef PERF_COUNTERS
+        long long count = 0;
+        if (fd >= 0 && ::read(fd, &count, sizeof(count)) == sizeof(count)) return count;
+#endif
+        return -1;
+    }
+
+private:
+    int fd = -1;
+};
+
+string formatTlbMisses(long long misses) {
+    return misses < 0 ? "" : ", " + to_string(misses) + " dTLB misses";
+}
+
+// ------------------------------------------------------------
+// Utility: split string by a delimiter
+// ------------------------------------------------------------
+vector<string> split(const string &s, char delim) {
+    vector<string> elems;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, delim)) {
+        if (!item.empty())
+            elems.push_back(item);
+    }
+    return elems;
+}
+
+// ------------------------------------------------------------
+// Parse a CSV line safely (handles quoted commas)
+// ------------------------------------------------------------
+// fieldStarts, if given, receives the offset in `line` where each
+// raw field starts, followed by line.size() + 1.
+vector<string> parseCSVLine(const string &line, vector<size_t> *fieldStarts = nullptr) {
+    vector<string> result;
+    string current;
+    bool inQuotes = false;
+
+    if (fieldStarts) fieldStarts->assign(1, 0);
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '"') {
+            inQuotes = !inQuotes;
+        } else if (c == ',' && !inQuotes) {
+            result.push_back(current);
+            current.clear();
+            if (fieldStarts) fieldStarts->push_back(i + 1);
+        } else {
+            current += c;
+        }
+    }
+    result.push_back(current);
+    if (fieldStarts) fieldStarts->push_back(line.size() + 1);
+    return result;
+}
+
+// ------------------------------------------------------------
+// Dataset file naming: plain .csv, a compressed .csv.gz /
+// .csv.zst archive of the same CSV, a .ytc columnar file or an
+// Arrow IPC file (.arrow) / stream (.arrows)
+// ------------------------------------------------------------
+bool endsWith(const string &s, const string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool isDatasetFile(const string &name) {
+    return endsWith(name, ".csv") || endsWith(name, ".csv.gz") || endsWith(name, ".csv.zst") ||
+           endsWith(name, ".ytc") || endsWith(name, ".arrow") || endsWith(name, ".arrows");
+}
+
+// ------------------------------------------------------------
+// Read-only memory mapping of a whole file or POSIX
+// shared-memory object (files are read into memory where mmap
+// is unavailable)
+// ------------------------------------------------------------
+class MappedFile {
+public:
+    explicit MappedFile(const string &filename, bool sharedMemory = false) {
+#ifdef _WIN32
+        if (sharedMemory) return;
+        ifstream in(filename, ios::binary);
+        if (!in.is_open()) {
+            failure = errno;
+            return;
+        }
+        owned.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        bytes = owned.data();
+        length = owned.size();
+#else
+        int fd = sharedMemory ? shm_open(filename.c_str(), O_RDONLY, 0) : open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            failure = errno;
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            failure = errno;
+        } else if (st.st_size > 0) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                bytes = static_cast<const char *>(p);
+                length = st.st_size;
+            } else {
+                failure = errno;
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (bytes) munmap(const_cast<char *>(bytes), length);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+    int error() const { return failure; } // errno of a failed open or map, 0 if mapped or empty
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    int failure = 0;
+    vector<char> owned;
+};
+
+// ------------------------------------------------------------
+// In-process decompression of .csv.gz (zlib) and .csv.zst
+// (libzstd) files
+//
+// The compressed file is mapped, not read into memory, and split
+// into frames that decode on their own: every zstd frame, and gzip members whose header records
+// their size (BGZF, as written by bgzip). Frames are decoded by
+// worker threads and their output is handed out in file order,
+// so a single-frame file still decodes on a worker alongside the
+// parser. Any frame that fails to decode (a truncated or corrupt
+// file) fails the whole file.
+//
+// Built with -DWITH_ZLIB (link -lz) and -DWITH_ZSTD (link
+// -lzstd); without them such files are reported as unsupported.
+// ------------------------------------------------------------
+const size_t DECODED_PIECE_BYTES = 1 << 20;
+const size_t DECODED_PIECES_PER_FRAME = 4;
+
+class FrameDecoder {
+public:
+    explicit FrameDecoder(const string &filename) : zstd(endsWith(filename, ".zst")), input(filename) {
+#ifndef GZIP_FRAMES
+        if (!zstd) {
+            reason = "built without zlib";
+            return;
+        }
+#endif
+#ifndef ZSTD_FRAMES
+        if (zstd) {
+            reason = "built without libzstd";
+            return;
+        }
+#endif
+        if (!input.data()) {
+            reason = input.error() ? strerror(input.error()) : "unexpected end of file";
+            return;
+        }
+        splitFrames();
+        unsigned workerCount = static_cast<unsigned>(min<size_t>(frames.size(), max(1u, thread::hardware_concurrency())));
+        window = max<size_t>(1, 2 * workerCount);
+        for (unsigned i = 0; i < workerCount; ++i) workers.emplace_back([this] { work(); });
+        open = true;
+    }
+
+    ~FrameDecoder() { finish(); }
+
+    FrameDecoder(const FrameDecoder &) = delete;
+    FrameDecoder &operator=(const FrameDecoder &) = delete;
+
+    bool isOpen() const { return open; }
+    const string &problem() const { return reason; } // why the file could not be decoded
+
+    // Moves the next decoded bytes into `piece`; false at the end of
+    // the file or once a frame failed.
+    bool next(string &piece) {
+        unique_lock<mutex> lock(stateLock);
+        while (current < frames.size()) {
+            Frame &frame = *frames[current];
+            changed.wait(lock, [&] { return !frame.pieces.empty() || frame.done; });
+            if (!frame.pieces.empty()) {
+                piece = move(frame.pieces.front());
+                frame.pieces.pop_front();
+                changed.notify_all();
+                return true;
+            }
+            if (frame.failed) {
+                if (reason.empty()) reason = frame.error;
+                return false;
+            }
+            frames[current++].reset();
+            changed.notify_all();
+        }
+        return false;
+    }
+
+    // Stops the workers; false if any frame the reader reached failed.
+    bool finish() {
+        {
+            lock_guard<mutex> lock(stateLock);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (auto &t : workers) t.join();
+        workers.clear();
+        return reason.empty();
+    }
+
+private:
+    struct Frame {
+        size_t begin, end;
+        deque<string> pieces;
+        bool done = false, failed = false;
+        string error;
+    };
+
+    void splitFrames() {
+        size_t pos = 0;
+        while (pos < input.size()) {
+            size_t size = zstd ? zstdFrameSize(pos) : gzipMemberSize(pos);
+            if (size == 0 || size > input.size() - pos) size = input.size() - pos;
+            frames.emplace_back(new Frame{pos, pos + size, {}, false, false, {}});
+            pos += size;
+        }
+    }
+
+    // Size of the zstd frame at `pos`, 0 if it cannot be told from
+    // its headers (the rest of the file then decodes as one frame).
+    size_t zstdFrameSize(size_t pos) const {
+#ifdef ZSTD_FRAMES
+        size_t size = ZSTD_findFrameCompressedSize(input.data() + pos, input.size() - pos);
+        return ZSTD_isError(size) ? 0 : size;
+#else
+        (void)pos;
+        return 0;
+#endif
+    }
+
+    // Size of the gzip member at `pos` from its BGZF "BC" extra
+    // subfield, 0 for members that do not record it.
+    size_t gzipMemberSize(size_t pos) const {
+        const auto *p = reinterpret_cast<const unsigned char *>(input.data() + pos);
+        size_t left = input.size() - pos;
+        if (left < 12 || p[0] != 0x1f || p[1] != 0x8b || !(p[3] & 4)) return 0;
+        size_t extraBytes = p[10] | p[11] << 8;
+        if (left < 12 + extraBytes) return 0;
+        for (size_t i = 12; i + 4 <= 12 + extraBytes;) {
+            size_t length = p[i + 2] | p[i + 3] << 8;
+            if (p[i] == 'B' && p[i + 1] == 'C' && length == 2 && i + 6 <= 12 + extraBytes)
+                return (p[i + 4] | p[i + 5] << 8) + 1;
+            i += 4 + length;
+        }
+        return 0;
+    }
+
+    void work() {
+        MemoryScope scope(MEM_LOADER);
+        while (true) {
+            size_t index;
+            {
+                unique_lock<mutex> lock(stateLock);
+                changed.wait(lock, [&] { return stopping || claimed == frames.size() || claimed < current + window; });
+                if (stopping || claimed == frames.size()) return;
+                index = claimed++;
+            }
+            Frame &frame = *frames[index];
+            auto emit = [&](string &&piece) {
+                unique_lock<mutex> lock(stateLock);
+                changed.wait(lock, [&] { return stopping || frame.pieces.size() < DECODED_PIECES_PER_FRAME; });
+                if (stopping) return false;
+                frame.pieces.push_back(move(piece));
+                changed.notify_all();
+                return true;
+            };
+            string error = zstd ? decodeZstd(frame, emit) : decodeGzip(frame, emit);
+            {
+                lock_guard<mutex> lock(stateLock);
+                frame.done = true;
+                frame.failed = !error.empty();
+                frame.error = move(error);
+            }
+            changed.notify_all();
+        }
+    }
+
+    // Each decoder returns an error message, empty on success (or
+    // when the reader stopped early).
+    template <typename Emit>
+    string decodeGzip(const Frame &frame, Emit &emit) {
+#ifdef GZIP_FRAMES
+        z_stream zs{};
+        if (inflateInit2(&zs, 15 + 32) != Z_OK) return "zlib initialisation failed";
+        const Bytef *end = reinterpret_cast<const Bytef *>(input.data() + frame.end);
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data() + frame.begin));
+        string error;
+        while (true) {
+            // avail_in is 32 bits wide, so larger frames are fed in parts.
+            if (zs.avail_in == 0) zs.avail_in = static_cast<uInt>(min<size_t>(end - zs.next_in, numeric_limits<uInt>::max()));
+            string piece(DECODED_PIECE_BYTES, '\0');
+            zs.next_out = reinterpret_cast<Bytef *>(&piece[0]);
+            zs.avail_out = static_cast<uInt>(piece.size());
+            int status = inflate(&zs, Z_NO_FLUSH);
+            piece.resize(piece.size() - zs.avail_out);
+            if (!piece.empty() && !emit(move(piece))) break;
+            if (status == Z_STREAM_END) {
+                // Concatenated members; anything else after one is ignored.
+                if (end - zs.next_in < 2 || zs.next_in[0] != 0x1f || zs.next_in[1] != 0x8b) break;
+                inflateReset(&zs);
+            } else if (status != Z_OK) {
+                // Z_BUF_ERROR: no progress possible, the input ran out.
+                error = status == Z_BUF_ERROR ? "unexpected end of file" : zs.msg ? zs.msg : "invalid compressed data";
+                break;
+            }
+        }
+        inflateEnd(&zs);
+        return error;
+#else
+        (void)frame;
+        (void)emit;
+        return "built without zlib";
+#endif
+    }
+
+    template <typename Emit>
+    string decodeZstd(const Frame &frame, Emit &emit) {
+#ifdef ZSTD_FRAMES
+        ZSTD_DCtx *context = ZSTD_createDCtx();
+        if (!context) return "zstd initialisation failed";
+        ZSTD_inBuffer in = {input.data() + frame.begin, frame.end - frame.begin, 0};
+        size_t status = 0;
+        string error;
+        while (in.pos < in.size || status != 0) {
+            string piece(DECODED_PIECE_BYTES, '\0');
+            ZSTD_outBuffer out = {&piece[0], piece.size(), 0};
+            size_t before = in.pos;
+            status = ZSTD_decompressStream(context, &out, &in);
+            if (ZSTD_isError(status)) {
+                error = ZSTD_getErrorName(status);
+                break;
+            }
+            piece.resize(out.pos);
+            if (!piece.empty() && !emit(move(piece))) break;
+            if (status != 0 && in.pos == in.size && in.pos == before && out.pos == 0) {
+                error = "unexpected end of file";
+                break;
+            }
+        }
+        ZSTD_freeDCtx(context);
+        return error;
+#else
+        (void)frame;
+        (void)emit;
+        return "built without libzstd";
+#endif
+    }
+
+    bool zstd;
+    bool open = false;
+    MappedFile input; // decoded in place, so only the output is buffered
+    vector<unique_ptr<Frame>> frames;
+    vector<thread> workers;
+    mutex stateLock;
+    condition_variable changed;
+    size_t claimed = 0, current = 0, window = 1;
+    bool stopping = false;
+    string reason;
+};
+
+// ------------------------------------------------------------
+// Buffered line reader over a plain or compressed file
+// ------------------------------------------------------------
+class LineReader {
+public:
+    explicit LineReader(const string &filename) {
+        TraceSpan span("open");
+        if (endsWith(filename, ".gz") || endsWith(filename, ".zst")) {
+            decoder.reset(new FrameDecoder(filename));
+            if (!decoder->isOpen()) {
+                problemText = decoder->problem();
+                decoder.reset();
+            }
+        } else {
+            stream = fopen(filename.c_str(), "rb");
+            if (!stream) problemText = strerror(errno);
+            buffer.resize(1 << 20);
+        }
+    }
+
+    ~LineReader() { close(); }
+
+    LineReader(const LineReader &) = delete;
+    LineReader &operator=(const LineReader &) = delete;
+
+    bool isOpen() const { return stream != nullptr || decoder != nullptr; }
+
+    // Reads the next line without its trailing "\n" / "\r\n".
+    bool next(string &line) {
+        line.clear();
+        while (isOpen()) {
+            if (pos == len) {
+                len = fill();
+                pos = 0;
+                if (len == 0) {
+                    if (line.empty()) return false;
+                    break;
+                }
+            }
+            const char *begin = buffer.data() + pos;
+            const char *nl = static_cast<const char *>(memchr(begin, '\n', len - pos));
+            if (nl) {
+                line.append(begin, nl - begin);
+                pos += (nl - begin) + 1;
+                break;
+            }
+            line.append(begin, len - pos);
+            pos = len;
+        }
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return isOpen();
+    }
+
+    // Returns false if the file could not be read or decoded completely.
+    bool close() {
+        bool ok = true;
+        if (stream) {
+            ok = !ferror(stream);
+            ok = fclose(stream) == 0 && ok;
+            if (!ok) problemText = "read error";
+            stream = nullptr;
+        }
+        if (decoder) {
+            ok = decoder->finish();
+            problemText = decoder->problem();
+            decoder.reset();
+        }
+        return ok;
+    }
+
+    // Why the file could not be opened or decoded (after close()).
+    const string &problem() const { return problemText; }
+
+private:
+    size_t fill() {
+        if (!decoder) return fread(&buffer[0], 1, buffer.size(), stream);
+        return decoder->next(buffer) ? buffer.size() : 0;
+    }
+
+    FILE *stream = nullptr;
+    unique_ptr<FrameDecoder> decoder;
+    string buffer;
+    size_t pos = 0, len = 0;
+    string problemText;
+};
+
+// ------------------------------------------------------------
+// Country code of a Kaggle dataset file: "USvideos.csv" -> "US"
+// ------------------------------------------------------------
+string countryFromFilename(const string &path) {
+    string name = fs::path(path).filename().string();
+    size_t end = name.find("videos");
+    if (end == string::npos || end == 0) end = name.find('.');
+    return name.substr(0, end);
+}
+
+// ------------------------------------------------------------
+// Fixed-format date parsing
+//
+// publish_time is always "YYYY-MM-DDTHH:MM:SS.sssZ" and
+// trending_date "YY.DD.MM", so every digit sits at a known
+// offset. Fields are assembled without branching on the input,
+// and a single OR-ed error word covering every digit, separator
+// and range check is tested once at the end.
+// ------------------------------------------------------------
+// Days since 1970-01-01 of a proleptic Gregorian date (Howard
+// Hinnant's days_from_civil).
+int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+// Two digits at s[0..1]; marks `bad` for anything else.
+unsigned twoDigits(const char *s, unsigned &bad) {
+    unsigned hi = static_cast<unsigned char>(s[0]) - '0', lo = static_cast<unsigned char>(s[1]) - '0';
+    bad |= (hi > 9) | (lo > 9);
+    return hi * 10 + lo;
+}
+
+// Days past 28 in each month, two bits per month from January.
+const uint32_t MONTH_EXTRA_DAYS = 0xEEFBB3;
+
+// Nonzero unless 1 <= month <= 12 and 1 <= day <= the month's length.
+unsigned dateFieldsInvalid(unsigned year, unsigned month, unsigned day) {
+    unsigned leap = (year % 4 == 0) & ((year % 100 != 0) | (year % 400 == 0));
+    unsigned length = 28 + ((MONTH_EXTRA_DAYS >> (2 * ((month - 1) & 15))) & 3) + (leap & (month == 2));
+    return (month - 1 > 11) | (day - 1 >= length);
+}
+
+bool parsePublishTime(const string &text, int64_t &seconds) {
+    if (text.size() < 19) return false;
+    const char *p = text.data();
+    unsigned bad = (p[4] ^ '-') | (p[7] ^ '-') | (p[10] ^ 'T') | (p[13] ^ ':') | (p[16] ^ ':');
+    unsigned year = twoDigits(p, bad) * 100 + twoDigits(p + 2, bad);
+    unsigned month = twoDigits(p + 5, bad), day = twoDigits(p + 8, bad);
+    unsigned hour = twoDigits(p + 11, bad), minute = twoDigits(p + 14, bad), second = twoDigits(p + 17, bad);
+    bad |= dateFieldsInvalid(year, month, day) | (hour > 23) | (minute > 59) | (second > 60);
+    if (bad) return false;
+    seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+bool parseTrendingDate(const string &text, int32_t &day) {
+    if (text.size() != 8) return false;
+    const char *p = text.data();
+    unsigned bad = (p[2] ^ '.') | (p[5] ^ '.');
+    unsigned year = 2000 + twoDigits(p, bad), dayOfMonth = twoDigits(p + 3, bad), month = twoDigits(p + 6, bad);
+    bad |= dateFieldsInvalid(year, month, dayOfMonth);
+    if (bad) return false;
+    day = static_cast<int32_t>(daysFromCivil(year, month, dayOfMonth));
+    return true;
+}
+
+// Hours from publishing to the start (00:00 UTC) of the first
+// trending day, clamped at 0 for videos trending the day they were
+// published; 0 when either date is unknown.
+double hoursToTrend(int64_t publishTime, int32_t trendingDay) {
+    if (publishTime == 0 || trendingDay == 0) return 0.0;
+    return max(0.0, (static_cast<double>(trendingDay) * 86400.0 - static_cast<double>(publishTime)) / 3600.0);
+}
+
+// ------------------------------------------------------------
+// Where a CSV line sits inside a dataset file mapped into
+// titleArenas and descriptionArenas (see adoptDatasetFile), so
+// its wide fields can be referenced in place instead of copied
+// ------------------------------------------------------------
+struct LineSource {
+    uint32_t titleArena = 0, descriptionArena = 0;
+    uint64_t offset = 0; // of the line within the file
+};
+
+// Field k of a parsed line as a TextRef into the mapped file, if
+// the raw bytes equal the parsed value (no quotes inside the field
+// other than one enclosing pair); an empty TextRef otherwise.
+TextRef fieldInPlace(uint32_t arena, const string &line, const vector<string> &fields, const vector<size_t> &starts,
+                     size_t k, const LineSource *source) {
+    TextRef ref;
+    if (!source || fields[k].empty()) return ref;
+    size_t begin = starts[k], end = starts[k + 1] - 1;
+    if (end - begin >= 2 && line[begin] == '"' && line[end - 1] == '"') ++begin, --end;
+    if (end - begin == fields[k].size() && fields[k].size() <= UINT32_MAX) {
+        ref.arena = arena;
+        ref.offset = source->offset + begin;
+        ref.length = static_cast<uint32_t>(fields[k].size());
+    }
+    return ref;
+}
+
+// ------------------------------------------------------------
+// Parse one CSV record (false if malformed). The title is interned
+// in titlePool and the tags are compressed into tagArenas; new
+// titles and the description are referenced in the mapped file
+// when `source` is given and stored in the arenas otherwise. No
+// text is kept if keepText is false.
+// ------------------------------------------------------------
+bool parseVideoRecord(const string &line, Video &video, bool keepText = true, const LineSource *source = nullptr) {
+    thread_local vector<size_t> starts;
+    vector<string> fields = parseCSVLine(line, &starts);
+    if (fields.size() < 16) return false;
+
+    double views = 0.0, likes = 0.0, dislikes = 0.0, comments = 0.0;
+    try {
+        views = stod(fields[7]);
+        likes = stod(fields[8]);
+    } catch (...) {
+        return false;
+    }
+    // Only views and likes are required; like unparsable dates,
+    // blank or malformed dislikes and comment counts read as 0.
+    try {
+        dislikes = stod(fields[9]);
+    } catch (...) {
+        dislikes = 0.0;
+    }
+    try {
+        comments = stod(fields[10]);
+    } catch (...) {
+        comments = 0.0;
+    }
+
+    if (keepText) {
+        video.title = titlePool.intern(fields[2], [&] {
+            return fieldInPlace(source ? source->titleArena : 0, line, fields, starts, 2, source);
+        });
+        video.tags = tagArenas.append(encodeTags(split(fields[6], '|')));
+        video.description = fieldInPlace(source ? source->descriptionArena : 0, line, fields, starts, 15, source);
+        if (video.description.length == 0) video.description = descriptionArenas.append(fields[15]);
+    } else {
+        video.title = 0;
+        video.tags = TextRef();
+        video.description = TextRef();
+    }
+    video.views = views;
+    video.likes = likes;
+    video.dislikes = dislikes;
+    video.comments = comments;
+    video.ratio = (views == 0.0) ? 0.0 : likes / views;
+    if (!parsePublishTime(fields[5], video.publishTime)) video.publishTime = 0;
+    if (!parseTrendingDate(fields[1], video.trendingDay)) video.trendingDay = 0;
+    video.hoursToTrend = hoursToTrend(video.publishTime, video.trendingDay);
+    video.flags = 0;
+    for (int f = 0; f < VIDEO_FLAG_COUNT; ++f) {
+        const string &value = fields[12 + f];
+        if (!value.empty() && (value[0] == 'T' || value[0] == 't')) video.flags |= 1 << f;
+    }
+    return true;
+}
+
+// Adds the title and tags of one CSV record to a training sample.
+void sampleVideoRecord(const string &line, SymbolSample &sample) {
+    vector<string> fields = parseCSVLine(line);
+    if (fields.size() < 16) return;
+    sample.add(fields[2]);
+    for (const auto &tag : split(fields[6], '|')) sample.add(tag);
+}
+
+// ------------------------------------------------------------
+// Load one dataset
+// ------------------------------------------------------------
+VideoTable loadSingleDataset(const string &filename) {
+    TraceSpan span("parse");
+    VideoTable videos;
+    LineReader file(filename);
+    if (!file.isOpen()) {
+        cerr << "Error: Could not open " << filename << (file.problem().empty() ? "" : " (" + file.problem() + ")") << endl;
+        return videos;
+    }
+
+    string line;
+    file.next(line); // skip header
+
+    // The first records train the string symbols (if no loader has
+    // yet) and are parsed once that is done.
+    vector<string> head;
+    trainStringSymbols([&] {
+        SymbolSample sample;
+        while (!sample.full() && file.next(line)) {
+            sampleVideoRecord(line, sample);
+            head.push_back(move(line));
+        }
+        return sample.strings;
+    });
+
+    uint16_t country = countryCodes.intern(countryFromFilename(filename));
+    Video video;
+    for (size_t i = 0; i < head.size() || file.next(line); ++i) {
+        if (i < head.size()) line = move(head[i]);
+        if (line.empty()) continue;
+        if (parseVideoRecord(line, video)) {
+            video.country = country;
+            videos.push_back(move(video));
+        }
+    }
+
+    // A partly decoded file is dropped rather than loaded short.
+    if (!file.close()) {
+        cerr << "Error: Could not read " << filename << " completely (" << file.problem() << "), skipping it\n";
+        return VideoTable();
+    }
+    return videos;
+}
+
+// ------------------------------------------------------------
+// Parse a whole CSV file that is already in memory
+//
+// `file`, if given, locates the buffer's bytes in a mapped copy of
+// the file, where titles and descriptions are then referenced.
+// ------------------------------------------------------------
+VideoTable parseDatasetBuffer(const char *data, size_t size, const string &country, const LineSource *file = nullptr) {
+    TraceSpan span("parse");
+    trainStringSymbols([&] {
+        SymbolSample sample;
+        const char *p = static_cast<const char *>(memchr(data, '\n', size)), *end = data + size;
+        while (p && !sample.full()) {
+            const char *nl = static_cast<const char *>(memchr(p + 1, '\n', end - p - 1));
+            sampleVideoRecord(string(p + 1, nl ? nl : end), sample);
+            p = nl;
+        }
+        return sample.strings;
+    });
+
+    uint16_t countryId = countryCodes.intern(country);
+    VideoTable videos;
+    string line;
+    Video video;
+    LineSource source;
+    if (file) source = *file;
+    bool header = true;
+    for (size_t pos = 0; pos < size;) {
+        const char *nl = static_cast<const char *>(memchr(data + pos, '\n', size - pos));
+        size_t end = nl ? nl - data : size;
+        line.assign(data + pos, end - pos);
+        source.offset = (file ? file->offset : 0) + pos;
+        pos = end + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (header) {
+            header = false;
+            continue;
+        }
+        if (line.empty()) continue;
+        if (parseVideoRecord(line, video, true, file ? &source : nullptr)) {
+            video.country = countryId;
+            videos.push_back(move(video));
+        }
+    }
+    return videos;
+}
+
+// ------------------------------------------------------------
+// Asynchronous whole-file reader
+//
+// Plain CSVs are read with many large reads in flight across all
+// files at once, so the disk queue stays deep on a cold cache.
+// Linux uses io_uring directly through its system calls; other
+// POSIX systems (or kernels where io_uring is unavailable) fall
+// back to a pool of threads issuing pread. Each finished file is
+// handed to a callback, which may run on any thread. On Windows
+// the loader reads each file through LineReader instead.
+// ------------------------------------------------------------
+const size_t ASYNC_CHUNK_BYTES = 4 << 20;
+const unsigned ASYNC_QUEUE_DEPTH = 32;
+
+#ifndef _WIN32
+#ifdef ASYNC_IO_URING
+class IoUring {
+public:
+    ~IoUring() {
+        if (sqes) munmap(sqes, sqeBytes);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqBytes);
+        if (sqRing) munmap(sqRing, sqBytes);
+        if (ringFd >= 0) ::close(ringFd);
+    }
+
+    bool setup(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) return false;
+
+        sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) sqBytes = cqBytes = max(sqBytes, cqBytes);
+
+        sqRing = mapRing(sqBytes, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing : mapRing(cqBytes, IORING_OFF_CQ_RING);
+        sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(mapRing(sqeBytes, IORING_OFF_SQES));
+        if (!sqRing || !cqRing || !sqes) return false;
+
+        char *sq = static_cast<char *>(sqRing), *cq = static_cast<char *>(cqRing);
+        sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+        cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    bool queueRead(int fd, char *buffer, size_t length, uint64_t offset, uint64_t userData) {
+        unsigned tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) return false;
+        unsigned index = tail & sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer);
+        sqe.len = static_cast<unsigned>(length);
+        sqe.off = offset;
+        sqe.user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted;
+        return true;
+    }
+
+    // Asks the kernel to cancel the request tagged `target`; the
+    // cancel completes with its own `userData`.
+    bool queueCancel(uint64_t target, uint64_t userData) {
+        unsigned tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) return false;
+        unsigned index = tail & sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = target;
+        sqe.user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted;
+        return true;
+    }
+
+    // Submits queued reads and waits for one completion.
+    bool waitCompletion(uint64_t &userData, int &result) {
+        while (true) {
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe &cqe = cqes[head & cqMask];
+                userData = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            long submitted = syscall(__NR_io_uring_enter, ringFd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (submitted < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            unsubmitted -= static_cast<unsigned>(submitted);
+        }
+    }
+
+private:
+    void *mapRing(size_t bytes, off_t offset) {
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    int ringFd = -1;
+    void *sqRing = nullptr, *cqRing = nullptr;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqBytes = 0, cqBytes = 0, sqeBytes = 0;
+    unsigned *sqHead = nullptr, *sqTail = nullptr, *sqArray = nullptr, *cqHead = nullptr, *cqTail = nullptr;
+    unsigned sqMask = 0, cqMask = 0, sqEntries = 0, unsubmitted = 0;
+    io_uring_cqe *cqes = nullptr;
+};
+#endif
+
+class AsyncFileReader {
+public:
+    using Callback = function<void(size_t index, ByteBuffer &&data, bool ok)>;
+
+    // False reads with the pread threads even where io_uring works;
+    // readAll clears it when it had to fall back to them.
+    bool ioUring = true;
+
+#ifdef ASYNC_IO_URING
+    ~AsyncFileReader() { releaseOrphans(true); }
+#endif
+
+    // Reads every file completely and calls onFile once per file.
+    void readAll(const vector<string> &paths, const Callback &onFile) {
+#ifdef ASYNC_IO_URING
+        releaseOrphans(false);
+#endif
+        files.clear();
+        chunks.clear();
+        for (size_t i = 0; i < paths.size(); ++i) {
+            FileState &f = files.emplace_back();
+            TraceSpan span("open");
+            f.fd = openForRead(paths[i], f.size);
+            if (f.fd < 0) {
+                onFile(i, {}, false);
+                continue;
+            }
+            f.data.resize(f.size);
+            for (size_t off = 0; off < f.size; off += ASYNC_CHUNK_BYTES)
+                chunks.push_back({i, off, min(ASYNC_CHUNK_BYTES, f.size - off)});
+            f.pending = (f.size + ASYNC_CHUNK_BYTES - 1) / ASYNC_CHUNK_BYTES;
+            if (f.pending == 0) finishFile(i, onFile);
+        }
+
+        TraceSpan span("read");
+#ifdef ASYNC_IO_URING
+        if (ioUring && !chunks.empty() && readWithIoUring(onFile)) return;
+#endif
+        if (!chunks.empty()) ioUring = false;
+        readWithThreads(onFile);
+    }
+
+private:
+    struct FileState {
+        int fd = -1;
+        size_t size = 0;
+        ByteBuffer data;
+        atomic<size_t> pending{0};
+        atomic<bool> failed{false};
+
+    };
+
+    struct Chunk {
+        size_t file, offset, length;
+    };
+
+    deque<FileState> files;
+    vector<Chunk> chunks;
+
+#ifdef ASYNC_IO_URING
+    // A ring whose reads could not all be collected, with the buffers
+    // those reads target; see releaseOrphans. Declared in this order
+    // so the ring is torn down before the buffers are freed.
+    vector<ByteBuffer> orphans;
+    unique_ptr<IoUring> orphanRing;
+    vector<bool> orphanInKernel;
+    size_t orphanInFlight = 0;
+#endif
+
+    static int openForRead(const string &path, size_t &size) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return -1;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        size = st.st_size;
+        return fd;
+    }
+
+    // Synchronous positional read of one whole chunk.
+    bool readChunk(const Chunk &c) {
+        FileState &f = files[c.file];
+        size_t done = 0;
+        while (done < c.length) {
+            ssize_t n = pread(f.fd, f.data.data() + c.offset + done, c.length - done, c.offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += n;
+        }
+        return true;
+    }
+
+    void chunkDone(const Chunk &c, bool ok, const Callback &onFile) {
+        FileState &f = files[c.file];
+        if (!ok) f.failed = true;
+        if (f.pending.fetch_sub(1) == 1) finishFile(c.file, onFile);
+    }
+
+    void finishFile(size_t index, const Callback &onFile) {
+        FileState &f = files[index];
+        ::close(f.fd);
+        f.fd = -1;
+        onFile(index, move(f.data), !f.failed);
+    }
+
+    void readWithThreads(const Callback &onFile) {
+        atomic<size_t> next{0};
+        auto worker = [&] {
+            for (size_t i = next++; i < chunks.size(); i = next++) chunkDone(chunks[i], readChunk(chunks[i]), onFile);
+        };
+        vector<thread> pool;
+        for (unsigned t = 0; t < ASYNC_QUEUE_DEPTH && t < chunks.size(); ++t) pool.emplace_back(worker);
+        for (auto &t : pool) t.join();
+    }
+
+#ifdef ASYNC_IO_URING
+    bool readWithIoUring(const Callback &onFile) {
+        unique_ptr<IoUring> owned(new IoUring());
+        IoUring &ring = *owned;
+        if (!ring.setup(ASYNC_QUEUE_DEPTH)) return false;
+
+        // Per-chunk progress, so short reads can be resubmitted.
+        vector<size_t> completed(chunks.size(), 0);
+        vector<bool> finished(chunks.size(), false), inKernel(chunks.size(), false);
+        size_t next = 0, inFlight = 0;
+        auto submit = [&](size_t i) {
+            const Chunk &c = chunks[i];
+            FileState &f = files[c.file];
+            inKernel[i] = ring.queueRead(f.fd, f.data.data() + c.offset + completed[i], c.length - completed[i],
+                                         c.offset + completed[i], i);
+            return inKernel[i];
+        };
+
+        while (next < chunks.size() || inFlight > 0) {
+            while (next < chunks.size() && inFlight < ASYNC_QUEUE_DEPTH && submit(next)) {
+                ++next;
+                ++inFlight;
+            }
+            uint64_t i;
+            int result;
+            if (!ring.waitCompletion(i, result)) {
+                // The ring broke down. Reads still in flight may yet
+                // write into their buffers, so they are cancelled and
+                // their completions collected before the remaining
+                // chunks are read synchronously.
+                if (!drainRing(ring, inKernel, inFlight)) {
+                    // They cannot be collected yet: the reader keeps the
+                    // ring and the buffers they target, and those files fail.
+                    for (size_t j = 0; j < chunks.size(); ++j) {
+                        FileState &f = files[chunks[j].file];
+                        if (inKernel[j] && !f.data.empty()) orphans.push_back(move(f.data));
+                    }
+                    orphanRing = move(owned);
+                    orphanInKernel = inKernel;
+                    orphanInFlight = inFlight;
+                }
+                for (size_t j = 0; j < chunks.size(); ++j) {
+                    if (finished[j]) continue;
+                    FileState &f = files[chunks[j].file];
+                    chunkDone(chunks[j], !f.data.empty() && readChunk(chunks[j]), onFile);
+                }
+                return true;
+            }
+            inKernel[i] = false;
+            --inFlight;
+            if (result == -EAGAIN || result == -EINTR || (result > 0 && completed[i] + result < chunks[i].length)) {
+                if (result > 0) completed[i] += result;
+                if (submit(i)) {
+                    ++inFlight;
+                } else {
+                    finished[i] = true;
+                    chunkDone(chunks[i], readChunk(chunks[i]), onFile);
+                }
+                continue;
+            }
+            if (result > 0) completed[i] += result;
+            // Errors (e.g. IORING_OP_READ unsupported) retry with a plain pread.
+            bool ok = result > 0 || readChunk(chunks[i]);
+            finished[i] = true;
+            chunkDone(chunks[i], ok, onFile);
+        }
+        return true;
+    }
+
+    // Frees the orphaned buffers once the reads into them have
+    // completed, or, with `teardown`, after closing their ring,
+    // which cancels whatever is still queued.
+    void releaseOrphans(bool teardown) {
+        if (!orphanRing) return;
+        if (!drainRing(*orphanRing, orphanInKernel, orphanInFlight) && !teardown) return;
+        orphanRing.reset();
+        vector<ByteBuffer>().swap(orphans);
+    }
+
+    // Cancels every read still in the kernel and waits until each has
+    // completed; false if the ring keeps failing first.
+    static bool drainRing(IoUring &ring, vector<bool> &inKernel, size_t &inFlight) {
+        const uint64_t CANCEL_TAG = 1ULL << 63;
+        for (size_t j = 0; j < inKernel.size(); ++j)
+            if (inKernel[j]) ring.queueCancel(j, CANCEL_TAG | j); // best effort; reads finish on their own anyway
+        for (int failures = 0; inFlight > 0;) {
+            uint64_t userData;
+            int result;
+            if (!ring.waitCompletion(userData, result)) {
+                if (++failures == 100) return false;
+                this_thread::sleep_for(milliseconds(1));
+                continue;
+            }
+            if (userData & CANCEL_TAG) continue;
+            inKernel[userData] = false;
+            --inFlight;
+        }
+        return true;
+    }
+#endif
+};
+#endif
+
+// ------------------------------------------------------------
+// Columnar file format (.ytc)
+//
+// A compact long-term store for parsed videos. Each column is
+// encoded on its own and located through a directory in the
+// header. Loading maps the file and references the title and
+// description heaps in place; every other column is read through
+// a view of the mapping while the Video rows are built. Files
+// saved from the program also carry the query index, whose arrays
+// a lone .ytc dataset adopts from the mapping as they are (see
+// loadIndexColumn), so a query only pages in the arrays it reads:
+//   - tag dictionary / description heap: deduplicated string heaps
+//   - title heap: deduplicated titles as stringSymbols codes, with
+//     the symbol table stored beside them, so titles stay
+//     compressed in the mapping (plain text in older files)
+//   - country heap: deduplicated country codes
+//   - tag ids, tag counts, title ids, country ids, description
+//     ids, status flags, publish time (epoch seconds), trending
+//     day (days since 1970): bit-packed integers
+//   - views / likes / dislikes / comments: frame-of-reference
+//     bit-packed integers (raw doubles if a value in the column
+//     is fractional or negative)
+//   - query index: the VideoIndex arrays, see encodeIndexColumn
+//     (empty if the file was saved without one)
+// The ratio and hours-to-trend columns are derived on decode.
+// Integers are stored in host byte order (little-endian).
+// Columns from COL_REQUIRED on were added later and may be
+// missing from older files.
+// ------------------------------------------------------------
+const char COLUMNAR_MAGIC[4] = {'Y', 'T', 'C', '1'};
+
+enum ColumnId : uint32_t {
+    COL_TAG_DICT = 0,
+    COL_TAG_COUNTS,
+    COL_TAG_IDS,
+    COL_TITLE_HEAP,
+    COL_TITLE_IDS,
+    COL_VIEWS,
+    COL_LIKES,
+    COL_COUNTRY_HEAP,
+    COL_COUNTRY_IDS,
+    COL_DISLIKES,
+    COL_COMMENTS,
+    COL_DESCRIPTION_HEAP,
+    COL_DESCRIPTION_IDS,
+    COL_FLAGS,
+    COL_PUBLISH_TIME,
+    COL_TRENDING_DAY,
+    COL_STRING_SYMBOLS,
+    COL_QUERY_INDEX,
+    COL_COUNT,
+    COL_REQUIRED = COL_COUNTRY_HEAP
+};
+
+enum ColumnEncoding : uint32_t {
+    ENC_STRING_HEAP = 0,
+    ENC_PACKED_U64,
+    ENC_RAW_F64,
+    ENC_SYMBOL_HEAP, // string heap of SymbolTable codes
+    ENC_SYMBOL_TABLE, // count, then count symbols (uint64_t) and their lengths (uint8_t)
+    ENC_INDEX_ARRAYS  // IndexColumnHeader, SharedArray directory, arrays
+};
+
+struct ColumnEntry {
+    uint32_t id;
+    uint32_t encoding;
+    uint64_t offset;
+    uint64_t size;
+};
+
+template <typename T>
+void appendRaw(string &out, const T &value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T readRaw(const char *p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+// Packed layout: count, base, width, then ceil(count*width/64) words.
+void appendPacked(string &out, const vector<uint64_t> &values) {
+    uint64_t base = values.empty() ? 0 : *min_element(values.begin(), values.end());
+    uint64_t maxDelta = 0;
+    for (uint64_t v : values) maxDelta = max(maxDelta, v - base);
+    uint64_t width = 0;
+    while (width < 64 && (maxDelta >> width) != 0) ++width;
+
+    vector<uint64_t> words((values.size() * width + 63) / 64, 0);
+    for (size_t i = 0; i < values.size() && width > 0; ++i) {
+        uint64_t delta = values[i] - base;
+        size_t bit = i * width, word = bit / 64, shift = bit % 64;
+        words[word] |= delta << shift;
+        if (shift + width > 64) words[word + 1] |= delta >> (64 - shift);
+    }
+
+    appendRaw<uint64_t>(out, values.size());
+    appendRaw<uint64_t>(out, base);
+    appendRaw<uint64_t>(out, width);
+    out.append(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint64_t));
+}
+
+template <typename S>
+void appendStringHeap(string &out, const vector<S> &strings) {
+    appendRaw<uint64_t>(out, strings.size());
+    uint64_t offset = 0;
+    for (const auto &s : strings) {
+        appendRaw<uint64_t>(out, offset);
+        offset += s.size();
+    }
+    appendRaw<uint64_t>(out, offset);
+    for (const auto &s : strings) out.append(s.data(), s.size());
+}
+
+// Read-only view of one packed column inside a mapped file.
+class PackedColumn {
+public:
+    PackedColumn() = default;
+    explicit PackedColumn(const char *p)
+        : n(readRaw<uint64_t>(p)), base(readRaw<uint64_t>(p + 8)),
+          width(readRaw<uint64_t>(p + 16)), words(p + 24) {}
+
+    size_t size() const { return n; }
+
+    uint64_t operator[](size_t i) const {
+        if (width == 0) return base;
+        size_t bit = i * width, word = bit / 64, shift = bit % 64;
+        uint64_t v = readRaw<uint64_t>(words + word * 8) >> shift;
+        if (shift + width > 64) v |= readRaw<uint64_t>(words + (word + 1) * 8) << (64 - shift);
+        uint64_t mask = width == 64 ? ~0ULL : ((1ULL << width) - 1);
+        return base + (v & mask);
+    }
+
+private:
+    uint64_t n = 0, base = 0, width = 0;
+    const char *words = nullptr;
+};
+
+// Read-only view of a string heap inside a mapped file.
+class StringHeap {
+public:
+    StringHeap() = default;
+    explicit StringHeap(const char *p)
+        : n(readRaw<uint64_t>(p)), offsets(p + 8), bytes(p + 8 + (n + 1) * 8) {}
+
+    size_t size() const { return n; }
+
+    string operator[](size_t i) const {
+        uint64_t begin = readRaw<uint64_t>(offsets + i * 8);
+        uint64_t end = readRaw<uint64_t>(offsets + (i + 1) * 8);
+        return string(bytes + begin, end - begin);
+    }
+
+    // Position of entry i within the heap's bytes, for referencing it in place.
+    const char *data() const { return bytes; }
+    uint64_t offset(size_t i) const { return readRaw<uint64_t>(offsets + i * 8); }
+    uint64_t length(size_t i) const { return readRaw<uint64_t>(offsets + (i + 1) * 8) - offset(i); }
+
+    string_view view(size_t i) const { return string_view(bytes + offset(i), length(i)); }
+
+private:
+    uint64_t n = 0;
+    const char *offsets = nullptr, *bytes = nullptr;
+};
+
+// Read-only view of a numeric column inside a mapped file; a
+// default-constructed view reads as zeros.
+class NumericColumn {
+public:
+    NumericColumn() = default;
+    NumericColumn(const char *p, uint32_t encoding)
+        : raw(encoding == ENC_RAW_F64 ? p : nullptr), packed(raw ? PackedColumn() : PackedColumn(p)) {}
+
+    double operator[](size_t i) const { return raw ? readRaw<double>(raw + i * 8) : static_cast<double>(packed[i]); }
+
+private:
+    const char *raw = nullptr;
+    PackedColumn packed;
+};
+
+// Bit-packed when every value is a non-negative integer, raw doubles otherwise.
+void appendNumeric(string &out, uint32_t &encoding, const VideoTable &videos, double Video::*field) {
+    auto isIntegral = [](double d) { return d >= 0.0 && d < 9.0e18 && d == static_cast<double>(static_cast<uint64_t>(d)); };
+    bool integral = all_of(videos.begin(), videos.end(), [&](const Video &v) { return isIntegral(v.*field); });
+    if (integral) {
+        vector<uint64_t> values;
+        values.reserve(videos.size());
+        for (const auto &v : videos) values.push_back(static_cast<uint64_t>(v.*field));
+        appendPacked(out, values);
+        encoding = ENC_PACKED_U64;
+    } else {
+        for (const auto &v : videos) appendRaw<double>(out, v.*field);
+        encoding = ENC_RAW_F64;
+    }
+}
+
+// ------------------------------------------------------------
+// Encode videos as a columnar image (the .ytc file contents),
+// with `queryIndex` (see encodeIndexColumn) as their index column
+// ------------------------------------------------------------
+string encodeColumnar(const VideoTable &videos, const string &queryIndex = string()) {
+    MemoryScope scope(MEM_DICTIONARY);
+    unordered_map<string, uint64_t> tagIds, countryIds;
+    vector<string> tagDict, countryHeap;
+    vector<uint64_t> tagCounts, tagIdColumn, titleIdColumn, countryIdColumn, descriptionIdColumn, flagColumn, publishColumn,
+        trendingColumn;
+    // Titles are already interned, so the heap is keyed by pool id
+    // and holds their codes; descriptions are keyed by views into
+    // their arenas.
+    vector<uint64_t> titleIds(titlePool.size(), UINT64_MAX);
+    vector<string> titleHeap;
+    string scratch;
+    unordered_map<string_view, uint64_t> descriptionIds;
+    vector<string_view> descriptionHeap;
+
+    TraceSpan internSpan("intern");
+    auto intern = [](auto &ids, auto &heap, const auto &s) {
+        auto it = ids.emplace(s, heap.size());
+        if (it.second) heap.push_back(s);
+        return it.first->second;
+    };
+
+    for (const auto &v : videos) {
+        if (titleIds[v.title] == UINT64_MAX) {
+            titleIds[v.title] = titleHeap.size();
+            titleHeap.emplace_back();
+            stringSymbols.encode(titlePool.view(v.title, scratch), titleHeap.back());
+        }
+        titleIdColumn.push_back(titleIds[v.title]);
+        countryIdColumn.push_back(intern(countryIds, countryHeap, countryCodes.name(v.country)));
+        size_t tagCount = 0;
+        forEachTag(v.tags, [&](string_view tag) {
+            tagIdColumn.push_back(intern(tagIds, tagDict, string(tag)));
+            ++tagCount;
+        });
+        tagCounts.push_back(tagCount);
+        descriptionIdColumn.push_back(intern(descriptionIds, descriptionHeap, descriptionArenas.view(v.description)));
+        flagColumn.push_back(v.flags);
+        publishColumn.push_back(static_cast<uint64_t>(v.publishTime));
+        trendingColumn.push_back(static_cast<uint64_t>(static_cast<int64_t>(v.trendingDay)));
+    }
+
+    string columns[COL_COUNT];
+    uint32_t encodings[COL_COUNT] = {ENC_STRING_HEAP, ENC_PACKED_U64, ENC_PACKED_U64, ENC_SYMBOL_HEAP,
+                                     ENC_PACKED_U64,  ENC_PACKED_U64, ENC_PACKED_U64, ENC_STRING_HEAP,
+                                     ENC_PACKED_U64,  ENC_PACKED_U64, ENC_PACKED_U64, ENC_STRING_HEAP,
+                                     ENC_PACKED_U64,  ENC_PACKED_U64, ENC_PACKED_U64, ENC_PACKED_U64,
+                                     ENC_SYMBOL_TABLE, ENC_INDEX_ARRAYS};
+    appendStringHeap(columns[COL_TAG_DICT], tagDict);
+    appendPacked(columns[COL_TAG_COUNTS], tagCounts);
+    appendPacked(columns[COL_TAG_IDS], tagIdColumn);
+    appendStringHeap(columns[COL_TITLE_HEAP], titleHeap);
+    appendPacked(columns[COL_TITLE_IDS], titleIdColumn);
+    appendStringHeap(columns[COL_COUNTRY_HEAP], countryHeap);
+    appendPacked(columns[COL_COUNTRY_IDS], countryIdColumn);
+    appendNumeric(columns[COL_VIEWS], encodings[COL_VIEWS], videos, &Video::views);
+    appendNumeric(columns[COL_LIKES], encodings[COL_LIKES], videos, &Video::likes);
+    appendNumeric(columns[COL_DISLIKES], encodings[COL_DISLIKES], videos, &Video::dislikes);
+    appendNumeric(columns[COL_COMMENTS], encodings[COL_COMMENTS], videos, &Video::comments);
+    appendStringHeap(columns[COL_DESCRIPTION_HEAP], descriptionHeap);
+    appendPacked(columns[COL_DESCRIPTION_IDS], descriptionIdColumn);
+    appendPacked(columns[COL_FLAGS], flagColumn);
+    appendPacked(columns[COL_PUBLISH_TIME], publishColumn);
+    appendPacked(columns[COL_TRENDING_DAY], trendingColumn);
+    appendRaw<uint64_t>(columns[COL_STRING_SYMBOLS], stringSymbols.size());
+    for (unsigned code = 0; code < stringSymbols.size(); ++code)
+        columns[COL_STRING_SYMBOLS].append(stringSymbols.symbol(static_cast<uint8_t>(code)), 8);
+    for (unsigned code = 0; code < stringSymbols.size(); ++code)
+        columns[COL_STRING_SYMBOLS] += static_cast<char>(stringSymbols.length(static_cast<uint8_t>(code)));
+    columns[COL_QUERY_INDEX] = queryIndex;
+
+    string image(COLUMNAR_MAGIC, 4);
+    appendRaw<uint32_t>(image, COL_COUNT);
+    appendRaw<uint64_t>(image, videos.size());
+    uint64_t offset = image.size() + COL_COUNT * sizeof(ColumnEntry);
+    for (uint32_t c = 0; c < COL_COUNT; ++c) {
+        offset = (offset + 7) & ~7ULL;
+        appendRaw(image, ColumnEntry{c, encodings[c], offset, columns[c].size()});
+        offset += columns[c].size();
+    }
+    image.reserve(offset);
+    for (uint32_t c = 0; c < COL_COUNT; ++c) {
+        image.append(((image.size() + 7) & ~7ULL) - image.size(), '\0');
+        image += columns[c];
+        string().swap(columns[c]);
+    }
+    return image;
+}
+
+// ------------------------------------------------------------
+// Write videos to a columnar file
+// ------------------------------------------------------------
+bool saveColumnar(const VideoTable &videos, const string &filename, const string &queryIndex = string()) {
+    string image = encodeColumnar(videos, queryIndex);
+    ofstream out(filename, ios::binary);
+    if (!out.is_open()) {
+        cerr << "Error: Could not write " << filename << endl;
+        return false;
+    }
+    out.write(image.data(), image.size());
+    return static_cast<bool>(out);
+}
+
+// ------------------------------------------------------------
+// Memory-mapped reader for columnar files
+// ------------------------------------------------------------
+class ColumnarFile {
+public:
+    explicit ColumnarFile(const string &filename) : ColumnarFile(make_shared<MappedFile>(filename)) {}
+    explicit ColumnarFile(shared_ptr<MappedFile> mapped)
+        : file(move(mapped)), data(file->data()), length(file->size()) {
+        parseHeader();
+    }
+
+    // The underlying mapping, for referencing columns beyond this reader's lifetime.
+    const shared_ptr<MappedFile> &mapping() const { return file; }
+
+    bool isValid() const { return valid; }
+    const string &problem() const { return reason; } // why the file is not valid
+    size_t rows() const { return rowCount; }
+    bool hasColumn(ColumnId id) const { return id < columnCount; }
+
+    StringHeap tagDictionary() const { return StringHeap(column(COL_TAG_DICT)); }
+    PackedColumn tagCounts() const { return PackedColumn(column(COL_TAG_COUNTS)); }
+    PackedColumn tagIds() const { return PackedColumn(column(COL_TAG_IDS)); }
+    StringHeap titleHeap() const { return StringHeap(column(COL_TITLE_HEAP)); }
+    PackedColumn titleIds() const { return PackedColumn(column(COL_TITLE_IDS)); }
+    StringHeap countryHeap() const { return StringHeap(column(COL_COUNTRY_HEAP)); }
+    PackedColumn countryIds() const { return PackedColumn(column(COL_COUNTRY_IDS)); }
+    StringHeap descriptionHeap() const { return StringHeap(column(COL_DESCRIPTION_HEAP)); }
+    PackedColumn descriptionIds() const { return PackedColumn(column(COL_DESCRIPTION_IDS)); }
+    PackedColumn flags() const { return PackedColumn(column(COL_FLAGS)); }
+    PackedColumn publishTimes() const { return PackedColumn(column(COL_PUBLISH_TIME)); }
+    PackedColumn trendingDays() const { return PackedColumn(column(COL_TRENDING_DAY)); }
+
+    NumericColumn views() const { return numeric(COL_VIEWS); }
+    NumericColumn likes() const { return numeric(COL_LIKES); }
+    NumericColumn dislikes() const { return numeric(COL_DISLIKES); }
+    NumericColumn comments() const { return numeric(COL_COMMENTS); }
+
+    // The index column's bytes, empty if the file has none.
+    string_view queryIndex() const {
+        return hasColumn(COL_QUERY_INDEX) ? string_view(column(COL_QUERY_INDEX), entries[COL_QUERY_INDEX].size) : string_view();
+    }
+
+    // Whether the title heap holds codes of symbolTable(), rather than text.
+    bool titlesEncoded() const { return entries[COL_TITLE_HEAP].encoding == ENC_SYMBOL_HEAP; }
+    SymbolTable symbolTable() const {
+        SymbolTable table;
+        if (!hasColumn(COL_STRING_SYMBOLS)) return table;
+        const char *p = column(COL_STRING_SYMBOLS);
+        unsigned n = static_cast<unsigned>(readRaw<uint64_t>(p));
+        vector<uint64_t> symbols(n);
+        for (unsigned c = 0; c < n; ++c) symbols[c] = readRaw<uint64_t>(p + 8 + c * 8);
+        table.load(symbols.data(), reinterpret_cast<const uint8_t *>(p + 8 + n * 8), n);
+        return table;
+    }
+
+private:
+    void parseHeader() {
+        const size_t fixed = 4 + sizeof(uint32_t) + sizeof(uint64_t);
+        if (!data || length < fixed || memcmp(data, COLUMNAR_MAGIC, 4) != 0) {
+            reason = "not a columnar file";
+            return;
+        }
+        uint32_t count = readRaw<uint32_t>(data + 4);
+        rowCount = readRaw<uint64_t>(data + 8);
+        if (count < COL_REQUIRED || count > COL_COUNT || length < fixed + count * sizeof(ColumnEntry)) {
+            reason = "bad column directory";
+            return;
+        }
+        for (uint32_t c = 0; c < count; ++c) {
+            entries[c] = readRaw<ColumnEntry>(data + fixed + c * sizeof(ColumnEntry));
+            if (entries[c].id != c || entries[c].offset > length || entries[c].size > length - entries[c].offset) {
+                reason = "column " + to_string(c) + " lies outside the file";
+                return;
+            }
+            if (!columnFits(static_cast<ColumnId>(c))) {
+                reason = "column " + to_string(c) + " is damaged";
+                return;
+            }
+        }
+        if (entries[COL_TITLE_HEAP].encoding == ENC_SYMBOL_HEAP && count <= COL_STRING_SYMBOLS) {
+            reason = "titles are encoded but the symbol table is missing";
+            return;
+        }
+        columnCount = count;
+        valid = true;
+    }
+
+    // Whether column `id` is well formed within its directory entry:
+    // heap offsets ascending and inside the heap, packed words and
+    // raw values present for every row (every tag for tag ids).
+    bool columnFits(ColumnId id) const {
+        const ColumnEntry &e = entries[id];
+        const char *p = data + e.offset;
+        if (id == COL_STRING_SYMBOLS) {
+            if (e.encoding != ENC_SYMBOL_TABLE || e.size < 8) return false;
+            uint64_t n = readRaw<uint64_t>(p);
+            if (n > SymbolTable::MAX_SYMBOLS || e.size < 8 + n * 9) return false;
+            for (uint64_t c = 0; c < n; ++c)
+                if (p[8 + n * 8 + c] < 1 || p[8 + n * 8 + c] > 8) return false;
+            return true;
+        }
+        if (id == COL_QUERY_INDEX) return e.encoding == ENC_INDEX_ARRAYS; // checked when adopted
+        if (id == COL_TAG_DICT || id == COL_TITLE_HEAP || id == COL_COUNTRY_HEAP || id == COL_DESCRIPTION_HEAP) {
+            bool codes = id == COL_TITLE_HEAP && e.encoding == ENC_SYMBOL_HEAP;
+            if ((e.encoding != ENC_STRING_HEAP && !codes) || e.size < 8) return false;
+            uint64_t n = readRaw<uint64_t>(p);
+            if (n >= (e.size - 8) / 8) return false;
+            uint64_t bytes = e.size - 8 - (n + 1) * 8, previous = 0;
+            for (uint64_t i = 0; i <= n; ++i) {
+                uint64_t offset = readRaw<uint64_t>(p + 8 + i * 8);
+                if (offset < previous || offset > bytes) return false;
+                previous = offset;
+            }
+            return true;
+        }
+        bool numeric = id == COL_VIEWS || id == COL_LIKES || id == COL_DISLIKES || id == COL_COMMENTS;
+        if (numeric && e.encoding == ENC_RAW_F64) return e.size / 8 >= rowCount;
+        if (e.encoding != ENC_PACKED_U64 || e.size < 24) return false;
+        uint64_t n = readRaw<uint64_t>(p), width = readRaw<uint64_t>(p + 16);
+        if (width > 64 || (id != COL_TAG_IDS && n != rowCount)) return false;
+        uint64_t words = n / 64 * width + (n % 64 * width + 63) / 64; // ceil(n * width / 64) without overflow
+        return words <= (e.size - 24) / 8;
+    }
+
+    const char *column(ColumnId id) const { return data + entries[id].offset; }
+
+    NumericColumn numeric(ColumnId id) const { return hasColumn(id) ? NumericColumn(column(id), entries[id].encoding) : NumericColumn(); }
+
+    shared_ptr<MappedFile> file;
+    const char *data;
+    size_t length;
+    ColumnEntry entries[COL_COUNT] = {};
+    uint32_t columnCount = 0;
+    uint64_t rowCount = 0;
+    bool valid = false;
+    string reason;
+};
+
+// TextRefs for every entry of a heap, with the heap adopted as one arena.
+vector<TextRef> adoptHeap(TextArenas &arenas, const StringHeap &heap, const shared_ptr<MappedFile> &owner,
+                          bool encoded = false) {
+    vector<TextRef> refs(heap.size());
+    if (heap.size() == 0) return refs;
+    uint32_t arena = arenas.adopt(heap.data(), owner, encoded);
+    for (size_t id = 0; id < heap.size(); ++id) {
+        if (heap.length(id) == 0) continue;
+        refs[id].arena = arena;
+        refs[id].offset = heap.offset(id);
+        refs[id].length = static_cast<uint32_t>(min<uint64_t>(heap.length(id), UINT32_MAX));
+    }
+    return refs;
+}
+
+// ------------------------------------------------------------
+// Decode a columnar image into videos. Titles and descriptions
+// are referenced in the image in place, which keeps the mapping
+// alive for the rest of the run; encoded titles stay in place only
+// while stringSymbols is the table that encoded them (the file's
+// table is loaded if nothing has trained one yet). Ids pointing
+// outside their heap and truncated codes throw runtime_error.
+// ------------------------------------------------------------
+VideoTable decodeColumnar(const ColumnarFile &file) {
+    TraceSpan span("decode");
+    VideoTable videos;
+
+    StringHeap tagDict = file.tagDictionary(), titleHeap = file.titleHeap();
+    bool encoded = file.titlesEncoded();
+    SymbolTable fileSymbols = file.symbolTable();
+    if (encoded) {
+        call_once(stringSymbolsTrained, [&] { stringSymbols = fileSymbols; });
+    } else {
+        trainStringSymbols([&] {
+            SymbolSample sample;
+            for (size_t i = 0; i < max(tagDict.size(), titleHeap.size()) && !sample.full(); ++i) {
+                if (i < tagDict.size()) sample.add(tagDict[i]);
+                if (i < titleHeap.size()) sample.add(titleHeap[i]);
+            }
+            return sample.strings;
+        });
+    }
+    bool inPlace = !encoded || stringSymbols.sameSymbols(fileSymbols);
+    vector<TextRef> titleRefs = inPlace ? adoptHeap(titleArenas, titleHeap, file.mapping(), encoded) : vector<TextRef>();
+    vector<uint32_t> titles(titleHeap.size());
+    string text;
+    for (size_t id = 0; id < titleHeap.size(); ++id) {
+        string_view title = titleHeap.view(id);
+        if (encoded) {
+            if (!SymbolTable::complete(title.data(), title.size())) throw runtime_error("title " + to_string(id) + " is truncated");
+            text.clear();
+            fileSymbols.decode(title.data(), title.size(), text);
+            title = text;
+        }
+        titles[id] = titlePool.intern(title, [&] { return inPlace ? titleRefs[id] : TextRef(); });
+    }
+    PackedColumn tagCounts = file.tagCounts(), tagIds = file.tagIds(), titleIds = file.titleIds();
+    NumericColumn views = file.views(), likes = file.likes(), dislikes = file.dislikes(), comments = file.comments();
+    bool hasCountry = file.hasColumn(COL_COUNTRY_IDS);
+    StringHeap countries = hasCountry ? file.countryHeap() : StringHeap();
+    PackedColumn countryIds = hasCountry ? file.countryIds() : PackedColumn();
+    vector<uint16_t> countryIdsInRun(countries.size());
+    for (size_t id = 0; id < countries.size(); ++id) countryIdsInRun[id] = countryCodes.intern(countries[id]);
+    bool hasDescriptions = file.hasColumn(COL_DESCRIPTION_IDS);
+    vector<TextRef> descriptions = hasDescriptions ? adoptHeap(descriptionArenas, file.descriptionHeap(), file.mapping())
+                                                   : vector<TextRef>();
+    PackedColumn descriptionIds = hasDescriptions ? file.descriptionIds() : PackedColumn();
+    bool hasFlags = file.hasColumn(COL_FLAGS);
+    PackedColumn flags = hasFlags ? file.flags() : PackedColumn();
+    bool hasDates = file.hasColumn(COL_TRENDING_DAY);
+    PackedColumn publishTimes = hasDates ? file.publishTimes() : PackedColumn();
+    PackedColumn trendingDays = hasDates ? file.trendingDays() : PackedColumn();
+
+    // Each dictionary tag is encoded once, when first used.
+    vector<string> tagCodes(tagDict.size());
+    string codes;
+
+    videos.reserve(file.rows());
+    size_t tagPos = 0;
+    for (size_t i = 0; i < file.rows(); ++i) {
+        Video v;
+        codes.clear();
+        for (uint64_t t = tagCounts[i]; t > 0; --t) {
+            if (tagPos == tagIds.size()) throw runtime_error("tag counts run past the tag ids");
+            uint64_t id = tagIds[tagPos++];
+            if (id >= tagDict.size()) throw runtime_error("tag id out of range in row " + to_string(i));
+            if (tagCodes[id].empty()) tagCodes[id] = encodeTags({tagDict[id]});
+            codes += tagCodes[id];
+        }
+        v.tags = tagArenas.append(codes);
+        if (titleIds[i] >= titles.size()) throw runtime_error("title id out of range in row " + to_string(i));
+        v.title = titles[titleIds[i]];
+        if (hasCountry) {
+            if (countryIds[i] >= countries.size()) throw runtime_error("country id out of range in row " + to_string(i));
+            v.country = countryIdsInRun[countryIds[i]];
+        }
+        if (hasDescriptions) {
+            if (descriptionIds[i] >= descriptions.size())
+                throw runtime_error("description id out of range in row " + to_string(i));
+            v.description = descriptions[descriptionIds[i]];
+        }
+        if (hasFlags) v.flags = static_cast<uint8_t>(flags[i]);
+        if (hasDates) {
+            v.publishTime = static_cast<int64_t>(publishTimes[i]);
+            v.trendingDay = static_cast<int32_t>(static_cast<int64_t>(trendingDays[i]));
+            v.hoursToTrend = hoursToTrend(v.publishTime, v.trendingDay);
+        }
+        v.views = views[i];
+        v.likes = likes[i];
+        v.dislikes = dislikes[i];
+        v.comments = comments[i];
+        v.ratio = (views[i] == 0.0) ? 0.0 : likes[i] / views[i];
+        videos.push_back(move(v));
+    }
+    return videos;
+}
+
+// ------------------------------------------------------------
+// Load a columnar file back into videos
+// ------------------------------------------------------------
+VideoTable loadColumnar(const string &filename) {
+    ColumnarFile file(filename);
+    if (!file.isValid()) {
+        cerr << "Error: " << filename << " is not a valid columnar file (" << file.problem() << ")" << endl;
+        return VideoTable();
+    }
+    try {
+        return decodeColumnar(file);
+    } catch (const exception &e) {
+        cerr << "Error: " << filename << ": " << e.what() << endl;
+        return VideoTable();
+    }
+}
+
+// ------------------------------------------------------------
+// Apache Arrow IPC export / import
+//
+// Videos are exchanged as an Arrow table with the schema
+//   title: utf8, tags: list<utf8>, views: float64,
+//   likes: float64, ratio: float64, country: utf8,
+//   dislikes: float64, comments: float64, description: utf8,
+//   comments_disabled / ratings_disabled /
+//   video_error_or_removed: bool,
+//   publish_time: timestamp[s, UTC], trending_date: date32
+// written as one record batch, split only where a utf8 column
+// would outgrow its 32-bit offsets (see arrowBatchEnds), so each
+// column is normally one buffer. ".arrow" files use the IPC file
+// format, anything else the IPC stream format. Body buffers are
+// 64-byte aligned so consumers can map them without copying; this
+// importer views the float64 columns in place (see
+// MappedNumericColumns). The flatbuffer metadata is written and
+// read by the small helpers below, so no Arrow library is needed.
+// ------------------------------------------------------------
+const char ARROW_MAGIC[6] = {'A', 'R', 'R', 'O', 'W', '1'};
+
+// Arrow flatbuffer enum values (Schema.fbs / Message.fbs)
+enum ArrowTypeId : uint8_t {
+    ARROW_TYPE_INT = 2,
+    ARROW_TYPE_FLOAT = 3,
+    ARROW_TYPE_UTF8 = 5,
+    ARROW_TYPE_BOOL = 6,
+    ARROW_TYPE_DATE = 8,
+    ARROW_TYPE_TIMESTAMP = 10,
+    ARROW_TYPE_LIST = 12
+};
+enum ArrowHeaderId : uint8_t { ARROW_HEADER_SCHEMA = 1, ARROW_HEADER_RECORD_BATCH = 3 };
+const int16_t ARROW_METADATA_V5 = 4;
+const int16_t ARROW_PRECISION_DOUBLE = 2;
+const int16_t ARROW_DATE_DAY = 0;
+const int16_t ARROW_TIME_SECOND = 0;
+
+// One flatbuffer object: a table, a string, a vector of tables
+// or a vector of inline structs. Children are serialized after
+// their parent so every offset points forward.
+struct FbObject {
+    enum Kind { TABLE, STRING, TABLE_VECTOR, STRUCT_VECTOR } kind = TABLE;
+
+    struct Field {
+        int size = 0; // 0 = absent, 1/2/4/8 = scalar, -1 = reference
+        uint64_t scalar = 0;
+        shared_ptr<FbObject> ref;
+    };
+    vector<Field> fields;                  // TABLE, indexed by field id
+    vector<shared_ptr<FbObject>> elements; // TABLE_VECTOR
+    string bytes;                          // STRING / STRUCT_VECTOR payload
+    uint32_t count = 0;                    // STRUCT_VECTOR element count
+
+    FbObject &set(size_t id, int size, uint64_t value) {
+        if (fields.size() <= id) fields.resize(id + 1);
+        fields[id].size = size;
+        fields[id].scalar = value;
+        return *this;
+    }
+
+    FbObject &ref(size_t id, shared_ptr<FbObject> object) {
+        if (fields.size() <= id) fields.resize(id + 1);
+        fields[id].size = -1;
+        fields[id].ref = move(object);
+        return *this;
+    }
+};
+
+shared_ptr<FbObject> fbTable() { return make_shared<FbObject>(); }
+
+shared_ptr<FbObject> fbString(const string &s) {
+    auto o = make_shared<FbObject>();
+    o->kind = FbObject::STRING;
+    o->bytes = s;
+    return o;
+}
+
+shared_ptr<FbObject> fbTables(vector<shared_ptr<FbObject>> elements) {
+    auto o = make_shared<FbObject>();
+    o->kind = FbObject::TABLE_VECTOR;
+    o->elements = move(elements);
+    return o;
+}
+
+// Vector of structs made of 8-byte members (FieldNode, Buffer, Block).
+shared_ptr<FbObject> fbStructs(const vector<vector<uint64_t>> &structs) {
+    auto o = make_shared<FbObject>();
+    o->kind = FbObject::STRUCT_VECTOR;
+    o->count = structs.size();
+    for (const auto &s : structs)
+        for (uint64_t member : s) appendRaw(o->bytes, member);
+    return o;
+}
+
+class FbWriter {
+public:
+    // Returns a finished buffer whose size is a multiple of 8.
+    static string finish(const FbObject &root) {
+        FbWriter w;
+        w.buf.assign(4, '\0');
+        uint32_t rootPos = w.write(root);
+        w.patch(0, rootPos);
+        w.pad(8);
+        return w.buf;
+    }
+
+private:
+    string buf;
+
+    void pad(size_t align) { buf.append((align - buf.size() % align) % align, '\0'); }
+
+    void patch(size_t at, uint32_t value) { memcpy(&buf[at], &value, 4); }
+
+    void writeRef(size_t at, const FbObject &child) { patch(at, write(child) - at); }
+
+    uint32_t write(const FbObject &o) {
+        switch (o.kind) {
+            case FbObject::STRING: {
+                pad(4);
+                uint32_t pos = buf.size();
+                appendRaw<uint32_t>(buf, o.bytes.size());
+                buf += o.bytes;
+                buf += '\0';
+                return pos;
+            }
+            case FbObject::STRUCT_VECTOR: {
+                while (buf.size() % 8 != 4) buf += '\0';
+                uint32_t pos = buf.size();
+                appendRaw<uint32_t>(buf, o.count);
+                buf += o.bytes;
+                return pos;
+            }
+            case FbObject::TABLE_VECTOR: {
+                pad(4);
+                uint32_t pos = buf.size();
+                appendRaw<uint32_t>(buf, o.elements.size());
+                buf.append(o.elements.size() * 4, '\0');
+                for (size_t i = 0; i < o.elements.size(); ++i) writeRef(pos + 4 + i * 4, *o.elements[i]);
+                return pos;
+            }
+            default:
+                return writeTable(o);
+        }
+    }
+
+    uint32_t writeTable(const FbObject &o) {
+        // Lay fields out relative to an 8-aligned table start, widest first.
+        vector<uint16_t> slot(o.fields.size(), 0);
+        size_t tableSize = 4;
+        for (int width : {8, 4, 2, 1}) {
+            for (size_t i = 0; i < o.fields.size(); ++i) {
+                int size = o.fields[i].size < 0 ? 4 : o.fields[i].size;
+                if (size != width) continue;
+                tableSize = (tableSize + width - 1) / width * width;
+                slot[i] = tableSize;
+                tableSize += width;
+            }
+        }
+
+        pad(2);
+        size_t vtablePos = buf.size();
+        appendRaw<uint16_t>(buf, 4 + 2 * o.fields.size());
+        appendRaw<uint16_t>(buf, tableSize);
+        for (uint16_t s : slot) appendRaw<uint16_t>(buf, s);
+        pad(8);
+        size_t tablePos = buf.size();
+        appendRaw<int32_t>(buf, tablePos - vtablePos);
+        buf.append(tableSize - 4, '\0');
+        for (size_t i = 0; i < o.fields.size(); ++i)
+            if (o.fields[i].size > 0) memcpy(&buf[tablePos + slot[i]], &o.fields[i].scalar, o.fields[i].size);
+        for (size_t i = 0; i < o.fields.size(); ++i)
+            if (o.fields[i].size < 0) writeRef(tablePos + slot[i], *o.fields[i].ref);
+        return tablePos;
+    }
+};
+
+// Bounds-checked read-only access to flatbuffer tables.
+class FbTable {
+public:
+    FbTable(const char *base, size_t length, size_t pos) : base(base), length(length), pos(pos) {
+        check(pos, 4);
+        int64_t vt = static_cast<int64_t>(pos) - readRaw<int32_t>(base + pos);
+        check(vt, 4);
+        vtable = vt;
+        vtableSize = readRaw<uint16_t>(base + vtable);
+        check(vtable, vtableSize);
+    }
+
+    static FbTable root(const char *base, size_t length) {
+        if (length < 4) throw runtime_error("truncated Arrow metadata");
+        return FbTable(base, length, readRaw<uint32_t>(base));
+    }
+
+    bool has(size_t id) const { return fieldPos(id) != 0; }
+
+    template <typename T>
+    T scalar(size_t id, T fallback = T()) const {
+        size_t at = fieldPos(id);
+        if (at == 0) return fallback;
+        check(at, sizeof(T));
+        return readRaw<T>(base + at);
+    }
+
+    FbTable table(size_t id) const { return FbTable(base, length, deref(id)); }
+
+    string str(size_t id) const {
+        if (!has(id)) return "";
+        size_t at = deref(id);
+        uint32_t n = readRaw<uint32_t>(base + at);
+        check(at + 4, n);
+        return string(base + at + 4, n);
+    }
+
+    // Vector of tables
+    vector<FbTable> tables(size_t id) const {
+        vector<FbTable> result;
+        if (!has(id)) return result;
+        size_t at = deref(id);
+        uint32_t n = readRaw<uint32_t>(base + at);
+        check(at + 4, static_cast<size_t>(n) * 4);
+        for (uint32_t i = 0; i < n; ++i) {
+            size_t slot = at + 4 + i * 4;
+            result.emplace_back(base, length, slot + readRaw<uint32_t>(base + slot));
+        }
+        return result;
+    }
+
+    // Vector of structs of 8-byte members, flattened.
+    vector<int64_t> structs(size_t id, size_t members) const {
+        vector<int64_t> result;
+        if (!has(id)) return result;
+        size_t at = deref(id);
+        uint32_t n = readRaw<uint32_t>(base + at);
+        check(at + 4, static_cast<size_t>(n) * members * 8);
+        for (size_t i = 0; i < static_cast<size_t>(n) * members; ++i) result.push_back(readRaw<int64_t>(base + at + 4 + i * 8));
+        return result;
+    }
+
+private:
+    const char *base;
+    size_t length, pos, vtable = 0;
+    uint16_t vtableSize = 0;
+
+    void check(int64_t at, size_t size) const {
+        if (at < 0 || static_cast<size_t>(at) + size > length) throw runtime_error("malformed Arrow metadata");
+    }
+
+    size_t fieldPos(size_t id) const {
+        if (4 + 2 * id + 2 > vtableSize) return 0;
+        uint16_t offset = readRaw<uint16_t>(base + vtable + 4 + 2 * id);
+        return offset == 0 ? 0 : pos + offset;
+    }
+
+    size_t deref(size_t id) const {
+        size_t at = fieldPos(id);
+        if (at == 0) throw runtime_error("missing Arrow metadata field");
+        check(at, 4);
+        size_t target = at + readRaw<uint32_t>(base + at);
+        check(target, 4);
+        return target;
+    }
+};
+
+shared_ptr<FbObject> arrowField(const string &name, uint8_t typeId, shared_ptr<FbObject> type,
+                                vector<shared_ptr<FbObject>> children = {}) {
+    auto field = fbTable();
+    field->ref(0, fbString(name)).set(1, 1, 1).set(2, 1, typeId).ref(3, type).ref(5, fbTables(move(children)));
+    return field;
+}
+
+shared_ptr<FbObject> arrowSchema() {
+    auto doubleField = [](const string &name) {
+        auto type = fbTable();
+        type->set(0, 2, ARROW_PRECISION_DOUBLE);
+        return arrowField(name, ARROW_TYPE_FLOAT, type);
+    };
+    vector<shared_ptr<FbObject>> fields = {arrowField("title", ARROW_TYPE_UTF8, fbTable()),
+                                           arrowField("tags", ARROW_TYPE_LIST, fbTable(),
+                                                      {arrowField("item", ARROW_TYPE_UTF8, fbTable())}),
+                                           doubleField("views"), doubleField("likes"), doubleField("ratio"),
+                                           arrowField("country", ARROW_TYPE_UTF8, fbTable()), doubleField("dislikes"),
+                                           doubleField("comments"), arrowField("description", ARROW_TYPE_UTF8, fbTable())};
+    for (const char *flag : VIDEO_FLAG_NAMES) fields.push_back(arrowField(flag, ARROW_TYPE_BOOL, fbTable()));
+    auto timestamp = fbTable();
+    timestamp->set(0, 2, ARROW_TIME_SECOND).ref(1, fbString("UTC"));
+    fields.push_back(arrowField("publish_time", ARROW_TYPE_TIMESTAMP, timestamp));
+    auto date = fbTable();
+    date->set(0, 2, ARROW_DATE_DAY);
+    fields.push_back(arrowField("trending_date", ARROW_TYPE_DATE, date));
+    auto schema = fbTable();
+    schema->ref(1, fbTables(move(fields)));
+    return schema;
+}
+
+// Encapsulated IPC message: continuation marker, metadata length,
+// metadata flatbuffer, body. Returns the metadata block length.
+uint64_t writeArrowMessage(ostream &out, uint8_t headerType, shared_ptr<FbObject> header, const string &body) {
+    FbObject message;
+    message.set(0, 2, ARROW_METADATA_V5).set(1, 1, headerType).ref(2, move(header)).set(3, 8, body.size());
+    string metadata = FbWriter::finish(message);
+    string prefix;
+    appendRaw<int32_t>(prefix, -1);
+    appendRaw<int32_t>(prefix, metadata.size());
+    out << prefix << metadata << body;
+    return prefix.size() + metadata.size();
+}
+
+// Builds one record batch body and its buffer / node descriptors.
+struct ArrowBatchBuilder {
+    string body;
+    vector<vector<uint64_t>> nodes, buffers;
+
+    void node(uint64_t length) { nodes.push_back({length, 0}); }
+
+    void buffer(const void *data, size_t size) {
+        buffers.push_back({body.size(), size});
+        body.append(static_cast<const char *>(data), size);
+        body.append((64 - body.size() % 64) % 64, '\0');
+    }
+
+    void noValidity() { buffer(nullptr, 0); }
+
+    template <typename Get>
+    void utf8Column(size_t count, Get get) {
+        vector<int32_t> offsets(1, 0);
+        string bytes;
+        for (size_t i = 0; i < count; ++i) {
+            bytes += get(i);
+            offsets.push_back(bytes.size());
+        }
+        node(count);
+        noValidity();
+        buffer(offsets.data(), offsets.size() * sizeof(int32_t));
+        buffer(bytes.data(), bytes.size());
+    }
+
+    template <typename Get>
+    void boolColumn(size_t count, Get get) {
+        vector<uint8_t> bits((count + 7) / 8, 0);
+        for (size_t i = 0; i < count; ++i)
+            if (get(i)) bits[i / 8] |= 1 << (i % 8);
+        node(count);
+        noValidity();
+        buffer(bits.data(), bits.size());
+    }
+
+    template <typename T>
+    void fixedColumn(const vector<T> &values) {
+        node(values.size());
+        noValidity();
+        buffer(values.data(), values.size() * sizeof(T));
+    }
+
+    void doubleColumn(const vector<double> &values) { fixedColumn(values); }
+};
+
+// Ends of the record batches for `videos`: a batch is cut only
+// where its title, tag or description text would pass INT32_MAX
+// bytes, the most 32-bit utf8 offsets can address.
+vector<size_t> arrowBatchEnds(const VideoTable &videos) {
+    const uint64_t limit = INT32_MAX;
+    vector<size_t> ends;
+    uint64_t titles = 0, tags = 0, descriptions = 0;
+    string scratch;
+    for (size_t row = 0; row < videos.size(); ++row) {
+        const Video &v = videos[row];
+        uint64_t title = titlePool.view(v.title, scratch).size(), tagBytes = 0;
+        forEachTag(v.tags, [&](string_view tag) { tagBytes += tag.size(); });
+        if (row > 0 && (titles + title > limit || tags + tagBytes > limit || descriptions + v.description.length > limit)) {
+            ends.push_back(row);
+            titles = tags = descriptions = 0;
+        }
+        titles += title;
+        tags += tagBytes;
+        descriptions += v.description.length;
+    }
+    if (!videos.empty()) ends.push_back(videos.size());
+    return ends;
+}
+
+// ------------------------------------------------------------
+// Export videos as an Arrow IPC file (.arrow) or stream
+// ------------------------------------------------------------
+bool exportArrow(const VideoTable &videos, const string &filename) {
+    MemoryScope scope(MEM_EXPORT);
+    ofstream out(filename, ios::binary);
+    if (!out.is_open()) {
+        cerr << "Error: Could not write " << filename << endl;
+        return false;
+    }
+
+    bool fileFormat = endsWith(filename, ".arrow");
+    uint64_t position = 0;
+    if (fileFormat) {
+        out << string(ARROW_MAGIC, 6) << string(2, '\0');
+        position = 8;
+    }
+
+    position += writeArrowMessage(out, ARROW_HEADER_SCHEMA, arrowSchema(), "");
+
+    vector<vector<uint64_t>> blocks;
+    size_t begin = 0;
+    for (size_t end : arrowBatchEnds(videos)) {
+        size_t count = end - begin;
+        const Video *rows = videos.data() + begin;
+        ArrowBatchBuilder batch;
+
+        string scratch;
+        batch.utf8Column(count, [&](size_t i) { return titlePool.view(rows[i].title, scratch); });
+
+        vector<int32_t> tagOffsets(1, 0);
+        vector<string> tags;
+        for (size_t i = 0; i < count; ++i) {
+            forEachTag(rows[i].tags, [&](string_view tag) { tags.emplace_back(tag); });
+            tagOffsets.push_back(tags.size());
+        }
+        batch.node(count);
+        batch.noValidity();
+        batch.buffer(tagOffsets.data(), tagOffsets.size() * sizeof(int32_t));
+        batch.utf8Column(tags.size(), [&](size_t i) -> const string & { return tags[i]; });
+
+        vector<double> views(count), likes(count), ratios(count), dislikes(count), comments(count);
+        for (size_t i = 0; i < count; ++i) {
+            views[i] = rows[i].views;
+            likes[i] = rows[i].likes;
+            ratios[i] = rows[i].ratio;
+            dislikes[i] = rows[i].dislikes;
+            comments[i] = rows[i].comments;
+        }
+        batch.doubleColumn(views);
+        batch.doubleColumn(likes);
+        batch.doubleColumn(ratios);
+        batch.utf8Column(count, [&](size_t i) -> const string & { return countryCodes.name(rows[i].country); });
+        batch.doubleColumn(dislikes);
+        batch.doubleColumn(comments);
+        batch.utf8Column(count, [&](size_t i) { return descriptionArenas.view(rows[i].description); });
+        for (int f = 0; f < VIDEO_FLAG_COUNT; ++f) batch.boolColumn(count, [&](size_t i) { return (rows[i].flags >> f) & 1; });
+        vector<int64_t> publishTimes(count);
+        vector<int32_t> trendingDays(count);
+        for (size_t i = 0; i < count; ++i) {
+            publishTimes[i] = rows[i].publishTime;
+            trendingDays[i] = rows[i].trendingDay;
+        }
+        batch.fixedColumn(publishTimes);
+        batch.fixedColumn(trendingDays);
+
+        auto recordBatch = fbTable();
+        recordBatch->set(0, 8, count).ref(1, fbStructs(batch.nodes)).ref(2, fbStructs(batch.buffers));
+        uint64_t metadataLength = writeArrowMessage(out, ARROW_HEADER_RECORD_BATCH, recordBatch, batch.body);
+        blocks.push_back({position, metadataLength, batch.body.size()});
+        position += metadataLength + batch.body.size();
+        begin = end;
+    }
+
+    string endOfStream;
+    appendRaw<int32_t>(endOfStream, -1);
+    appendRaw<int32_t>(endOfStream, 0);
+    out << endOfStream;
+
+    if (fileFormat) {
+        FbObject footer;
+        footer.set(0, 2, ARROW_METADATA_V5).ref(1, arrowSchema()).ref(2, fbStructs({})).ref(3, fbStructs(blocks));
+        string footerBytes = FbWriter::finish(footer);
+        string trailer;
+        appendRaw<int32_t>(trailer, footerBytes.size());
+        out << footerBytes << trailer << string(ARROW_MAGIC, 6);
+    }
+    return static_cast<bool>(out);
+}
+
+// Float64 columns of an imported file that hold exactly the rows'
+// values, in the file's mapping. A column is left null if the file
+// has more than one record batch, the column has nulls (read as
+// 0) or a ratio other than likes / views. buildVideoIndex views
+// these instead of copying the rows' values.
+struct MappedNumericColumns {
+    shared_ptr<const void> owner;
+    const double *views = nullptr, *likes = nullptr, *dislikes = nullptr, *comments = nullptr, *ratio = nullptr;
+};
+
+// ------------------------------------------------------------
+// Import videos from an Arrow IPC file or stream. Columns are
+// matched by name; ratio is recomputed from likes and views, and
+// country, dislikes, comments, description, the status flags and
+// the dates are optional. Titles and descriptions are referenced
+// in the mapping in place; if `numeric` is given, it receives the
+// float64 columns the query index can view in place too.
+// ------------------------------------------------------------
+VideoTable importArrow(const string &filename, MappedNumericColumns *numeric = nullptr) {
+    TraceSpan span("decode");
+    VideoTable videos;
+    auto mapping = make_shared<MappedFile>(filename);
+    const MappedFile &file = *mapping;
+    if (!file.data()) {
+        cerr << "Error: Could not open " << filename << endl;
+        return videos;
+    }
+    // Titles and descriptions are referenced in the mapping in place.
+    uint32_t titleArena = 0, descriptionArena = 0;
+    bool adopted = false;
+
+    // Buffer / node positions of the columns we need, found in the schema.
+    struct ColumnSlot {
+        uint8_t type = 0;
+        size_t node = 0, buffer = 0;
+        bool found = false;
+    };
+    ColumnSlot title, tags, views, likes, ratio, country, dislikes, comments, description, flags[VIDEO_FLAG_COUNT],
+        publishTime, trendingDate;
+    // Values of views, likes, dislikes, comments and ratio in the
+    // first record batch, while they match its rows bit for bit.
+    const double *exact[5] = {};
+    size_t batches = 0;
+
+    try {
+        const char *data = file.data();
+        size_t length = file.size(), pos = 0;
+        bool haveSchema = false;
+        if (length >= 8 && memcmp(data, ARROW_MAGIC, 6) == 0) pos = 8;
+
+        while (pos + 4 <= length) {
+            int32_t metadataLength = readRaw<int32_t>(data + pos);
+            pos += 4;
+            if (metadataLength == -1) {
+                if (pos + 4 > length) break;
+                metadataLength = readRaw<int32_t>(data + pos);
+                pos += 4;
+            }
+            if (metadataLength <= 0) break;
+            if (pos + metadataLength > length) throw runtime_error("truncated Arrow message");
+
+            FbTable message = FbTable::root(data + pos, metadataLength);
+            pos += metadataLength;
+            int64_t bodyLength = message.scalar<int64_t>(3);
+            if (bodyLength < 0 || pos + bodyLength > length) throw runtime_error("truncated Arrow message body");
+            const char *body = data + pos;
+            pos += bodyLength;
+
+            uint8_t headerType = message.scalar<uint8_t>(1);
+            if (headerType == ARROW_HEADER_SCHEMA) {
+                size_t node = 0, buffer = 0;
+                function<void(const FbTable &, ColumnSlot *)> walk = [&](const FbTable &field, ColumnSlot *slot) {
+                    uint8_t type = field.scalar<uint8_t>(2);
+                    if (field.has(4)) throw runtime_error("dictionary-encoded Arrow columns are not supported");
+                    if (slot) *slot = {type, node, buffer, true};
+                    if (type == ARROW_TYPE_FLOAT && slot && field.table(3).scalar<int16_t>(0) != ARROW_PRECISION_DOUBLE)
+                        throw runtime_error("column " + field.str(0) + " is not float64");
+                    if (type == ARROW_TYPE_UTF8) buffer += 3;
+                    else if (type == ARROW_TYPE_FLOAT || type == ARROW_TYPE_INT || type == ARROW_TYPE_BOOL ||
+                             type == ARROW_TYPE_DATE || type == ARROW_TYPE_TIMESTAMP || type == ARROW_TYPE_LIST)
+                        buffer += 2;
+                    else throw runtime_error("unsupported Arrow type in column " + field.str(0));
+                    ++node;
+                    for (const auto &child : field.tables(5)) walk(child, nullptr);
+                };
+                for (const auto &field : message.table(2).tables(1)) {
+                    string name = field.str(0);
+                    ColumnSlot *slot = name == "title" ? &title : name == "tags" ? &tags
+                                     : name == "views" ? &views : name == "likes" ? &likes
+                                     : name == "country" ? &country : name == "dislikes" ? &dislikes
+                                     : name == "comments" ? &comments
+                                     : name == "description" ? &description : nullptr;
+                    for (int f = 0; f < VIDEO_FLAG_COUNT; ++f)
+                        if (name == VIDEO_FLAG_NAMES[f]) slot = &flags[f];
+                    // Ratio is only compared with likes / views, so a column of another type is ignored.
+                    if (name == "ratio" && field.scalar<uint8_t>(2) == ARROW_TYPE_FLOAT &&
+                        field.table(3).scalar<int16_t>(0) == ARROW_PRECISION_DOUBLE)
+                        slot = &ratio;
+                    if (name == "publish_time" || name == "trending_date") {
+                        bool publish = name == "publish_time";
+                        uint8_t type = field.scalar<uint8_t>(2);
+                        // Date unit defaults to milliseconds, timestamp unit to seconds.
+                        int16_t unit = field.table(3).scalar<int16_t>(0, publish ? ARROW_TIME_SECOND : 1);
+                        if (type != (publish ? ARROW_TYPE_TIMESTAMP : ARROW_TYPE_DATE) ||
+                            unit != (publish ? ARROW_TIME_SECOND : ARROW_DATE_DAY))
+                            throw runtime_error(publish ? "publish_time must be timestamp[s]" : "trending_date must be date32");
+                        slot = publish ? &publishTime : &trendingDate;
+                    }
+                    walk(field, slot);
+                }
+                if (!title.found || title.type != ARROW_TYPE_UTF8 || !tags.found || tags.type != ARROW_TYPE_LIST ||
+                    !views.found || views.type != ARROW_TYPE_FLOAT || !likes.found || likes.type != ARROW_TYPE_FLOAT)
+                    throw runtime_error("schema must contain title: utf8, tags: list<utf8>, views/likes: float64");
+                if ((country.found && country.type != ARROW_TYPE_UTF8) || (description.found && description.type != ARROW_TYPE_UTF8))
+                    throw runtime_error("country/description must be utf8");
+                if ((dislikes.found && dislikes.type != ARROW_TYPE_FLOAT) || (comments.found && comments.type != ARROW_TYPE_FLOAT))
+                    throw runtime_error("dislikes/comments must be float64");
+                for (const auto &flag : flags)
+                    if (flag.found && flag.type != ARROW_TYPE_BOOL) throw runtime_error("status flag columns must be bool");
+                haveSchema = true;
+            } else if (headerType == ARROW_HEADER_RECORD_BATCH) {
+                if (!haveSchema) throw runtime_error("record batch before schema");
+                FbTable batch = message.table(2);
+                if (batch.has(3)) throw runtime_error("compressed Arrow record batches are not supported");
+                int64_t rows = batch.scalar<int64_t>(0);
+                vector<int64_t> nodes = batch.structs(1, 2), buffers = batch.structs(2, 2);
+
+                auto buffer = [&](size_t index, size_t minSize) {
+                    if (2 * index + 1 >= buffers.size()) throw runtime_error("missing Arrow buffer");
+                    int64_t offset = buffers[2 * index], size = buffers[2 * index + 1];
+                    if (offset < 0 || size < static_cast<int64_t>(minSize) || offset + size > bodyLength)
+                        throw runtime_error("Arrow buffer out of range");
+                    return body + offset;
+                };
+                auto valid = [&](const ColumnSlot &slot, size_t nodeOffset, size_t i) {
+                    size_t n = slot.node + nodeOffset;
+                    if (2 * n + 1 >= nodes.size() || nodes[2 * n + 1] == 0) return true;
+                    const char *bits = buffer(slot.buffer + (nodeOffset ? 2 : 0), (i / 8) + 1);
+                    return ((bits[i / 8] >> (i % 8)) & 1) != 0;
+                };
+                auto utf8At = [&](size_t firstBuffer, const int32_t *offsets, int32_t i) {
+                    int32_t begin = offsets[i], end = offsets[i + 1];
+                    const char *bytes = buffer(firstBuffer + 2, end);
+                    if (begin < 0 || end < begin) throw runtime_error("bad Arrow string offsets");
+                    return string_view(bytes + begin, end - begin);
+                };
+                auto textAt = [&](uint32_t arena, size_t firstBuffer, const int32_t *offsets, int32_t i) {
+                    string_view text = utf8At(firstBuffer, offsets, i);
+                    TextRef ref;
+                    if (text.empty()) return ref;
+                    ref.arena = arena;
+                    ref.offset = text.data() - data;
+                    ref.length = static_cast<uint32_t>(text.size());
+                    return ref;
+                };
+                if (!adopted) {
+                    titleArena = titleArenas.adopt(data, mapping);
+                    descriptionArena = descriptionArenas.adopt(data, mapping);
+                    adopted = true;
+                }
+
+                const int32_t *titleOffsets = reinterpret_cast<const int32_t *>(buffer(title.buffer + 1, (rows + 1) * 4));
+                const int32_t *tagOffsets = reinterpret_cast<const int32_t *>(buffer(tags.buffer + 1, (rows + 1) * 4));
+                size_t tagCount = rows ? tagOffsets[rows] : 0;
+                const int32_t *itemOffsets = reinterpret_cast<const int32_t *>(buffer(tags.buffer + 2 + 1, (tagCount + 1) * 4));
+                const double *viewValues = reinterpret_cast<const double *>(buffer(views.buffer + 1, rows * 8));
+                const double *likeValues = reinterpret_cast<const double *>(buffer(likes.buffer + 1, rows * 8));
+                const int32_t *countryOffsets =
+                    country.found ? reinterpret_cast<const int32_t *>(buffer(country.buffer + 1, (rows + 1) * 4)) : nullptr;
+                const double *dislikeValues =
+                    dislikes.found ? reinterpret_cast<const double *>(buffer(dislikes.buffer + 1, rows * 8)) : nullptr;
+                const double *commentValues =
+                    comments.found ? reinterpret_cast<const double *>(buffer(comments.buffer + 1, rows * 8)) : nullptr;
+                const double *ratioValues = ratio.found ? reinterpret_cast<const double *>(buffer(ratio.buffer + 1, rows * 8)) : nullptr;
+                if (batches++ == 0) {
+                    const double *values[5] = {viewValues, likeValues, dislikeValues, commentValues, ratioValues};
+                    copy(values, values + 5, exact);
+                } else {
+                    fill(exact, exact + 5, nullptr);
+                }
+                const int32_t *descriptionOffsets =
+                    description.found ? reinterpret_cast<const int32_t *>(buffer(description.buffer + 1, (rows + 1) * 4)) : nullptr;
+                const char *flagBits[VIDEO_FLAG_COUNT] = {};
+                for (int f = 0; f < VIDEO_FLAG_COUNT; ++f)
+                    if (flags[f].found) flagBits[f] = buffer(flags[f].buffer + 1, (rows + 7) / 8);
+                const char *publishValues = publishTime.found ? buffer(publishTime.buffer + 1, rows * 8) : nullptr;
+                const char *trendingValues = trendingDate.found ? buffer(trendingDate.buffer + 1, rows * 4) : nullptr;
+
+                auto checkTags = [&](int64_t i) {
+                    if (tagOffsets[i] < 0 || tagOffsets[i + 1] < tagOffsets[i] || static_cast<size_t>(tagOffsets[i + 1]) > tagCount)
+                        throw runtime_error("bad Arrow list offsets");
+                };
+                trainStringSymbols([&] {
+                    SymbolSample sample;
+                    for (int64_t i = 0; i < rows && !sample.full(); ++i) {
+                        if (valid(title, 0, i)) sample.add(utf8At(title.buffer, titleOffsets, i));
+                        if (!valid(tags, 0, i)) continue;
+                        checkTags(i);
+                        for (int32_t t = tagOffsets[i]; t < tagOffsets[i + 1]; ++t)
+                            if (valid(tags, 1, t)) sample.add(utf8At(tags.buffer + 2, itemOffsets, t));
+                    }
+                    return sample.strings;
+                });
+
+                string codes;
+                for (int64_t i = 0; i < rows; ++i) {
+                    Video v;
+                    if (valid(title, 0, i)) {
+                        TextRef ref = textAt(titleArena, title.buffer, titleOffsets, i);
+                        v.title = titlePool.intern(titleArenas.view(ref), [&] { return ref; });
+                    }
+                    if (valid(tags, 0, i)) {
+                        checkTags(i);
+                        codes.clear();
+                        for (int32_t t = tagOffsets[i]; t < tagOffsets[i + 1]; ++t) {
+                            if (!valid(tags, 1, t)) continue;
+                            stringSymbols.encode(utf8At(tags.buffer + 2, itemOffsets, t), codes);
+                            codes += static_cast<char>(SymbolTable::CODE_END);
+                        }
+                        v.tags = tagArenas.append(codes);
+                    }
+                    v.views = valid(views, 0, i) ? readRaw<double>(reinterpret_cast<const char *>(viewValues + i)) : 0.0;
+                    v.likes = valid(likes, 0, i) ? readRaw<double>(reinterpret_cast<const char *>(likeValues + i)) : 0.0;
+                    v.dislikes = dislikeValues && valid(dislikes, 0, i)
+                                     ? readRaw<double>(reinterpret_cast<const char *>(dislikeValues + i)) : 0.0;
+                    v.comments = commentValues && valid(comments, 0, i)
+                                     ? readRaw<double>(reinterpret_cast<const char *>(commentValues + i)) : 0.0;
+                    v.ratio = (v.views == 0.0) ? 0.0 : v.likes / v.views;
+                    if (countryOffsets && valid(country, 0, i)) v.country = countryCodes.intern(string(utf8At(country.buffer, countryOffsets, i)));
+                    if (descriptionOffsets && valid(description, 0, i))
+                        v.description = textAt(descriptionArena, description.buffer, descriptionOffsets, i);
+                    for (int f = 0; f < VIDEO_FLAG_COUNT; ++f)
+                        if (flagBits[f] && valid(flags[f], 0, i) && ((flagBits[f][i / 8] >> (i % 8)) & 1)) v.flags |= 1 << f;
+                    if (publishValues && valid(publishTime, 0, i)) v.publishTime = readRaw<int64_t>(publishValues + i * 8);
+                    if (trendingValues && valid(trendingDate, 0, i)) v.trendingDay = readRaw<int32_t>(trendingValues + i * 4);
+                    v.hoursToTrend = hoursToTrend(v.publishTime, v.trendingDay);
+                    const double rowValues[5] = {v.views, v.likes, v.dislikes, v.comments, v.ratio};
+                    for (int c = 0; c < 5; ++c)
+                        if (exact[c] && memcmp(&rowValues[c], exact[c] + i, sizeof(double)) != 0) exact[c] = nullptr;
+                    videos.push_back(move(v));
+                }
+            }
+        }
+        if (numeric && batches == 1) {
+            for (auto &values : exact)
+                if (reinterpret_cast<uintptr_t>(values) % alignof(double) != 0) values = nullptr;
+            numeric->owner = mapping;
+            numeric->views = exact[0];
+            numeric->likes = exact[1];
+            numeric->dislikes = exact[2];
+            numeric->comments = exact[3];
+            numeric->ratio = exact[4];
+        }
+    } catch (const exception &e) {
+        cerr << "Error: " << filename << ": " << e.what() << endl;
+        videos.clear();
+    }
+    return videos;
+}
+
+// ------------------------------------------------------------
+// Load one non-CSV (or compressed) dataset by file type;
+// `numeric` is passed on to importArrow
+// ------------------------------------------------------------
+VideoTable loadDatasetFile(const string &path, MappedNumericColumns *numeric = nullptr) {
+    if (endsWith(path, ".ytc")) return loadColumnar(path);
+    if (endsWith(path, ".arrow") || endsWith(path, ".arrows")) return importArrow(path, numeric);
+    return loadSingleDataset(path);
+}
+
+// ------------------------------------------------------------
+// Map a dataset file that was read into a buffer of `size` bytes
+// and register the mapping with the text arenas, so the parser can
+// reference titles and descriptions in place. Fails (and the text
+// is copied instead) if the file cannot be mapped or has changed
+// size since it was read.
+// ------------------------------------------------------------
+bool adoptDatasetFile(const string &path, size_t size, LineSource &source) {
+    auto file = make_shared<MappedFile>(path);
+    if (!file->data() || file->size() != size) return false;
+    source.titleArena = titleArenas.adopt(file->data(), file);
+    source.descriptionArena = descriptionArenas.adopt(file->data(), file);
+    source.offset = 0;
+    return true;
+}
+
+// Dataset files in `folderPath`, in directory order.
+vector<string> datasetPaths(const string &folderPath) {
+    vector<string> paths;
+    for (const auto &entry : fs::directory_iterator(folderPath))
+        if (isDatasetFile(entry.path().filename().string())) paths.push_back(entry.path().string());
+    return paths;
+}
+
+// ------------------------------------------------------------
+// Load and combine all datasets
+//
+// Plain CSVs are read by AsyncFileReader; each file is parsed by
+// a pool of parser workers as soon as its last read completes.
+// Other formats are loaded directly by the parser workers.
+// Results are merged in directory order. When a lone Arrow file
+// is the whole dataset, its float64 columns the index can view in
+// place are stored in `numeric`.
+// ------------------------------------------------------------
+VideoTable loadAllDatasets(const string &folderPath, MappedNumericColumns *numeric = nullptr) {
+    MemoryScope scope(MEM_LOADER);
+    auto start = steady_clock::now();
+    vector<string> paths = datasetPaths(folderPath);
+
+    vector<VideoTable> results(paths.size());
+    vector<string> rawPaths;
+    vector<size_t> rawIndex;
+
+    // Parser work queue: a job loads or parses one file into results.
+    mutex queueLock;
+    condition_variable queueReady;
+    deque<function<void()>> jobs;
+    size_t jobsLeft = paths.size();
+
+    auto post = [&](function<void()> job) {
+        {
+            lock_guard<mutex> lock(queueLock);
+            jobs.push_back(move(job));
+        }
+        queueReady.notify_one();
+    };
+    auto parser = [&] {
+        MemoryScope scope(MEM_LOADER);
+        while (true) {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(queueLock);
+                queueReady.wait(lock, [&] { return !jobs.empty() || jobsLeft == 0; });
+                if (jobs.empty()) return;
+                job = move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+            {
+                lock_guard<mutex> lock(queueLock);
+                if (--jobsLeft == 0) queueReady.notify_all();
+            }
+        }
+    };
+
+    vector<thread> parsers;
+    unsigned workerCount = max(1u, thread::hardware_concurrency());
+    for (unsigned i = 0; i < workerCount && i < paths.size(); ++i) parsers.emplace_back(parser);
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+#ifndef _WIN32
+        if (endsWith(paths[i], ".csv")) {
+            rawPaths.push_back(paths[i]);
+            rawIndex.push_back(i);
+            continue;
+        }
+#endif
+        post([&, i] { results[i] = loadDatasetFile(paths[i], paths.size() == 1 ? numeric : nullptr); });
+    }
+
+#ifndef _WIN32
+    AsyncFileReader reader;
+    reader.readAll(rawPaths, [&](size_t k, ByteBuffer &&data, bool ok) {
+        size_t i = rawIndex[k];
+        auto buffer = make_shared<ByteBuffer>(move(data));
+        post([&, i, buffer, ok] {
+            // A failed async read is retried through the line reader.
+            LineSource source;
+            bool mapped = ok && adoptDatasetFile(paths[i], buffer->size(), source);
+            results[i] = ok ? parseDatasetBuffer(buffer->data(), buffer->size(), countryFromFilename(paths[i]), mapped ? &source : nullptr)
+                            : loadSingleDataset(paths[i]);
+        });
+    });
+#endif
+
+    for (auto &t : parsers) t.join();
+
+    VideoTable allVideos;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        cout << "Loading: " << fs::path(paths[i]).filename().string() << " ...\n";
+        cout << "  -> Loaded " << results[i].size() << " videos.\n";
+        allVideos.insert(allVideos.end(), make_move_iterator(results[i].begin()), make_move_iterator(results[i].end()));
+        VideoTable().swap(results[i]);
+    }
+    metrics.loadMicros.record(duration_cast<microseconds>(steady_clock::now() - start).count());
+    cout << "\nTotal videos loaded from all datasets: " << allVideos.size() << "\n";
+    return allVideos;
+}
+
+// ------------------------------------------------------------
+// NUMA topology, read from Linux sysfs. Other systems (and
+// single-socket hosts) report one node holding every CPU.
+// ------------------------------------------------------------
+struct NumaNode {
+    int id;
+    vector<int> cpus;
+};
+
+// Parses a sysfs CPU list such as "0-3,8-11".
+vector<int> parseCpuList(const string &list) {
+    vector<int> cpus;
+    for (const auto &range : split(list, ',')) {
+        size_t dash = range.find('-');
+        try {
+            int first = stoi(range.substr(0, dash));
+            int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        } catch (...) {
+        }
+    }
+    return cpus;
+}
+
+const vector<NumaNode> &numaNodes() {
+    static const vector<NumaNode> nodes = [] {
+        vector<NumaNode> result;
+#ifdef __linux__
+        error_code ec;
+        for (const auto &entry : fs::directory_iterator("/sys/devices/system/node", ec)) {
+            string name = entry.path().filename().string();
+            if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+                name.find_first_not_of("0123456789", 4) != string::npos)
+                continue;
+            ifstream in(entry.path() / "cpulist");
+            string list;
+            getline(in, list);
+            vector<int> cpus = parseCpuList(list);
+            if (!cpus.empty()) result.push_back({stoi(name.substr(4)), cpus});
+        }
+#endif
+        if (result.empty()) {
+            NumaNode all{0, {}};
+            for (unsigned cpu = 0; cpu < max(1u, thread::hardware_concurrency()); ++cpu) all.cpus.push_back(cpu);
+            result.push_back(all);
+        }
+        sort(result.begin(), result.end(), [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+        return result;
+    }();
+    return nodes;
+}
+
+void pinToNode(const NumaNode &node) {
+#ifdef __linux__
+    if (numaNodes().size() < 2) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : node.cpus) CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)node;
+#endif
+}
+
+// Rows [begin, end) of the table that live on NUMA node number `part`.
+pair<size_t, size_t> nodePartition(size_t rows, size_t part) {
+    size_t parts = numaNodes().size();
+    return {rows * part / parts, rows * (part + 1) / parts};
+}
+
+// ------------------------------------------------------------
+// Node-pinned worker pool
+//
+// One worker per CPU of each node, started on first use and pinned
+// once, so parallel passes (several per radix sort) hand out work
+// instead of spawning threads. Calls are served one at a time; a
+// call made from inside a worker runs its tasks inline.
+// ------------------------------------------------------------
+class NodeWorkerPool {
+public:
+    static NodeWorkerPool &shared() {
+        static NodeWorkerPool pool;
+        return pool;
+    }
+
+    // Index of the first worker on node number `node`.
+    size_t firstWorker(size_t node) const { return nodeStart[node]; }
+
+    // Runs each task on its worker (at most one task per worker) and
+    // waits for all of them; rethrows the first exception.
+    void run(vector<pair<size_t, function<void()>>> &tasks) {
+        if (insideWorker) {
+            for (auto &task : tasks) task.second();
+            return;
+        }
+        lock_guard<mutex> serial(callLock);
+        {
+            lock_guard<mutex> guard(lock);
+            for (auto &task : tasks) workers[task.first].task = move(task.second);
+            pending = tasks.size();
+            failure = nullptr;
+        }
+        wake.notify_all();
+        unique_lock<mutex> guard(lock);
+        done.wait(guard, [&] { return pending == 0; });
+        if (failure) rethrow_exception(failure);
+    }
+
+    ~NodeWorkerPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers) worker.runner.join();
+    }
+
+private:
+    struct Worker {
+        thread runner;
+        function<void()> task;
+    };
+
+    NodeWorkerPool() {
+        const auto &nodes = numaNodes();
+        size_t count = 0;
+        for (const auto &node : nodes) {
+            nodeStart.push_back(count);
+            count += node.cpus.size();
+        }
+        workers = deque<Worker>(count);
+        for (size_t n = 0, w = 0; n < nodes.size(); ++n)
+            for (size_t c = 0; c < nodes[n].cpus.size(); ++c, ++w)
+                workers[w].runner = thread([this, w, &node = nodes[n]] {
+                    insideWorker = true;
+                    pinToNode(node);
+                    serve(workers[w]);
+                });
+    }
+
+    void serve(Worker &worker) {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stopping || worker.task; });
+            if (!worker.task) return;
+            function<void()> task = move(worker.task);
+            worker.task = nullptr;
+            guard.unlock();
+            exception_ptr error;
+            try {
+                task();
+            } catch (...) {
+                error = current_exception();
+            }
+            guard.lock();
+            if (error && !failure) failure = error;
+            if (--pending == 0) done.notify_all();
+        }
+    }
+
+    static thread_local bool insideWorker;
+    deque<Worker> workers;
+    vector<size_t> nodeStart;
+    mutex callLock, lock;
+    condition_variable wake, done;
+    size_t pending = 0;
+    exception_ptr failure;
+    bool stopping = false;
+};
+
+thread_local bool NodeWorkerPool::insideWorker = false;
+
+// ------------------------------------------------------------
+// Run fn(begin, end) over the table in slices, one per CPU, each
+// on a pool worker pinned to the node whose partition holds the
+// slice. Slice results are returned in table order for merging.
+// ------------------------------------------------------------
+template <typename Result, typename Fn>
+vector<Result> forEachNodeSlice(size_t rows, Fn fn) {
+    const auto &nodes = numaNodes();
+    NodeWorkerPool &pool = NodeWorkerPool::shared();
+    vector<pair<size_t, size_t>> slices;
+    vector<size_t> sliceWorker;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        auto part = nodePartition(rows, n);
+        size_t workers = max<size_t>(1, min(nodes[n].cpus.size(), part.second - part.first));
+        for (size_t w = 0; w < workers; ++w) {
+            size_t span = part.second - part.first;
+            slices.push_back({part.first + span * w / workers, part.first + span * (w + 1) / workers});
+            sliceWorker.push_back(pool.firstWorker(n) + w);
+        }
+    }
+
+    // Not a vector: vector<bool> packs the slices' results into shared words.
+    deque<Result> results(slices.size());
+    vector<pair<size_t, function<void()>>> tasks;
+    MemorySubsystem subsystem = currentSubsystem;
+    for (size_t s = 0; s < slices.size(); ++s) {
+        tasks.push_back({sliceWorker[s], [&, s] {
+                             MemoryScope scope(subsystem);
+                             results[s] = fn(slices[s].first, slices[s].second);
+                         }});
+    }
+    pool.run(tasks);
+    return vector<Result>(make_move_iterator(results.begin()), make_move_iterator(results.end()));
+}
+
+// ------------------------------------------------------------
+// Move each node's partition of the table onto that node. The new
+// row storage is allocated untouched, bound to each partition's
+// node with mbind where available, and first touched by workers
+// pinned to that node, so its pages land there either way; those
+// workers then construct the rows in it, and the table becomes a
+// writable view of the block. Titles, tags and descriptions stay
+// in their arenas. Does nothing on single-node hosts.
+// ------------------------------------------------------------
+void placeOnNumaNodes(VideoTable &videos) {
+    const auto &nodes = numaNodes();
+    if (nodes.size() < 2 || videos.empty()) return;
+
+    static_assert(is_trivially_destructible<Video>::value, "rows built in the block are never destroyed");
+    MemoryScope scope(MEM_LOADER);
+    TraceSpan span("numa_place");
+    size_t bytes = videos.size() * sizeof(Video);
+    Video *rows = static_cast<Video *>(hugePageAlloc(bytes));
+    shared_ptr<const void> block(rows, [bytes](const void *p) { hugePageFree(const_cast<void *>(p), bytes); });
+    // Large tables sit on 2 MB pages (see hugePageAlloc), which can
+    // only be bound and faulted whole.
+    uintptr_t base = reinterpret_cast<uintptr_t>(rows);
+#ifdef _WIN32
+    uintptr_t page = 4096;
+#else
+    uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+#endif
+    if (videos.size() * sizeof(Video) >= HUGE_PAGE_BYTES) page = HUGE_PAGE_BYTES;
+#ifdef NUMA_BINDING
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        auto part = nodePartition(videos.size(), n);
+        uintptr_t lo = (base + part.first * sizeof(Video) + page - 1) & ~(page - 1);
+        uintptr_t hi = (base + part.second * sizeof(Video)) & ~(page - 1);
+        if (hi <= lo) continue;
+        unsigned long mask[16] = {};
+        if (nodes[n].id < 16 * 64) mask[nodes[n].id / 64] |= 1UL << (nodes[n].id % 64);
+        syscall(__NR_mbind, lo, hi - lo, MPOL_BIND, mask, sizeof(mask) * 8, 0);
+    }
+#endif
+    forEachNodeSlice<bool>(videos.size(), [&](size_t begin, size_t end) {
+        uintptr_t lo = (base + begin * sizeof(Video) + page - 1) & ~(page - 1);
+        for (uintptr_t p = lo; p < base + end * sizeof(Video); p += page) *reinterpret_cast<volatile char *>(p) = 0;
+        return true;
+    });
+
+    const VideoTable &source = videos;
+    forEachNodeSlice<bool>(videos.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) new (&rows[i]) Video(source[i]); // text refs stay in their arenas
+        return true;
+    });
+    videos.adopt(rows, source.size(), move(block), true);
+    cout << "Partitioned " << videos.size() << " videos across " << nodes.size() << " NUMA nodes.\n";
+}
+
+// ------------------------------------------------------------
+// Heap-based analysis (returns runtime)
+// ------------------------------------------------------------
+long long analyzeWithHeap(const VideoTable &videos, const vector<string> &selectedTags, bool showOutput = true) {
+    struct Compare {
+        bool operator()(const pair<double, uint32_t> &a, const pair<double, uint32_t> &b) {
+            return a.first < b.first;
+        }
+    };
+
+    MemoryScope scope(MEM_HEAP_ANALYSIS);
+    // Titles stay pool ids until the top rows are printed.
+    using RatioHeap = priority_queue<pair<double, uint32_t>, vector<pair<double, uint32_t>>, Compare>;
+    const int topCount = 10;
+
+    DtlbMissCounter tlbMisses;
+    auto start = high_resolution_clock::now();
+
+    // Tags are matched in compressed form; each matching tag pushes once.
+    vector<TagMatcher> matchers(selectedTags.begin(), selectedTags.end());
+    vector<RatioHeap> partials = forEachNodeSlice<RatioHeap>(videos.size(), [&](size_t begin, size_t end) {
+        TraceSpan span("match");
+        RatioHeap local;
+        for (size_t i = begin; i < end; ++i) {
+            const Video &v = videos[i];
+            for (const auto &matcher : matchers) {
+                for (size_t n = matcher.count(v.tags); n > 0; --n) {
+                    local.push({v.ratio, v.title});
+                }
+            }
+        }
+        return local;
+    });
+
+    // The overall top results are among the top results of each slice.
+    RatioHeap heap;
+    size_t matches = 0;
+    {
+        TraceSpan span("rank");
+        for (auto &local : partials) {
+            matches += local.size();
+            for (int i = 0; i < topCount && !local.empty(); ++i) {
+                heap.push(local.top());
+                local.pop();
+            }
+        }
+    }
+
+    auto end = high_resolution_clock::now();
+    auto duration = duration_cast<milliseconds>(end - start).count();
+    long long misses = tlbMisses.read();
+    recordAnalysis(metrics.heap, duration_cast<microseconds>(end - start).count(), videos.size(), matches);
+
+    if (showOutput) {
+        cout << "\n[Heap Analysis Completed in " << duration << " ms" << formatTlbMisses(misses) << "]\n";
+        cout << "Top " << topCount << " videos by like/view ratio:\n";
+        for (int i = 0; i < topCount && !heap.empty(); ++i) {
+            auto top = heap.top();
+            heap.pop();
+            cout << i + 1 << ". " << titlePool.str(top.second) << " (ratio: " << top.first << ")\n";
+        }
+    }
+
+    return duration;
+}
+
+// ------------------------------------------------------------
+// Hash Table-based analysis (returns runtime)
+// ------------------------------------------------------------
+long long analyzeWithHashTable(const VideoTable &videos, const vector<string> &selectedTags, bool showOutput = true) {
+    MemoryScope scope(MEM_HASH_ANALYSIS);
+    DtlbMissCounter tlbMisses;
+    auto start = high_resolution_clock::now();
+
+    using RatioMap = unordered_map<string, vector<double>>;
+    vector<TagMatcher> matchers(selectedTags.begin(), selectedTags.end());
+    vector<RatioMap> partials = forEachNodeSlice<RatioMap>(videos.size(), [&](size_t begin, size_t end) {
+        TraceSpan span("match");
+        RatioMap local;
+        for (size_t i = begin; i < end; ++i) {
+            const Video &v = videos[i];
+            for (size_t s = 0; s < matchers.size(); ++s) {
+                size_t n = matchers[s].count(v.tags);
+                if (n > 0) {
+                    auto &ratios = local[selectedTags[s]];
+                    ratios.insert(ratios.end(), n, v.ratio);
+                }
+            }
+        }
+        return local;
+    });
+
+    unordered_map<string, double> tagAverages;
+    size_t matches = 0;
+    {
+        TraceSpan span("aggregate");
+        // Slices are in table order, so appending keeps the original summation order.
+        RatioMap tagRatios;
+        for (const auto &local : partials) {
+            for (const auto &entry : local) {
+                matches += entry.second.size();
+                auto &ratios = tagRatios[entry.first];
+                ratios.insert(ratios.end(), entry.second.begin(), entry.second.end());
+            }
+        }
+
+        for (const auto &entry : tagRatios) {
+            double sum = 0;
+            for (double r : entry.second) sum += r;
+            tagAverages[entry.first] = (entry.second.empty() ? 0.0 : sum / entry.second.size());
+        }
+    }
+
+    auto end = high_resolution_clock::now();
+    auto duration = duration_cast<milliseconds>(end - start).count();
+    long long misses = tlbMisses.read();
+    recordAnalysis(metrics.hashTable, duration_cast<microseconds>(end - start).count(), videos.size(), matches);
+
+    if (showOutput) {
+        cout << "\n[Hash Table Analysis Completed in " << duration << " ms" << formatTlbMisses(misses) << "]\n";
+        cout << "Average like/view ratio for selected tags:\n";
+        for (const auto &tag : selectedTags) {
+            if (tagAverages.find(tag) != tagAverages.end())
+                cout << " - " << tag << ": " << tagAverages[tag] << "\n";
+            else
+                cout << " - " << tag << ": (no data)\n";
+        }
+    }
+
+    return duration;
+}
+
+// ------------------------------------------------------------
+// Run both analyses multiple times and compare average time
+// ------------------------------------------------------------
+void compareDataStructures(const VideoTable &videos, const vector<string> &selectedTags) {
+    const int runs = 3;
+    long long totalHeap = 0, totalHash = 0;
+
+    cout << "\nRunning both analyses " << runs << " times each to calculate average runtime...\n";
+
+    for (int i = 1; i <= runs; ++i) {
+        cout << "\n--- Run #" << i << " ---\n";
+        long long heapTime = analyzeWithHeap(videos, selectedTags, false);
+        long long hashTime = analyzeWithHashTable(videos, selectedTags, false);
+        cout << "Heap: " << heapTime << " ms | Hash Table: " << hashTime << " ms\n";
+        totalHeap += heapTime;
+        totalHash += hashTime;
+    }
+
+    double avgHeap = totalHeap / static_cast<double>(runs);
+    double avgHash = totalHash / static_cast<double>(runs);
+
+    cout << "\n--------------------------------------------------\n";
+    cout << "Performance Comparison Summary (Average of " << runs << " runs)\n";
+    cout << "--------------------------------------------------\n";
+    cout << "Average Heap Time:       " << avgHeap << " ms\n";
+    cout << "Average Hash Table Time: " << avgHash << " ms\n";
+
+    if (avgHeap < avgHash)
+        cout << "✅ Heap is faster on average.\n";
+    else if (avgHash < avgHeap)
+        cout << "✅ Hash Table is faster on average.\n";
+    else
+        cout << "⚖️ Both performed equally on average.\n";
+
+    cout << "--------------------------------------------------\n";
+}
+
+// ------------------------------------------------------------
+// Query index
+//
+// Everything the query engine reads, laid out column-wise: the
+// tag dictionary with one ascending posting list of row ids per
+// tag (CSR layout), a country dictionary and the numeric columns
+// that queries filter and rank on. Built once, on first query.
+//
+// impactPostings holds the same lists re-ordered by ratio, best
+// first (ties by row), so the best-ratio rows of a tag are at
+// the front of its list.
+//
+// titles is the word index over video titles (see TitleIndex).
+// ------------------------------------------------------------
+
+enum QueryColumn { QCOL_VIEWS, QCOL_LIKES, QCOL_DISLIKES, QCOL_COMMENTS, QCOL_RATIO, QCOL_HOURS_TO_TREND, QCOL_COUNT };
+const char *const QUERY_COLUMN_NAMES[QCOL_COUNT] = {"views", "likes", "dislikes", "comments", "ratio", "hours_to_trend"};
+
+// ------------------------------------------------------------
+// Title tokenizer
+//
+// Splits UTF-8 text into lowercase word tokens. Letters and
+// digits form words; Latin-1, Latin Extended-A, Greek and
+// Cyrillic capitals are folded to lowercase. Han ideographs and
+// kana are written without spaces, so each one is a token of its
+// own. Punctuation, symbols, emoji and invalid bytes separate
+// words.
+// ------------------------------------------------------------
+const uint32_t UTF8_INVALID = 0xFFFD;
+
+uint32_t decodeUtf8(string_view s, size_t &i) {
+    unsigned char c = s[i];
+    int length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+    if (length == 0 || i + length > s.size()) {
+        ++i;
+        return UTF8_INVALID;
+    }
+    uint32_t cp = length == 1 ? c : c & (0x7F >> length);
+    for (int k = 1; k < length; ++k) {
+        unsigned char next = s[i + k];
+        if ((next >> 6) != 0x2) {
+            ++i;
+            return UTF8_INVALID;
+        }
+        cp = (cp << 6) | (next & 0x3F);
+    }
+    i += length;
+    return cp;
+}
+
+void appendUtf8(string &out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+enum CharClass { CHAR_SEPARATOR, CHAR_WORD, CHAR_SINGLE };
+
+CharClass classifyChar(uint32_t cp) {
+    if (cp < 0x80) return isalnum(static_cast<int>(cp)) ? CHAR_WORD : CHAR_SEPARATOR;
+    if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7 || cp == UTF8_INVALID) return CHAR_SEPARATOR;
+    if ((cp >= 0x2000 && cp <= 0x2BFF) || (cp >= 0x3000 && cp <= 0x303F) || (cp >= 0xFE30 && cp <= 0xFE4F) ||
+        (cp >= 0xFF00 && cp <= 0xFF0F) || (cp >= 0xFF1A && cp <= 0xFF20) || (cp >= 0xFF3B && cp <= 0xFF40) ||
+        (cp >= 0xFF5B && cp <= 0xFF65) || cp >= 0x1F000)
+        return CHAR_SEPARATOR;
+    if ((cp >= 0x3040 && cp <= 0x30FF) || (cp >= 0x3400 && cp <= 0x4DBF) || (cp >= 0x4E00 && cp <= 0x9FFF))
+        return CHAR_SINGLE;
+    return CHAR_WORD;
+}
+
+uint32_t foldCase(uint32_t cp) {
+    if (cp < 0x80) return static_cast<uint32_t>(tolower(static_cast<int>(cp)));
+    if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) return cp + 0x20;
+    if ((cp >= 0x100 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177)) return cp | 1;
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) return (cp & 1) ? cp + 1 : cp;
+    if (cp == 0x178) return 0xFF;
+    if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) return cp + 0x20;
+    if (cp >= 0x400 && cp <= 0x40F) return cp + 0x50;
+    if (cp >= 0x410 && cp <= 0x42F) return cp + 0x20;
+    return cp;
+}
+
+vector<string> tokenizeTitle(string_view text) {
+    vector<string> tokens;
+    string word;
+    for (size_t i = 0; i < text.size();) {
+        uint32_t cp = decodeUtf8(text, i);
+        CharClass kind = classifyChar(cp);
+        if (kind == CHAR_WORD) {
+            appendUtf8(word, foldCase(cp));
+            continue;
+        }
+        if (!word.empty()) tokens.push_back(move(word));
+        word.clear();
+        if (kind == CHAR_SINGLE) {
+            tokens.emplace_back();
+            appendUtf8(tokens.back(), cp);
+        }
+    }
+    if (!word.empty()) tokens.push_back(move(word));
+    return tokens;
+}
+
+// ------------------------------------------------------------
+// Title index
+//
+// One posting list per title term, rows ascending with the
+// term's count in the title (CSR layout). Lists are split into
+// blocks of TITLE_BLOCK_POSTINGS; each block records its last
+// row, its best BM25 contribution and its best ratio, so top-K
+// retrieval can skip blocks that cannot reach the current K-th
+// score without decoding them.
+// ------------------------------------------------------------
+const uint32_t TITLE_BLOCK_POSTINGS = 64;
+const float BM25_K1 = 1.2f, BM25_B = 0.75f;
+
+// Strings stored back to back: string i is bytes[offsets[i], offsets[i + 1]).
+struct StringColumn {
+    Column<uint64_t> offsets;
+    Column<char> bytes;
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    string_view operator[](size_t i) const { return string_view(bytes.data() + offsets[i], offsets[i + 1] - offsets[i]); }
+
+    void push_back(string_view s) {
+        if (offsets.empty()) offsets.push_back(0);
+        bytes.insert(bytes.end(), s.begin(), s.end());
+        offsets.push_back(bytes.size());
+    }
+};
+
+struct TitleIndex {
+    StringColumn terms;         // text of term t
+    Column<uint32_t> termOrder; // term ids sorted by text, see find()
+    Column<uint32_t> termOffsets; // postings of term t: [termOffsets[t], termOffsets[t + 1])
+    Column<uint32_t> rows;
+    Column<uint16_t> counts;
+    Column<float> termIdf;
+    Column<float> termMaxBm25;
+    Column<double> termMaxRatio;
+
+    Column<uint32_t> blockOffsets; // blocks of term t: [blockOffsets[t], blockOffsets[t + 1])
+    Column<uint32_t> blockLastRow;
+    Column<float> blockMaxBm25;
+    Column<double> blockMaxRatio;
+
+    Column<float> lengthNorm; // per row: K1 * (1 - B + B * length / average length)
+
+    float bm25(uint32_t term, size_t posting) const {
+        float tf = counts[posting];
+        return termIdf[term] * tf * (BM25_K1 + 1) / (tf + lengthNorm[rows[posting]]);
+    }
+
+    // Id of `term`, or UINT32_MAX if no title has it.
+    uint32_t find(string_view term) const {
+        auto it = lower_bound(termOrder.begin(), termOrder.end(), term,
+                              [&](uint32_t t, string_view text) { return terms[t] < text; });
+        return it != termOrder.end() && terms[*it] == term ? *it : UINT32_MAX;
+    }
+};
+
+// One bitmap per value bit of an integer column, one after the
+// other (slice(i) has the rows whose value has bit i set); see
+// bitSliceCompare.
+struct BitSlicedColumn {
+    bool indexed = false; // false when a value is fractional or negative
+    size_t slices = 0;
+    Column<uint64_t> words;
+
+    const uint64_t *slice(size_t i) const { return words.data() + i * (words.size() / slices); }
+};
+
+struct VideoIndex {
+    size_t rows = 0;
+
+    StringColumn tagNames;
+    Column<uint32_t> postingOffsets; // postings of tag t: [offsets[t], offsets[t + 1])
+    Column<uint32_t> postings;
+    Column<uint32_t> impactPostings; // same offsets, ratio-descending order
+
+    StringColumn countryNames; // by id in countryCodes
+    Column<uint16_t> country;
+
+    Column<double> numeric[QCOL_COUNT]; // indexed by QueryColumn
+    Column<uint64_t> flagBitmaps[VIDEO_FLAG_COUNT]; // one bit per row, indexed by flag bit
+    BitSlicedColumn ranges[QCOL_COUNT];             // for the count columns
+
+    TitleIndex titles;
+
+    // Non-empty descriptions in arena order, with their rows.
+    Column<TextRef> descriptions;
+    Column<uint32_t> descriptionRows;
+};
+
+// Calls f(column) for every column of `index`, in a fixed order
+// that is also the index's layout in a shared-memory dataset, so
+// new VideoIndex columns belong here too.
+template <typename F>
+void forEachIndexColumn(VideoIndex &index, F f) {
+    f(index.tagNames.offsets);
+    f(index.tagNames.bytes);
+    f(index.postingOffsets);
+    f(index.postings);
+    f(index.impactPostings);
+    f(index.countryNames.offsets);
+    f(index.countryNames.bytes);
+    f(index.country);
+    for (auto &column : index.numeric) f(column);
+    for (auto &bitmap : index.flagBitmaps) f(bitmap);
+    for (auto &range : index.ranges) f(range.words);
+    TitleIndex &titles = index.titles;
+    f(titles.terms.offsets);
+    f(titles.terms.bytes);
+    f(titles.termOrder);
+    f(titles.termOffsets);
+    f(titles.rows);
+    f(titles.counts);
+    f(titles.termIdf);
+    f(titles.termMaxBm25);
+    f(titles.termMaxRatio);
+    f(titles.blockOffsets);
+    f(titles.blockLastRow);
+    f(titles.blockMaxBm25);
+    f(titles.blockMaxRatio);
+    f(titles.lengthNorm);
+    f(index.descriptions);
+    f(index.descriptionRows);
+}
+
+TitleIndex buildTitleIndex(const VideoTable &videos, const Column<double> &ratio) {
+    TraceSpan span("title_index");
+    TitleIndex index;
+    unordered_map<string, uint32_t> termIds;
+
+    // Pass 1: (term, count) pairs per row, grouped by row. Each
+    // distinct title is tokenized once; repeats copy the terms of
+    // the first row with the same title id.
+    vector<uint32_t> rowOffsets(1, 0), rowTerms, documentFrequency;
+    vector<uint16_t> rowCounts;
+    vector<uint32_t> firstRow(titlePool.size(), UINT32_MAX);
+    index.lengthNorm.resize(videos.size());
+    double totalLength = 0;
+    for (size_t row = 0; row < videos.size(); ++row) {
+        uint32_t &first = firstRow[videos[row].title];
+        if (first != UINT32_MAX) {
+            for (uint32_t i = rowOffsets[first], end = rowOffsets[first + 1]; i < end; ++i) {
+                uint32_t term = rowTerms[i];
+                uint16_t count = rowCounts[i];
+                rowTerms.push_back(term);
+                rowCounts.push_back(count);
+                ++documentFrequency[term];
+            }
+            rowOffsets.push_back(rowTerms.size());
+            index.lengthNorm[row] = index.lengthNorm[first];
+            totalLength += index.lengthNorm[first];
+            continue;
+        }
+        first = static_cast<uint32_t>(row);
+        string scratch;
+        vector<string> tokens = tokenizeTitle(titlePool.view(videos[row].title, scratch));
+        vector<uint32_t> ids;
+        for (const auto &token : tokens) {
+            auto it = termIds.emplace(token, static_cast<uint32_t>(documentFrequency.size()));
+            if (it.second) documentFrequency.push_back(0);
+            ids.push_back(it.first->second);
+        }
+        sort(ids.begin(), ids.end());
+        for (size_t i = 0; i < ids.size();) {
+            size_t j = i;
+            while (j < ids.size() && ids[j] == ids[i]) ++j;
+            rowTerms.push_back(ids[i]);
+            rowCounts.push_back(static_cast<uint16_t>(min<size_t>(j - i, UINT16_MAX)));
+            ++documentFrequency[ids[i]];
+            i = j;
+        }
+        rowOffsets.push_back(rowTerms.size());
+        index.lengthNorm[row] = static_cast<float>(tokens.size()); // length until normalized below
+        totalLength += tokens.size();
+    }
+    float averageLength = videos.empty() ? 1.0f : static_cast<float>(max(1.0, totalLength / videos.size()));
+    for (auto &norm : index.lengthNorm) norm = BM25_K1 * (1 - BM25_B + BM25_B * norm / averageLength);
+
+    // Term texts by id, and ids in text order for lookups.
+    size_t terms = documentFrequency.size();
+    vector<const string *> termText(terms);
+    for (const auto &entry : termIds) termText[entry.second] = &entry.first;
+    for (const string *text : termText) index.terms.push_back(*text);
+    index.termOrder.resize(terms);
+    for (uint32_t t = 0; t < terms; ++t) index.termOrder[t] = t;
+    sort(index.termOrder.begin(), index.termOrder.end(), [&](uint32_t a, uint32_t b) { return *termText[a] < *termText[b]; });
+
+    // Pass 2: regroup by term; rows are visited in order, so each list is sorted.
+    index.termOffsets.assign(terms + 1, 0);
+    for (size_t t = 0; t < terms; ++t) index.termOffsets[t + 1] = index.termOffsets[t] + documentFrequency[t];
+    index.rows.resize(rowTerms.size());
+    index.counts.resize(rowTerms.size());
+    vector<uint32_t> fill(index.termOffsets.begin(), index.termOffsets.end() - 1);
+    for (size_t row = 0; row < videos.size(); ++row) {
+        for (uint32_t i = rowOffsets[row]; i < rowOffsets[row + 1]; ++i) {
+            uint32_t p = fill[rowTerms[i]]++;
+            index.rows[p] = static_cast<uint32_t>(row);
+            index.counts[p] = rowCounts[i];
+        }
+    }
+
+    // Block maxima and per-term bounds.
+    index.termIdf.resize(terms);
+    index.termMaxBm25.assign(terms, 0.0f);
+    index.termMaxRatio.assign(terms, 0.0);
+    index.blockOffsets.assign(1, 0);
+    for (size_t t = 0; t < terms; ++t) {
+        double df = documentFrequency[t];
+        index.termIdf[t] = static_cast<float>(log(1.0 + (videos.size() - df + 0.5) / (df + 0.5)));
+        for (uint32_t begin = index.termOffsets[t]; begin < index.termOffsets[t + 1]; begin += TITLE_BLOCK_POSTINGS) {
+            uint32_t end = min(begin + TITLE_BLOCK_POSTINGS, index.termOffsets[t + 1]);
+            float bestBm25 = 0.0f;
+            double bestRatio = 0.0;
+            for (uint32_t p = begin; p < end; ++p) {
+                bestBm25 = max(bestBm25, index.bm25(t, p));
+                bestRatio = max(bestRatio, ratio[index.rows[p]]);
+            }
+            index.blockLastRow.push_back(index.rows[end - 1]);
+            index.blockMaxBm25.push_back(bestBm25);
+            index.blockMaxRatio.push_back(bestRatio);
+            index.termMaxBm25[t] = max(index.termMaxBm25[t], bestBm25);
+            index.termMaxRatio[t] = max(index.termMaxRatio[t], bestRatio);
+        }
+        index.blockOffsets.push_back(index.blockLastRow.size());
+    }
+    return index;
+}
+
+BitSlicedColumn buildBitSlices(const Column<double> &values) {
+    BitSlicedColumn column;
+    uint64_t maxValue = 0;
+    for (double v : values) {
+        if (!(v >= 0.0 && v < 9.0e18 && v == static_cast<double>(static_cast<uint64_t>(v)))) return column;
+        maxValue = max(maxValue, static_cast<uint64_t>(v));
+    }
+    column.indexed = true;
+    column.slices = maxValue ? highestBit(maxValue) + 1 : 0;
+    size_t sliceWords = (values.size() + 63) / 64;
+    column.words.assign(column.slices * sliceWords, 0);
+    uint64_t *words = column.words.data();
+    for (size_t row = 0; row < values.size(); ++row)
+        for (uint64_t bits = static_cast<uint64_t>(values[row]); bits; bits &= bits - 1)
+            words[highestBit(bits & (~bits + 1)) * sliceWords + row / 64] |= 1ULL << (row % 64);
+    return column;
+}
+
+// Builds the query index of `videos`. Numeric columns found in
+// `mapped` (see importArrow) are viewed there instead of copied.
+VideoIndex buildVideoIndex(const VideoTable &videos, const MappedNumericColumns *mapped = nullptr) {
+    MemoryScope scope(MEM_INDEXES);
+    TraceSpan span("index_build");
+    VideoIndex index;
+    index.rows = videos.size();
+    const double *viewed[QCOL_COUNT] = {};
+    if (mapped) {
+        viewed[QCOL_VIEWS] = mapped->views;
+        viewed[QCOL_LIKES] = mapped->likes;
+        viewed[QCOL_DISLIKES] = mapped->dislikes;
+        viewed[QCOL_COMMENTS] = mapped->comments;
+        viewed[QCOL_RATIO] = mapped->ratio;
+    }
+    double *filled[QCOL_COUNT] = {};
+    for (int c = 0; c < QCOL_COUNT; ++c) {
+        if (viewed[c]) {
+            index.numeric[c].adopt(viewed[c], videos.size(), mapped->owner);
+        } else {
+            index.numeric[c].resize(videos.size());
+            filled[c] = index.numeric[c].data();
+        }
+    }
+
+    // Pass 1: intern tags (decoded once here) and count postings per tag.
+    vector<uint32_t> counts, rowTags, rowTagOffsets(1, 0);
+    unordered_map<string, uint32_t> tagIds;
+    for (size_t id = 0; id < countryCodes.size(); ++id) index.countryNames.push_back(countryCodes.name(static_cast<uint16_t>(id)));
+    index.country.resize(videos.size());
+    for (auto &bitmap : index.flagBitmaps) bitmap.assign((videos.size() + 63) / 64, 0);
+    for (size_t row = 0; row < videos.size(); ++row) {
+        const Video &v = videos[row];
+        forEachTag(v.tags, [&](string_view tag) {
+            auto it = tagIds.emplace(string(tag), static_cast<uint32_t>(index.tagNames.size()));
+            if (it.second) {
+                index.tagNames.push_back(tag);
+                counts.push_back(0);
+            }
+            ++counts[it.first->second];
+            rowTags.push_back(it.first->second);
+        });
+        rowTagOffsets.push_back(rowTags.size());
+        index.country[row] = v.country;
+        const double values[QCOL_COUNT] = {v.views, v.likes, v.dislikes, v.comments, v.ratio, v.hoursToTrend};
+        for (int c = 0; c < QCOL_COUNT; ++c)
+            if (filled[c]) filled[c][row] = values[c];
+        for (int f = 0; f < VIDEO_FLAG_COUNT; ++f)
+            if ((v.flags >> f) & 1) index.flagBitmaps[f][row / 64] |= 1ULL << (row % 64);
+    }
+
+    // Pass 2: fill posting lists; rows are visited in order, so each list is sorted.
+    index.postingOffsets.assign(counts.size() + 1, 0);
+    for (size_t t = 0; t < counts.size(); ++t) index.postingOffsets[t + 1] = index.postingOffsets[t] + counts[t];
+    index.postings.resize(index.postingOffsets.back());
+    vector<uint32_t> fill(index.postingOffsets.begin(), index.postingOffsets.end() - 1);
+    for (size_t row = 0; row < videos.size(); ++row) {
+        for (uint32_t i = rowTagOffsets[row]; i < rowTagOffsets[row + 1]; ++i) {
+            uint32_t t = rowTags[i];
+            // A tag repeated within one video is posted once.
+            if (fill[t] > index.postingOffsets[t] && index.postings[fill[t] - 1] == row) continue;
+            index.postings[fill[t]++] = static_cast<uint32_t>(row);
+        }
+    }
+    // Close the gaps left by skipped duplicates.
+    size_t write = 0;
+    for (size_t t = 0; t < counts.size(); ++t) {
+        uint32_t begin = index.postingOffsets[t];
+        index.postingOffsets[t] = write;
+        for (uint32_t p = begin; p < fill[t]; ++p) index.postings[write++] = index.postings[p];
+    }
+    index.postingOffsets.back() = write;
+    index.postings.resize(write);
+
+    index.impactPostings = index.postings;
+    const Column<double> &ratio = index.numeric[QCOL_RATIO];
+    for (size_t t = 0; t < counts.size(); ++t)
+        sort(index.impactPostings.begin() + index.postingOffsets[t], index.impactPostings.begin() + index.postingOffsets[t + 1],
+             [&](uint32_t a, uint32_t b) { return ratio[a] != ratio[b] ? ratio[a] > ratio[b] : a < b; });
+
+    index.titles = buildTitleIndex(videos, ratio);
+    for (QueryColumn c : {QCOL_VIEWS, QCOL_LIKES, QCOL_DISLIKES, QCOL_COMMENTS}) index.ranges[c] = buildBitSlices(index.numeric[c]);
+
+    for (size_t row = 0; row < videos.size(); ++row)
+        if (videos[row].description.length) index.descriptionRows.push_back(static_cast<uint32_t>(row));
+    sort(index.descriptionRows.begin(), index.descriptionRows.end(), [&](uint32_t a, uint32_t b) {
+        const TextRef &x = videos[a].description, &y = videos[b].description;
+        return x.arena != y.arena ? x.arena < y.arena : x.offset != y.offset ? x.offset < y.offset : a < b;
+    });
+    index.descriptions.resize(index.descriptionRows.size());
+    for (size_t i = 0; i < index.descriptionRows.size(); ++i) index.descriptions[i] = videos[index.descriptionRows[i]].description;
+    return index;
+}
+
+// Ids of every dictionary tag containing `selTag`, the same
+// substring rule the heap and hash table analyses use.
+vector<uint32_t> matchingTagIds(const VideoIndex &index, const string &selTag) {
+    vector<uint32_t> ids;
+    for (uint32_t t = 0; t < index.tagNames.size(); ++t)
+        if (index.tagNames[t].find(selTag) != string_view::npos) ids.push_back(t);
+    return ids;
+}
+
+// Row bitmap of rows having any tag that matches any of `tags`.
+vector<uint64_t> tagBitmap(const VideoIndex &index, const vector<string> &tags) {
+    vector<uint64_t> bitmap((index.rows + 63) / 64, 0);
+    for (const auto &selTag : tags)
+        for (uint32_t t : matchingTagIds(index, selTag))
+            for (uint32_t p = index.postingOffsets[t]; p < index.postingOffsets[t + 1]; ++p)
+                bitmap[index.postings[p] / 64] |= 1ULL << (index.postings[p] % 64);
+    return bitmap;
+}
+
+vector<uint32_t> bitmapRows(const vector<uint64_t> &bitmap) {
+    vector<uint32_t> rows;
+    for (size_t w = 0; w < bitmap.size(); ++w) {
+        if (bitmap[w] == ~0ULL) {
+            for (uint32_t bit = 0; bit < 64; ++bit) rows.push_back(static_cast<uint32_t>(w * 64 + bit));
+            continue;
+        }
+        for (uint64_t bits = bitmap[w]; bits; bits &= bits - 1)
+            rows.push_back(static_cast<uint32_t>(w * 64 + highestBit(bits & (~bits + 1))));
+    }
+    return rows;
+}
+
+// Sorted, distinct rows having any tag that matches any of `tags`.
+vector<uint32_t> lookupTags(const VideoIndex &index, const vector<string> &tags) {
+    return bitmapRows(tagBitmap(index, tags));
+}
+
+// Ids of the title terms present in the index.
+vector<uint32_t> titleTermIds(const VideoIndex &index, const vector<string> &terms) {
+    vector<uint32_t> ids;
+    for (const auto &term : terms) {
+        uint32_t id = index.titles.find(term);
+        if (id != UINT32_MAX) ids.push_back(id);
+    }
+    return ids;
+}
+
+// Row bitmap of rows whose title has any of `terms`.
+vector<uint64_t> titleBitmap(const VideoIndex &index, const vector<string> &terms) {
+    vector<uint64_t> bitmap((index.rows + 63) / 64, 0);
+    for (uint32_t t : titleTermIds(index, terms))
+        for (uint32_t p = index.titles.termOffsets[t]; p < index.titles.termOffsets[t + 1]; ++p)
+            bitmap[index.titles.rows[p] / 64] |= 1ULL << (index.titles.rows[p] % 64);
+    return bitmap;
+}
+
+// Sorted, distinct rows whose title has any of `terms`.
+vector<uint32_t> lookupTitleTerms(const VideoIndex &index, const vector<string> &terms) {
+    return bitmapRows(titleBitmap(index, terms));
+}
+
+// ------------------------------------------------------------
+// Description search
+//
+// A search walks the index's descriptions in arena order, so the
+// text is read front to back, in one slice per core. Each
+// description is tested against every pattern while it is still
+// in cache. Matching ignores ASCII case: candidate positions are
+// found 16 at a time by comparing the pattern's first and last
+// bytes together (SSE2, or a byte loop without it), and only
+// those are compared in full. Rows sharing one stored text, as
+// after loading a columnar file, are tested once.
+// ------------------------------------------------------------
+char foldAscii(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c; }
+
+bool isAsciiLetter(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+// `pattern` must already be folded with foldAscii.
+bool equalsFolded(const char *text, const char *pattern, size_t length) {
+    for (size_t i = 0; i < length; ++i)
+        if (foldAscii(text[i]) != pattern[i]) return false;
+    return true;
+}
+
+bool containsFolded(const char *text, size_t length, const string &pattern) {
+    size_t m = pattern.size();
+    if (m == 0) return true;
+    if (m > length) return false;
+    size_t starts = length - m + 1, i = 0;
+#ifdef __SSE2__
+    // OR-ing 0x20 lowercases ASCII letters and maps no other byte onto one.
+    const __m128i first = _mm_set1_epi8(pattern[0]), last = _mm_set1_epi8(pattern[m - 1]);
+    const __m128i firstFold = _mm_set1_epi8(isAsciiLetter(pattern[0]) ? 0x20 : 0);
+    const __m128i lastFold = _mm_set1_epi8(isAsciiLetter(pattern[m - 1]) ? 0x20 : 0);
+    for (; i + 16 <= starts; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i + m - 1));
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(a, firstFold), first),
+                                     _mm_cmpeq_epi8(_mm_or_si128(b, lastFold), last));
+        for (uint64_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits)); mask; mask &= mask - 1)
+            if (equalsFolded(text + i + highestBit(mask & (~mask + 1)), pattern.data(), m)) return true;
+    }
+#endif
+    for (; i < starts; ++i)
+        if (foldAscii(text[i]) == pattern[0] && equalsFolded(text + i, pattern.data(), m)) return true;
+    return false;
+}
+
+// Row bitmap of rows whose description contains any of `patterns`.
+vector<uint64_t> descriptionBitmap(const VideoIndex &index, const vector<string> &patterns) {
+    TraceSpan span("description_scan");
+    vector<string> folded = patterns;
+    for (auto &p : folded) transform(p.begin(), p.end(), p.begin(), foldAscii);
+
+    auto hits = forEachNodeSlice<vector<uint32_t>>(index.descriptions.size(), [&](size_t begin, size_t end) {
+        vector<uint32_t> rows;
+        bool match = false;
+        for (size_t i = begin; i < end; ++i) {
+            const TextRef &ref = index.descriptions[i];
+            if (i == begin || ref.arena != index.descriptions[i - 1].arena || ref.offset != index.descriptions[i - 1].offset) {
+                const char *text = descriptionArenas.data(ref);
+                match = any_of(folded.begin(), folded.end(), [&](const string &p) { return containsFolded(text, ref.length, p); });
+            }
+            if (match) rows.push_back(index.descriptionRows[i]);
+        }
+        return rows;
+    });
+
+    vector<uint64_t> bitmap((index.rows + 63) / 64, 0);
+    for (const auto &slice : hits)
+        for (uint32_t row : slice) bitmap[row / 64] |= 1ULL << (row % 64);
+    return bitmap;
+}
+
+// Sorted rows whose description contains any of `patterns`.
+vector<uint32_t> lookupDescriptions(const VideoIndex &index, const vector<string> &patterns) {
+    return bitmapRows(descriptionBitmap(index, patterns));
+}
+
+// ------------------------------------------------------------
+// Shared-memory datasets (POSIX shm)
+//
+// One instance publishes the loaded dataset into a named
+// shared-memory object and later instances map it read-only
+// instead of parsing data/. The object holds the arrays an
+// instance works on, each located by its offset from the start so
+// it is valid wherever a process maps it: the rows, the text they
+// reference, the title pool's entries, the country codes and
+// symbol table, and every column of the query index. Attaching
+// adopts them all in place, so nothing is decoded, copied or
+// rebuilt, and all attached instances share one copy of the pages.
+//
+// Rows reference text by arena and by pool id, so the publisher
+// rewrites those against the object (arena 0 of each TextArenas,
+// pool ids in object order), and an instance can only attach
+// before it loads text of its own. Rows keep this build's layout;
+// objects published by a build with another Video size are
+// refused.
+// ------------------------------------------------------------
+const char SHARED_MAGIC[4] = {'Y', 'T', 'S', '2'};
+const uint64_t SHARED_ALIGN = 64;
+
+struct SharedHeader {
+    char magic[4];
+    uint32_t videoBytes; // sizeof(Video) of the publishing build
+    uint64_t rows;
+    uint64_t arrays;                  // SharedArray entries after the header
+    uint64_t rangeSlices[QCOL_COUNT]; // BitSlicedColumn::slices, UINT64_MAX if not indexed
+};
+
+struct SharedArray {
+    uint64_t offset;
+    uint64_t count;
+    uint64_t width; // bytes per value
+};
+
+// What a shared dataset holds besides its query index.
+struct SharedDataset {
+    VideoTable rows;
+    Column<char> tagCodes, titleText, descriptionText;
+    Column<TextRef> titles; // title pool entries by id, text in titleText
+    StringColumn countries; // countryCodes by id
+    Column<uint64_t> symbols;
+    Column<uint8_t> symbolLengths;
+};
+
+// Calls f(column) for every array of a shared dataset, in object order.
+template <typename F>
+void forEachSharedArray(SharedDataset &dataset, VideoIndex &index, F f) {
+    f(dataset.rows);
+    f(dataset.tagCodes);
+    f(dataset.titleText);
+    f(dataset.descriptionText);
+    f(dataset.titles);
+    f(dataset.countries.offsets);
+    f(dataset.countries.bytes);
+    f(dataset.symbols);
+    f(dataset.symbolLengths);
+    forEachIndexColumn(index, f);
+}
+
+// Arrays to write, with their directory entries.
+using SharedArrays = vector<pair<const void *, SharedArray>>;
+
+// Places `arrays` after a header of `headerBytes` and their
+// directory, each SHARED_ALIGN-aligned; returns the total size.
+uint64_t placeSharedArrays(SharedArrays &arrays, uint64_t headerBytes) {
+    uint64_t bytes = headerBytes + arrays.size() * sizeof(SharedArray);
+    for (auto &array : arrays) {
+        bytes = (bytes + SHARED_ALIGN - 1) & ~(SHARED_ALIGN - 1);
+        array.second.offset = bytes;
+        bytes += array.second.count * array.second.width;
+    }
+    return bytes;
+}
+
+// Writes the directory of placed `arrays` and their values.
+void writeSharedArrays(char *dst, const SharedArrays &arrays, uint64_t headerBytes) {
+    for (size_t i = 0; i < arrays.size(); ++i) {
+        const SharedArray &array = arrays[i].second;
+        memcpy(dst + headerBytes + i * sizeof(SharedArray), &array, sizeof(array));
+        if (array.count) memcpy(dst + array.offset, arrays[i].first, array.count * array.width);
+    }
+}
+
+// Makes `column` view `array` of the `size` bytes at `base`, kept
+// alive by `owner`. False if the array does not hold values of the
+// column's type or lies outside those bytes.
+template <typename T>
+bool adoptSharedArray(Column<T> &column, const char *base, size_t size, const SharedArray &array,
+                      const shared_ptr<const void> &owner) {
+    if (array.width != sizeof(T) || array.offset > size || array.count > (size - array.offset) / sizeof(T) ||
+        reinterpret_cast<uintptr_t>(base + array.offset) % alignof(T) != 0)
+        return false;
+    column.adopt(reinterpret_cast<const T *>(base + array.offset), array.count, owner);
+    return true;
+}
+
+// Sets what an adopted index keeps beside its arrays.
+void setIndexShape(VideoIndex &index, uint64_t rows, const uint64_t rangeSlices[QCOL_COUNT]) {
+    index.rows = rows;
+    for (int c = 0; c < QCOL_COUNT; ++c) {
+        index.ranges[c].indexed = rangeSlices[c] != UINT64_MAX;
+        index.ranges[c].slices = index.ranges[c].indexed ? rangeSlices[c] : 0;
+    }
+}
+
+string sharedMemoryName(const string &name) { return name.empty() || name[0] != '/' ? "/" + name : name; }
+
+#ifndef _WIN32
+// Creates the shm object `path` of `bytes` and fills it through
+// write(char *). Attaching checks the magic, so it is written last.
+template <typename Write>
+bool writeSharedObject(const string &path, size_t bytes, Write write) {
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        cerr << "Error: Could not create shared memory " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    void *p = ftruncate(fd, bytes) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        cerr << "Error: Could not map shared memory " << path << ": " << strerror(errno) << endl;
+        shm_unlink(path.c_str());
+        return false;
+    }
+    char *dst = static_cast<char *>(p);
+    write(dst);
+    atomic_thread_fence(memory_order_release);
+    memcpy(dst, SHARED_MAGIC, 4);
+    munmap(p, bytes);
+    return true;
+}
+#endif
+
+// Publishes `videos` and their query index as the shared dataset
+// `name`. index.descriptions is swapped with its rewritten copy
+// while the object is written.
+bool publishSharedDataset(const VideoTable &videos, VideoIndex &index, const string &name) {
+#ifdef _WIN32
+    (void)videos;
+    (void)index;
+    cerr << "Error: Shared-memory datasets are not supported on this platform (" << name << ")" << endl;
+    return false;
+#else
+    TraceSpan span("share");
+    MemoryScope scope(MEM_DICTIONARY);
+    SharedDataset dataset;
+    auto append = [](Column<char> &text, string_view value) {
+        uint64_t offset = text.size();
+        text.insert(text.end(), value.begin(), value.end());
+        text.push_back('\0');
+        return offset;
+    };
+
+    // Descriptions first, in the index's arena order, so the
+    // rewritten index lists them in object order.
+    unordered_map<const char *, uint64_t> descriptionOffsets;
+    auto description = [&](const TextRef &ref) {
+        auto it = descriptionOffsets.emplace(descriptionArenas.data(ref), 0);
+        if (it.second) it.first->second = append(dataset.descriptionText, descriptionArenas.view(ref));
+        return TextRef{it.first->second, 0, ref.length};
+    };
+    const Column<TextRef> &original = index.descriptions;
+    Column<TextRef> descriptions(original.size());
+    for (size_t i = 0; i < descriptions.size(); ++i) descriptions[i] = description(original[i]);
+
+    // Rows, with tag lists and titles stored once each.
+    unordered_map<string_view, uint64_t> tagOffsets;
+    vector<uint32_t> titleIds(titlePool.size(), 0);
+    dataset.titles.push_back(TextRef());
+    string scratch;
+    dataset.rows = videos;
+    for (Video &v : dataset.rows) {
+        if (v.tags.length) {
+            auto it = tagOffsets.emplace(tagArenas.view(v.tags), 0);
+            if (it.second) it.first->second = append(dataset.tagCodes, it.first->first);
+            v.tags = TextRef{it.first->second, 0, v.tags.length};
+        }
+        if (v.title) {
+            uint32_t &id = titleIds[v.title];
+            if (!id) {
+                string_view title = titlePool.view(v.title, scratch);
+                id = static_cast<uint32_t>(dataset.titles.size());
+                dataset.titles.push_back(TextRef{append(dataset.titleText, title), 0, static_cast<uint32_t>(title.size())});
+            }
+            v.title = id;
+        }
+        if (v.description.length) v.description = description(v.description);
+    }
+    for (size_t id = 0; id < countryCodes.size(); ++id) dataset.countries.push_back(countryCodes.name(static_cast<uint16_t>(id)));
+    for (unsigned code = 0; code < stringSymbols.size(); ++code) {
+        dataset.symbols.push_back(readRaw<uint64_t>(stringSymbols.symbol(static_cast<uint8_t>(code))));
+        dataset.symbolLengths.push_back(static_cast<uint8_t>(stringSymbols.length(static_cast<uint8_t>(code))));
+    }
+
+    SharedHeader header = {};
+    header.videoBytes = sizeof(Video);
+    header.rows = videos.size();
+    for (int c = 0; c < QCOL_COUNT; ++c) header.rangeSlices[c] = index.ranges[c].indexed ? index.ranges[c].slices : UINT64_MAX;
+
+    descriptions.swap(index.descriptions);
+    SharedArrays arrays;
+    forEachSharedArray(dataset, index, [&](const auto &column) {
+        arrays.push_back({column.data(), SharedArray{0, column.size(), sizeof(*column.data())}});
+    });
+    header.arrays = arrays.size();
+    uint64_t bytes = placeSharedArrays(arrays, sizeof(header));
+    auto write = [&](char *dst) {
+        memcpy(dst, &header, sizeof(header));
+        writeSharedArrays(dst, arrays, sizeof(header));
+    };
+
+    string path = sharedMemoryName(name);
+#ifdef __linux__
+    // Filled under a private name, then renamed over `path` in
+    // /dev/shm, where glibc keeps shm objects: attaching instances
+    // see the old dataset or the whole new one, and concurrent
+    // publishers each replace the object whole.
+    string temp = path + "." + to_string(getpid()) + ".tmp";
+    shm_unlink(temp.c_str()); // left by an earlier process with this pid
+    bool ok = writeSharedObject(temp, bytes, write);
+    if (ok && rename(("/dev/shm" + temp).c_str(), ("/dev/shm" + path).c_str()) != 0) {
+        cerr << "Error: Could not publish shared memory " << path << ": " << strerror(errno) << endl;
+        shm_unlink(temp.c_str());
+        ok = false;
+    }
+#else
+    // Shm objects cannot be renamed here, so publishers take turns
+    // on a lock file to replace the object. An instance attaching
+    // meanwhile finds no object, or one without its magic yet.
+    string lockPath = (fs::temp_directory_path() / ("yt-analyzer-" + path.substr(1) + ".lock")).string();
+    int lock = open(lockPath.c_str(), O_CREAT | O_RDWR, 0644);
+    bool ok = lock >= 0 && flock(lock, LOCK_EX) == 0;
+    if (!ok) {
+        cerr << "Error: Could not lock " << lockPath << ": " << strerror(errno) << endl;
+    } else {
+        shm_unlink(path.c_str()); // instances that mapped the old object keep it
+        ok = writeSharedObject(path, bytes, write);
+    }
+    if (lock >= 0) ::close(lock);
+#endif
+    descriptions.swap(index.descriptions);
+    return ok;
+#endif
+}
+
+// Whether CSR offsets ascend from 0 to `end`.
+template <typename T>
+bool ascendsTo(const Column<T> &offsets, uint64_t end) {
+    return !offsets.empty() && offsets[0] == 0 && offsets.back() == end && is_sorted(offsets.begin(), offsets.end());
+}
+
+template <typename T>
+bool allBelow(const Column<T> &values, uint64_t limit) {
+    return all_of(values.begin(), values.end(), [&](T v) { return static_cast<uint64_t>(v) < limit; });
+}
+
+bool validStrings(const StringColumn &strings) {
+    return strings.offsets.empty() ? strings.bytes.empty() : ascendsTo(strings.offsets, strings.bytes.size());
+}
+
+// Whether `ref` lies in `text`, adopted as arena 0.
+bool refFits(const TextRef &ref, const Column<char> &text) {
+    return ref.length == 0 || (ref.arena == 0 && ref.offset <= text.size() && ref.length <= text.size() - ref.offset);
+}
+
+// Throws runtime_error unless every array of an adopted index of
+// `rows` rows has the size its neighbours imply and every posting
+// and row id is below `rows`.
+void checkVideoIndex(const VideoIndex &index, size_t rows, const uint64_t rangeSlices[QCOL_COUNT]) {
+    auto check = [](bool ok, const char *what) {
+        if (!ok) throw runtime_error(what);
+    };
+    size_t rowWords = (rows + 63) / 64, tags = index.tagNames.size();
+    check(validStrings(index.tagNames) && index.postingOffsets.size() == tags + 1 &&
+              ascendsTo(index.postingOffsets, index.postings.size()) && allBelow(index.postings, rows) &&
+              index.impactPostings.size() == index.postings.size() && allBelow(index.impactPostings, rows),
+          "bad tag postings");
+    check(validStrings(index.countryNames) && index.country.size() == rows && allBelow(index.country, index.countryNames.size()),
+          "bad country column");
+    for (const auto &column : index.numeric) check(column.size() == rows, "bad numeric column");
+    for (const auto &bitmap : index.flagBitmaps) check(bitmap.size() == rowWords, "bad flag bitmap");
+    for (int c = 0; c < QCOL_COUNT; ++c) {
+        uint64_t slices = rangeSlices[c];
+        check(slices == UINT64_MAX ? index.ranges[c].words.empty() : slices <= 64 && index.ranges[c].words.size() == slices * rowWords,
+              "bad bit slices");
+    }
+    const TitleIndex &titles = index.titles;
+    size_t terms = titles.terms.size(), blocks = titles.blockLastRow.size();
+    check(validStrings(titles.terms) && titles.termOrder.size() == terms && allBelow(titles.termOrder, terms) &&
+              titles.termOffsets.size() == terms + 1 && ascendsTo(titles.termOffsets, titles.rows.size()) &&
+              allBelow(titles.rows, rows) && titles.counts.size() == titles.rows.size() && titles.termIdf.size() == terms &&
+              titles.termMaxBm25.size() == terms && titles.termMaxRatio.size() == terms && titles.blockOffsets.size() == terms + 1 &&
+              ascendsTo(titles.blockOffsets, blocks) && titles.blockMaxBm25.size() == blocks &&
+              titles.blockMaxRatio.size() == blocks && titles.lengthNorm.size() == rows,
+          "bad title index");
+    check(index.descriptions.size() == index.descriptionRows.size() && allBelow(index.descriptionRows, rows),
+          "bad description index");
+}
+
+// Throws runtime_error unless every array of an attached dataset
+// has the size its neighbours imply, every row, posting and text
+// reference stays inside the object and the country codes are
+// distinct. Runs before attaching changes any global state.
+void checkSharedDataset(const SharedDataset &dataset, const VideoIndex &index, const SharedHeader &header) {
+    auto check = [](bool ok, const char *what) {
+        if (!ok) throw runtime_error(what);
+    };
+    size_t rows = header.rows;
+    check(dataset.rows.size() == rows && rows <= UINT32_MAX, "row count does not match the rows");
+    check(dataset.symbols.size() == dataset.symbolLengths.size() && dataset.symbols.size() <= SymbolTable::MAX_SYMBOLS &&
+              all_of(dataset.symbolLengths.begin(), dataset.symbolLengths.end(), [](uint8_t n) { return n >= 1 && n <= 8; }),
+          "bad symbol table");
+    check(validStrings(dataset.countries) && dataset.countries.size() >= 1 && dataset.countries[0].empty() &&
+              dataset.countries.size() <= size_t(UINT16_MAX) + 1,
+          "bad country codes");
+    // Attaching interns ids 1.. in order, so every code must be new.
+    unordered_set<string_view> countryNames;
+    for (size_t id = 1; id < dataset.countries.size(); ++id)
+        check(!dataset.countries[id].empty() && countryNames.insert(dataset.countries[id]).second, "repeated country code");
+    check(!dataset.titles.empty() && all_of(dataset.titles.begin(), dataset.titles.end(),
+                                            [&](const TextRef &ref) { return refFits(ref, dataset.titleText); }),
+          "title outside the object");
+    for (const Video &v : dataset.rows) {
+        check(refFits(v.tags, dataset.tagCodes) && refFits(v.description, dataset.descriptionText), "row text outside the object");
+        check(v.title < dataset.titles.size() && v.country < dataset.countries.size(), "row id out of range");
+    }
+    checkVideoIndex(index, rows, header.rangeSlices);
+    check(all_of(index.descriptions.begin(), index.descriptions.end(),
+                 [&](const TextRef &ref) { return refFits(ref, dataset.descriptionText); }),
+          "bad description index");
+}
+
+// ------------------------------------------------------------
+// Attach to the shared dataset `name`: `videos` and `index` view
+// its mapping. Fails if the object is missing, damaged or from
+// another build, or if this instance already loaded text.
+// ------------------------------------------------------------
+bool attachSharedDataset(const string &name, VideoTable &videos, unique_ptr<VideoIndex> &index) {
+    TraceSpan span("attach");
+    auto mapped = make_shared<MappedFile>(sharedMemoryName(name), true);
+    const char *data = mapped->data();
+    size_t size = mapped->size();
+    if (!data) {
+        cerr << "Error: No shared dataset named " << name << endl;
+        return false;
+    }
+    SharedDataset dataset;
+    unique_ptr<VideoIndex> attached(new VideoIndex());
+    SharedHeader header;
+    try {
+        if (size < sizeof(header) || memcmp(data, SHARED_MAGIC, 4) != 0) throw runtime_error("not a shared dataset");
+        header = readRaw<SharedHeader>(data);
+        if (header.videoBytes != sizeof(Video)) throw runtime_error("published by a different build");
+        size_t arrays = 0;
+        forEachSharedArray(dataset, *attached, [&](auto &) { ++arrays; });
+        if (header.arrays != arrays || (size - sizeof(header)) / sizeof(SharedArray) < arrays) throw runtime_error("bad array directory");
+        size_t i = 0;
+        forEachSharedArray(dataset, *attached, [&](auto &column) {
+            SharedArray array = readRaw<SharedArray>(data + sizeof(header) + i * sizeof(SharedArray));
+            if (!adoptSharedArray(column, data, size, array, mapped)) throw runtime_error("array " + to_string(i) + " lies outside the object");
+            ++i;
+        });
+        checkSharedDataset(dataset, *attached, header);
+    } catch (const exception &e) {
+        cerr << "Error: Shared dataset " << name << " is damaged (" << e.what() << ")" << endl;
+        return false;
+    }
+
+    // Rows reference arena 0 and pool ids from 1, which only mean
+    // the same here while nothing else has been loaded. Arrays are
+    // read through `shared`, as non-const access would copy them.
+    const SharedDataset &shared = dataset;
+    bool loaded = tagArenas.count() == 0 && titleArenas.count() == 0 && descriptionArenas.count() == 0 &&
+                  titlePool.size() == 1 && countryCodes.size() == 1;
+    if (loaded) {
+        loaded = false;
+        call_once(stringSymbolsTrained, [&] {
+            stringSymbols.load(shared.symbols.data(), shared.symbolLengths.data(), static_cast<unsigned>(shared.symbols.size()));
+            loaded = true;
+        });
+    }
+    if (!loaded) {
+        cerr << "Error: Shared dataset " << name << " must be attached before anything else is loaded" << endl;
+        return false;
+    }
+    tagArenas.adopt(shared.tagCodes.data(), mapped);
+    titleArenas.adopt(shared.titleText.data(), mapped);
+    descriptionArenas.adopt(shared.descriptionText.data(), mapped);
+    titlePool.adopt(shared.titles.data(), static_cast<uint32_t>(shared.titles.size()), mapped);
+    for (size_t id = 1; id < shared.countries.size(); ++id) countryCodes.intern(string(shared.countries[id]));
+
+    setIndexShape(*attached, header.rows, header.rangeSlices);
+    videos = move(dataset.rows);
+    index = move(attached);
+    return true;
+}
+
+bool unshareDataset(const string &name) {
+#ifdef _WIN32
+    cerr << "Error: Shared-memory datasets are not supported on this platform (" << name << ")" << endl;
+    return false;
+#else
+    string path = sharedMemoryName(name);
+    if (shm_unlink(path.c_str()) != 0) {
+        cerr << "Error: Could not remove shared memory " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+#endif
+}
+
+// ------------------------------------------------------------
+// Query index in columnar files
+//
+// The index column of a .ytc file holds the arrays of the rows'
+// VideoIndex laid out as in a shared dataset: a header, a
+// SharedArray directory and the arrays, in forEachIndexColumn
+// order, with offsets from the start of the column. Loading the
+// file as the whole dataset adopts them from its mapping, so the
+// index is neither decoded nor rebuilt. Descriptions are the one
+// exception: their rows are stored in the order of the file's
+// description heap and their refs are taken from the loaded rows.
+// ------------------------------------------------------------
+struct IndexColumnHeader {
+    uint64_t rows;
+    uint64_t arrays;                  // SharedArray entries after the header
+    uint64_t rangeSlices[QCOL_COUNT]; // BitSlicedColumn::slices, UINT64_MAX if not indexed
+};
+
+// The index column for `videos` and their `index`. index.descriptions
+// and index.descriptionRows are swapped out while it is written.
+string encodeIndexColumn(const VideoTable &videos, VideoIndex &index) {
+    TraceSpan span("index_column");
+    MemoryScope scope(MEM_DICTIONARY);
+    // Description ids in first-use order, as encodeColumnar gives them.
+    unordered_map<string_view, uint32_t> heapIds;
+    for (const Video &v : videos)
+        if (v.description.length) heapIds.emplace(descriptionArenas.view(v.description), static_cast<uint32_t>(heapIds.size()));
+    const Column<uint32_t> &built = static_cast<const VideoIndex &>(index).descriptionRows;
+    vector<pair<uint32_t, uint32_t>> order; // (description id, row)
+    order.reserve(built.size());
+    for (uint32_t row : built) order.push_back({heapIds[descriptionArenas.view(videos[row].description)], row});
+    sort(order.begin(), order.end());
+    Column<uint32_t> descriptionRows(order.size());
+    for (size_t i = 0; i < order.size(); ++i) descriptionRows[i] = order[i].second;
+    Column<TextRef> descriptions;
+
+    IndexColumnHeader header = {};
+    header.rows = videos.size();
+    for (int c = 0; c < QCOL_COUNT; ++c) header.rangeSlices[c] = index.ranges[c].indexed ? index.ranges[c].slices : UINT64_MAX;
+    descriptionRows.swap(index.descriptionRows);
+    descriptions.swap(index.descriptions);
+    SharedArrays arrays;
+    forEachIndexColumn(index, [&](const auto &column) {
+        arrays.push_back({column.data(), SharedArray{0, column.size(), sizeof(*column.data())}});
+    });
+    header.arrays = arrays.size();
+    string image(placeSharedArrays(arrays, sizeof(header)), '\0');
+    memcpy(&image[0], &header, sizeof(header));
+    writeSharedArrays(&image[0], arrays, sizeof(header));
+    descriptionRows.swap(index.descriptionRows);
+    descriptions.swap(index.descriptions);
+    return image;
+}
+
+// ------------------------------------------------------------
+// Adopt the query index of the columnar file `filename` for
+// `videos`, the rows loaded from it. Every array views the file's
+// mapping in place. Returns false, leaving `index` alone, if the
+// file has no index or it is damaged or does not fit the rows.
+// ------------------------------------------------------------
+bool loadIndexColumn(const string &filename, const VideoTable &videos, unique_ptr<VideoIndex> &index) {
+    TraceSpan span("index_adopt");
+    ColumnarFile file(filename);
+    string_view column = file.queryIndex();
+    if (!file.isValid() || column.empty()) return false;
+    unique_ptr<VideoIndex> adopted(new VideoIndex());
+    IndexColumnHeader header;
+    try {
+        if (column.size() < sizeof(header)) throw runtime_error("truncated header");
+        header = readRaw<IndexColumnHeader>(column.data());
+        if (header.rows != videos.size() || file.rows() != videos.size()) throw runtime_error("row count does not match the rows");
+        size_t arrays = 0;
+        forEachIndexColumn(*adopted, [&](auto &) { ++arrays; });
+        if (header.arrays != arrays || (column.size() - sizeof(header)) / sizeof(SharedArray) < arrays)
+            throw runtime_error("bad array directory");
+        size_t i = 0;
+        forEachIndexColumn(*adopted, [&](auto &array) {
+            SharedArray entry = readRaw<SharedArray>(column.data() + sizeof(header) + i * sizeof(SharedArray));
+            if (!adoptSharedArray(array, column.data(), column.size(), entry, file.mapping()))
+                throw runtime_error("array " + to_string(i) + " lies outside the column");
+            ++i;
+        });
+        // Read through `rows`, as non-const access would copy the array.
+        const Column<uint32_t> &rows = static_cast<const VideoIndex &>(*adopted).descriptionRows;
+        if (!adopted->descriptions.empty()) throw runtime_error("bad description index");
+        Column<TextRef> descriptions(rows.size());
+        for (size_t d = 0; d < rows.size(); ++d) {
+            if (rows[d] >= videos.size() || !videos[rows[d]].description.length) throw runtime_error("bad description index");
+            descriptions[d] = videos[rows[d]].description;
+        }
+        adopted->descriptions.swap(descriptions);
+        checkVideoIndex(*adopted, header.rows, header.rangeSlices);
+    } catch (const exception &e) {
+        cerr << "Error: " << filename << ": damaged query index (" << e.what() << ")" << endl;
+        return false;
+    }
+    setIndexShape(*adopted, header.rows, header.rangeSlices);
+    index = move(adopted);
+    return true;
+}
+
+// ------------------------------------------------------------
+// Ranking scores as expression templates
+//
+// A score such as (likes - dislikes) / views is written with
+// ordinary operators over column placeholders (score::likes,
+// ...). The operators build a type that mirrors the expression
+// tree, so the whole formula is visible at the top-K call site
+// and is inlined into the ranking loop with no per-row dispatch.
+// Division by zero scores 0, as ratio does for unviewed videos.
+// ------------------------------------------------------------
+const size_t QUERY_BATCH_ROWS = 1024;
+
+enum ScoreOp { SCORE_ADD, SCORE_SUB, SCORE_MUL, SCORE_DIV };
+const char *const SCORE_OP_SYMBOLS[] = {"+", "-", "*", "/"};
+const int SCORE_ATOM_PRECEDENCE = 3;
+
+int scoreOpPrecedence(ScoreOp op) { return op == SCORE_ADD || op == SCORE_SUB ? 1 : 2; }
+
+double applyScoreOp(ScoreOp op, double a, double b) {
+    switch (op) {
+        case SCORE_ADD:
+            return a + b;
+        case SCORE_SUB:
+            return a - b;
+        case SCORE_MUL:
+            return a * b;
+        default:
+            return b == 0.0 ? 0.0 : a / b;
+    }
+}
+
+// Formula text with only the parentheses precedence needs; the
+// compiled and interpreted forms print identically, which is how
+// a query's "order by" finds its compiled score.
+string scoreConstantText(double value) {
+    ostringstream out;
+    out.precision(15);
+    out << value;
+    return out.str();
+}
+
+string scoreBinaryText(ScoreOp op, const string &left, int leftPrecedence, const string &right, int rightPrecedence) {
+    int p = scoreOpPrecedence(op);
+    return (leftPrecedence < p ? "(" + left + ")" : left) + " " + SCORE_OP_SYMBOLS[op] + " " +
+           (rightPrecedence <= p ? "(" + right + ")" : right);
+}
+
+string scoreNegateText(const string &operand, int precedence) {
+    return "-" + (precedence < SCORE_ATOM_PRECEDENCE ? "(" + operand + ")" : operand);
+}
+
+namespace score {
+
+template <typename E>
+struct Expr {
+    const E &self() const { return static_cast<const E &>(*this); }
+};
+
+template <QueryColumn C>
+struct ColumnTerm : Expr<ColumnTerm<C>> {
+    static const int precedence = SCORE_ATOM_PRECEDENCE;
+    double eval(const double *const *columns, uint32_t row) const { return columns[C][row]; }
+    string describe() const { return QUERY_COLUMN_NAMES[C]; }
+};
+
+struct ConstantTerm : Expr<ConstantTerm> {
+    static const int precedence = SCORE_ATOM_PRECEDENCE;
+    explicit ConstantTerm(double value) : value(value) {}
+    double eval(const double *const *, uint32_t) const { return value; }
+    string describe() const { return scoreConstantText(value); }
+    double value;
+};
+
+template <ScoreOp Op, typename L, typename R>
+struct BinaryTerm : Expr<BinaryTerm<Op, L, R>> {
+    static const int precedence = Op == SCORE_ADD || Op == SCORE_SUB ? 1 : 2;
+    BinaryTerm(const L &left, const R &right) : left(left), right(right) {}
+    double eval(const double *const *columns, uint32_t row) const {
+        return applyScoreOp(Op, left.eval(columns, row), right.eval(columns, row));
+    }
+    string describe() const { return scoreBinaryText(Op, left.describe(), L::precedence, right.describe(), R::precedence); }
+    L left;
+    R right;
+};
+
+template <typename E>
+struct NegateTerm : Expr<NegateTerm<E>> {
+    static const int precedence = SCORE_ATOM_PRECEDENCE;
+    explicit NegateTerm(const E &operand) : operand(operand) {}
+    double eval(const double *const *columns, uint32_t row) const { return -operand.eval(columns, row); }
+    string describe() const { return scoreNegateText(operand.describe(), E::precedence); }
+    E operand;
+};
+
+// Operands are expressions or plain numbers; at least one side must be an expression.
+template <typename E>
+const E &term(const Expr<E> &e) { return e.self(); }
+inline ConstantTerm term(double value) { return ConstantTerm(value); }
+
+template <typename T>
+using TermOf = typename decay<decltype(term(declval<const T &>()))>::type;
+
+template <ScoreOp Op, typename L, typename R>
+using BinaryOf = typename enable_if<is_base_of<Expr<L>, L>::value || is_base_of<Expr<R>, R>::value,
+                                    BinaryTerm<Op, TermOf<L>, TermOf<R>>>::type;
+
+template <typename L, typename R>
+BinaryOf<SCORE_ADD, L, R> operator+(const L &l, const R &r) { return {term(l), term(r)}; }
+template <typename L, typename R>
+BinaryOf<SCORE_SUB, L, R> operator-(const L &l, const R &r) { return {term(l), term(r)}; }
+template <typename L, typename R>
+BinaryOf<SCORE_MUL, L, R> operator*(const L &l, const R &r) { return {term(l), term(r)}; }
+template <typename L, typename R>
+BinaryOf<SCORE_DIV, L, R> operator/(const L &l, const R &r) { return {term(l), term(r)}; }
+template <typename E>
+NegateTerm<E> operator-(const Expr<E> &e) { return NegateTerm<E>(e.self()); }
+
+const ColumnTerm<QCOL_VIEWS> views{};
+const ColumnTerm<QCOL_LIKES> likes{};
+const ColumnTerm<QCOL_DISLIKES> dislikes{};
+const ColumnTerm<QCOL_COMMENTS> comments{};
+const ColumnTerm<QCOL_RATIO> ratio{};
+const ColumnTerm<QCOL_HOURS_TO_TREND> hoursToTrend{};
+
+// Built-in scores, usable by name in "order by".
+const auto engagement = (likes - dislikes) / views;
+const auto discussion = comments / views;
+const auto approval = likes / (likes + dislikes);
+
+} // namespace score
+
+// ------------------------------------------------------------
+// Interpreted scores
+//
+// The query language accepts any arithmetic over the columns.
+// Formulas without a compiled equivalent run as a postfix
+// program that is interpreted one instruction at a time over a
+// whole batch of rows, so dispatch is paid per batch, not per
+// row.
+// ------------------------------------------------------------
+struct ScoreProgram {
+    enum OpCode : uint8_t { LOAD_COLUMN, LOAD_CONSTANT, BINARY, NEGATE };
+    struct Instruction {
+        OpCode code;
+        QueryColumn column;
+        ScoreOp op;
+        double constant;
+    };
+
+    vector<Instruction> program;
+    string text;
+    int precedence = SCORE_ATOM_PRECEDENCE;
+    size_t depth = 0; // stack slots needed
+
+    static ScoreProgram column(QueryColumn c) {
+        ScoreProgram p;
+        p.program.push_back({LOAD_COLUMN, c, SCORE_ADD, 0.0});
+        p.text = QUERY_COLUMN_NAMES[c];
+        p.depth = 1;
+        return p;
+    }
+
+    static ScoreProgram constant(double value) {
+        ScoreProgram p;
+        p.program.push_back({LOAD_CONSTANT, QCOL_VIEWS, SCORE_ADD, value});
+        p.text = scoreConstantText(value);
+        p.depth = 1;
+        return p;
+    }
+
+    static ScoreProgram binary(ScoreOp op, const ScoreProgram &left, const ScoreProgram &right) {
+        ScoreProgram p = left;
+        p.program.insert(p.program.end(), right.program.begin(), right.program.end());
+        p.program.push_back({BINARY, QCOL_VIEWS, op, 0.0});
+        p.text = scoreBinaryText(op, left.text, left.precedence, right.text, right.precedence);
+        p.precedence = scoreOpPrecedence(op);
+        p.depth = max(left.depth, right.depth + 1);
+        return p;
+    }
+
+    static ScoreProgram negate(const ScoreProgram &operand) {
+        ScoreProgram p = operand;
+        p.program.push_back({NEGATE, QCOL_VIEWS, SCORE_ADD, 0.0});
+        p.text = scoreNegateText(operand.text, operand.precedence);
+        p.precedence = SCORE_ATOM_PRECEDENCE;
+        return p;
+    }
+
+    bool isColumn() const { return program.size() == 1 && program[0].code == LOAD_COLUMN; }
+
+    // Scores rows[0..n) into out; n must not exceed QUERY_BATCH_ROWS.
+    // `stack` holds depth * QUERY_BATCH_ROWS values.
+    void evaluate(const double *const *columns, const uint32_t *rows, size_t n, double *stack, double *out) const {
+        size_t top = 0;
+        for (const auto &ins : program) {
+            double *slot = stack + top * QUERY_BATCH_ROWS;
+            switch (ins.code) {
+                case LOAD_COLUMN: {
+                    const double *column = columns[ins.column];
+                    for (size_t i = 0; i < n; ++i) slot[i] = column[rows[i]];
+                    ++top;
+                    break;
+                }
+                case LOAD_CONSTANT:
+                    fill(slot, slot + n, ins.constant);
+                    ++top;
+                    break;
+                case BINARY: {
+                    double *a = slot - 2 * QUERY_BATCH_ROWS, *b = slot - QUERY_BATCH_ROWS;
+                    switch (ins.op) {
+                        case SCORE_ADD:
+                            for (size_t i = 0; i < n; ++i) a[i] += b[i];
+                            break;
+                        case SCORE_SUB:
+                            for (size_t i = 0; i < n; ++i) a[i] -= b[i];
+                            break;
+                        case SCORE_MUL:
+                            for (size_t i = 0; i < n; ++i) a[i] *= b[i];
+                            break;
+                        default:
+                            for (size_t i = 0; i < n; ++i) a[i] = b[i] == 0.0 ? 0.0 : a[i] / b[i];
+                    }
+                    --top;
+                    break;
+                }
+                case NEGATE: {
+                    double *a = slot - QUERY_BATCH_ROWS;
+                    for (size_t i = 0; i < n; ++i) a[i] = -a[i];
+                    break;
+                }
+            }
+        }
+        copy(stack, stack + n, out);
+    }
+};
+
+// ------------------------------------------------------------
+// Top-K ranking
+//
+// `score(i, row)` scores the i-th selected row. A bounded heap
+// keeps the best k; results come back best first as
+// (score, row) pairs, equal scores in table order.
+// ------------------------------------------------------------
+using RankedRows = vector<pair<double, uint32_t>>;
+
+template <typename Score>
+RankedRows topKRows(const vector<uint32_t> &rows, size_t k, bool descending, Score score) {
+    // Ordered best first, so the heap's top is the worst entry kept so far.
+    auto better = [descending](const pair<double, uint32_t> &a, const pair<double, uint32_t> &b) {
+        if (a.first != b.first) return descending ? a.first > b.first : a.first < b.first;
+        return a.second < b.second;
+    };
+    priority_queue<pair<double, uint32_t>, vector<pair<double, uint32_t>>, decltype(better)> heap(better);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        pair<double, uint32_t> entry(score(i, rows[i]), rows[i]);
+        if (heap.size() < k) {
+            heap.push(entry);
+        } else if (better(entry, heap.top())) {
+            heap.pop();
+            heap.push(entry);
+        }
+    }
+    RankedRows ranked;
+    for (; !heap.empty(); heap.pop()) ranked.push_back(heap.top());
+    reverse(ranked.begin(), ranked.end());
+    return ranked;
+}
+
+struct ColumnPointers {
+    explicit ColumnPointers(const VideoIndex &index) {
+        for (int c = 0; c < QCOL_COUNT; ++c) columns[c] = index.numeric[c].data();
+    }
+    const double *columns[QCOL_COUNT];
+};
+
+struct CompiledScore {
+    const char *name;
+    string formula;
+    function<RankedRows(const VideoIndex &, const vector<uint32_t> &, size_t, bool)> topK;
+    function<void(const VideoIndex &, const uint32_t *, size_t, double *)> evaluate; // scores n rows into out
+};
+
+template <typename E>
+CompiledScore compileScore(const char *name, const score::Expr<E> &expr) {
+    E e = expr.self();
+    return {name, e.describe(), [e](const VideoIndex &index, const vector<uint32_t> &rows, size_t k, bool descending) {
+                ColumnPointers in(index);
+                return topKRows(rows, k, descending, [&](size_t, uint32_t row) { return e.eval(in.columns, row); });
+            },
+            [e](const VideoIndex &index, const uint32_t *rows, size_t n, double *out) {
+                ColumnPointers in(index);
+                for (size_t i = 0; i < n; ++i) out[i] = e.eval(in.columns, rows[i]);
+            }};
+}
+
+const vector<CompiledScore> &compiledScores() {
+    static const vector<CompiledScore> scores = {compileScore("engagement", score::engagement),
+                                                 compileScore("discussion", score::discussion),
+                                                 compileScore("approval", score::approval)};
+    return scores;
+}
+
+const CompiledScore *findCompiledScore(const ScoreProgram &program) {
+    for (const auto &s : compiledScores())
+        if (s.formula == program.text) return &s;
+    return nullptr;
+}
+
+// Scores of `rows`, in order.
+vector<double> scoreRows(const VideoIndex &index, const ScoreProgram &order, const vector<uint32_t> &rows) {
+    vector<double> scores(rows.size());
+    if (const CompiledScore *compiled = findCompiledScore(order)) {
+        compiled->evaluate(index, rows.data(), rows.size(), scores.data());
+        return scores;
+    }
+    ColumnPointers in(index);
+    vector<double> stack(order.depth * QUERY_BATCH_ROWS);
+    for (size_t begin = 0; begin < rows.size(); begin += QUERY_BATCH_ROWS)
+        order.evaluate(in.columns, rows.data() + begin, min(QUERY_BATCH_ROWS, rows.size() - begin), stack.data(),
+                       scores.data() + begin);
+    return scores;
+}
+
+RankedRows rankRows(const VideoIndex &index, const vector<uint32_t> &rows, const ScoreProgram &order, size_t k,
+                    bool descending) {
+    if (order.isColumn()) {
+        const double *column = index.numeric[order.program[0].column].data();
+        return topKRows(rows, k, descending, [&](size_t, uint32_t row) { return column[row]; });
+    }
+    if (const CompiledScore *compiled = findCompiledScore(order)) return compiled->topK(index, rows, k, descending);
+
+    vector<double> scores = scoreRows(index, order, rows);
+    return topKRows(rows, k, descending, [&](size_t i, uint32_t) { return scores[i]; });
+}
+
+// ------------------------------------------------------------
+// Full ordering with a parallel LSD radix sort
+//
+// Scores map to unsigned keys whose integer order is the score
+// order (sign bit set for positives, all bits flipped for
+// negatives, inverted once more for descending). (key, row)
+// pairs are then sorted a byte at a time from the lowest: each
+// pass counts digits per slice in parallel, turns the counts
+// into per-slice output positions and scatters every slice in
+// order, so the sort is stable and equal scores stay in table
+// order. Passes over a byte all keys share are skipped.
+// ------------------------------------------------------------
+const size_t RADIX_PARALLEL_MIN_ROWS = 1 << 16;
+
+uint64_t orderedKey(double value, bool descending) {
+    if (value == 0.0) value = 0.0; // -0 sorts with +0
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = (bits >> 63) ? ~bits : bits | (1ULL << 63);
+    return descending ? ~bits : bits;
+}
+
+struct SortEntry {
+    uint64_t key;
+    uint32_t row;
+};
+
+void radixSort(vector<SortEntry> &entries) {
+    struct SliceCounts {
+        size_t begin = 0, end = 0;
+        size_t counts[256] = {}; // becomes the next output position per digit
+    };
+    size_t n = entries.size();
+    bool parallel = n >= RADIX_PARALLEL_MIN_ROWS;
+    vector<SortEntry> scratch(n);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        auto count = [&](size_t begin, size_t end) {
+            SliceCounts slice;
+            slice.begin = begin;
+            slice.end = end;
+            for (size_t i = begin; i < end; ++i) ++slice.counts[(entries[i].key >> shift) & 0xff];
+            return slice;
+        };
+        vector<SliceCounts> slices = parallel ? forEachNodeSlice<SliceCounts>(n, count) : vector<SliceCounts>{count(0, n)};
+
+        bool shared = false;
+        size_t position = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            size_t total = 0;
+            for (auto &slice : slices) {
+                size_t c = slice.counts[digit];
+                slice.counts[digit] = position;
+                position += c;
+                total += c;
+            }
+            shared = shared || total == n;
+        }
+        if (shared) continue;
+
+        auto scatter = [&](size_t begin, size_t end) {
+            SliceCounts &slice = *find_if(slices.begin(), slices.end(),
+                                          [&](const SliceCounts &s) { return s.begin == begin && s.end == end; });
+            for (size_t i = begin; i < end; ++i) scratch[slice.counts[(entries[i].key >> shift) & 0xff]++] = entries[i];
+            return true;
+        };
+        if (parallel) forEachNodeSlice<bool>(n, scatter);
+        else scatter(0, n);
+        entries.swap(scratch);
+    }
+}
+
+vector<uint32_t> sortRows(const VideoIndex &index, const vector<uint32_t> &rows, const ScoreProgram &order,
+                          bool descending) {
+    TraceSpan span("sort");
+    vector<double> scores = scoreRows(index, order, rows);
+    vector<SortEntry> entries(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) entries[i] = {orderedKey(scores[i], descending), rows[i]};
+    radixSort(entries);
+    vector<uint32_t> sorted(rows.size());
+    for (size_t i = 0; i < entries.size(); ++i) sorted[i] = entries[i].row;
+    return sorted;
+}
+
+// ------------------------------------------------------------
+// Sorted selections of recent queries, keyed by everything but
+// offset and limit, so paging through a result is a slice of
+// the cached permutation after the first sort.
+// ------------------------------------------------------------
+const size_t ORDER_CACHE_ENTRIES = 8;
+
+class OrderCache {
+public:
+    struct Entry {
+        string key;
+        vector<uint32_t> rows;
+        size_t candidates;
+    };
+
+    const Entry *find(const string &key) {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].key != key) continue;
+            rotate(entries.begin(), entries.begin() + i, entries.begin() + i + 1);
+            return &entries.front();
+        }
+        return nullptr;
+    }
+
+    const Entry &insert(Entry entry) {
+        if (entries.size() == ORDER_CACHE_ENTRIES) entries.pop_back();
+        entries.push_front(move(entry));
+        return entries.front();
+    }
+
+private:
+    deque<Entry> entries; // most recently used first
+};
+
+// ------------------------------------------------------------
+// Query language
+//
+//   tags:music,gaming views>1000000 country=US,GB
+//   order by ratio desc limit 50
+//   tags:music likes>=1000 avg ratio by tag
+//
+// Clauses may appear in any order:
+//   tags:a,b            rows with a tag containing a or b
+//   title:"a b"         rows whose title has the word a or b
+//                       (case-insensitive, whole words)
+//   country=US,GB       rows from these datasets
+//   <column> <op> <n>   column is views, likes, dislikes,
+//                       comments or ratio; op is >, >=, <,
+//                       <= or =
+//   order by <score> [asc|desc]
+//                       score is a column, a built-in score
+//                       (engagement, discussion, approval) or
+//                       arithmetic over columns, e.g.
+//                       (likes - dislikes) / views;
+//                       or "relevance" (BM25) with title:
+//   limit <n> | all     rows to show (default 10)
+//   offset <n>          rows to skip first, for paging
+//   avg <column> [by tag]
+//   into <file>         write the results to a file instead,
+//                       as CSV or JSON for .csv / .json names
+// Values with spaces can be double-quoted.
+// ------------------------------------------------------------
+enum CompareOp { OP_GT, OP_GE, OP_LT, OP_LE, OP_EQ };
+const char *const COMPARE_OP_NAMES[] = {">", ">=", "<", "<=", "="};
+
+struct Predicate {
+    QueryColumn column;
+    CompareOp op;
+    double value;
+};
+
+struct Query {
+    vector<string> tags;
+    vector<string> titleTerms;
+    vector<string> descriptions; // substrings, any of which must occur
+    vector<string> countries;
+    vector<Predicate> filters;
+    uint8_t flagsSet = 0, flagsClear = 0; // VideoFlag bits required true / false
+    bool ordered = false;
+    bool orderByRelevance = false; // BM25 over titleTerms
+    ScoreProgram order = ScoreProgram::column(QCOL_RATIO);
+    bool descending = true;
+    size_t limit = 10; // SIZE_MAX for "limit all"
+    size_t offset = 0;
+    bool aggregate = false;
+    QueryColumn aggregateColumn = QCOL_RATIO;
+    bool aggregateByTag = false;
+    string outputPath; // "into": write the results to this file
+};
+
+const Column<double> &queryColumn(const VideoIndex &index, QueryColumn column) { return index.numeric[column]; }
+
+class QueryParser {
+public:
+    explicit QueryParser(const string &text) { tokenize(text); }
+
+    Query parse() {
+        Query q;
+        while (pos < tokens.size()) {
+            string word = lower(expectValue("a clause"));
+            if (word == "tags" || word == "tag") {
+                expectSymbol(":", "=");
+                q.tags = parseList();
+            } else if (word == "title") {
+                expectSymbol(":", "=");
+                for (const auto &value : parseList())
+                    for (auto &term : tokenizeTitle(value))
+                        if (find(q.titleTerms.begin(), q.titleTerms.end(), term) == q.titleTerms.end())
+                            q.titleTerms.push_back(move(term));
+                if (q.titleTerms.empty()) throw runtime_error("title: needs at least one word");
+            } else if (word == "description") {
+                expectSymbol(":", "=");
+                for (auto &text : parseList()) {
+                    if (text.empty()) throw runtime_error("description: values must not be empty");
+                    q.descriptions.push_back(move(text));
+                }
+            } else if (word == "country") {
+                expectSymbol(":", "=");
+                for (auto &c : parseList()) {
+                    transform(c.begin(), c.end(), c.begin(), ::toupper);
+                    q.countries.push_back(c);
+                }
+            } else if (isFlag(word)) {
+                uint8_t bit = static_cast<uint8_t>(1 << flagOf(word));
+                expectSymbol("=", ":");
+                string value = lower(expectValue("true or false"));
+                if (value != "true" && value != "false") throw runtime_error(word + " must be true or false");
+                q.flagsSet = value == "true" ? (q.flagsSet | bit) : (q.flagsSet & ~bit);
+                q.flagsClear = value == "false" ? (q.flagsClear | bit) : (q.flagsClear & ~bit);
+            } else if (isColumn(word)) {
+                Predicate p{columnOf(word), parseOp(), parseNumber()};
+                q.filters.push_back(p);
+            } else if (word == "order") {
+                if (lower(expectValue("'by'")) != "by") throw runtime_error("expected 'by' after 'order'");
+                q.ordered = true;
+                if (pos < tokens.size() && !tokens[pos].symbol && lower(tokens[pos].text) == "relevance") {
+                    ++pos;
+                    q.orderByRelevance = true;
+                    q.order = ScoreProgram::column(QCOL_RATIO); // not used
+                } else {
+                    q.orderByRelevance = false;
+                    q.order = parseScore();
+                }
+                if (pos < tokens.size() && (lower(tokens[pos].text) == "asc" || lower(tokens[pos].text) == "desc"))
+                    q.descending = lower(tokens[pos++].text) == "desc";
+            } else if (word == "limit") {
+                if (pos < tokens.size() && !tokens[pos].symbol && lower(tokens[pos].text) == "all") {
+                    ++pos;
+                    q.limit = SIZE_MAX;
+                    continue;
+                }
+                double n = parseNumber();
+                if (n < 1 || n != static_cast<double>(static_cast<size_t>(n))) throw runtime_error("limit must be a positive integer");
+                q.limit = static_cast<size_t>(n);
+            } else if (word == "offset") {
+                double n = parseNumber();
+                if (n < 0 || n != static_cast<double>(static_cast<size_t>(n))) throw runtime_error("offset must be a non-negative integer");
+                q.offset = static_cast<size_t>(n);
+            } else if (word == "into") {
+                q.outputPath = parsePath();
+            } else if (word == "avg") {
+                q.aggregate = true;
+                q.aggregateColumn = parseColumn();
+                if (pos < tokens.size() && lower(tokens[pos].text) == "by" && !tokens[pos].symbol) {
+                    ++pos;
+                    if (lower(expectValue("'tag'")) != "tag") throw runtime_error("only 'avg ... by tag' is supported");
+                    q.aggregateByTag = true;
+                }
+            } else {
+                throw runtime_error("unexpected '" + word + "'");
+            }
+        }
+        if (q.aggregateByTag && q.tags.empty()) throw runtime_error("'avg ... by tag' needs a tags: clause");
+        if (q.orderByRelevance && q.titleTerms.empty()) throw runtime_error("'order by relevance' needs a title: clause");
+        if (q.orderByRelevance && !q.descending) throw runtime_error("relevance can only be ordered desc");
+        return q;
+    }
+
+    // A whole input that is just a score formula.
+    ScoreProgram parseFormula() {
+        ScoreProgram program = parseScore();
+        if (pos < tokens.size()) throw runtime_error("unexpected '" + tokens[pos].text + "'");
+        return program;
+    }
+
+private:
+    struct Token {
+        string text;
+        bool symbol;
+        bool glued; // no whitespace before it
+    };
+    vector<Token> tokens;
+    size_t pos = 0;
+
+    static bool isArithmetic(const string &symbol) { return symbol.size() == 1 && string("()+-*/").find(symbol[0]) != string::npos; }
+
+    void tokenize(const string &text) {
+        bool glued = false;
+        for (size_t i = 0; i < text.size();) {
+            char c = text[i];
+            if (isspace(static_cast<unsigned char>(c))) {
+                ++i;
+                glued = false;
+                continue;
+            }
+            if (c == '"') {
+                size_t end = text.find('"', i + 1);
+                if (end == string::npos) throw runtime_error("unterminated quote");
+                tokens.push_back({text.substr(i + 1, end - i - 1), false, glued});
+                i = end + 1;
+            } else if (string(",:=()+-*/").find(c) != string::npos) {
+                tokens.push_back({string(1, c), true, glued});
+                ++i;
+            } else if (c == '<' || c == '>') {
+                bool orEqual = i + 1 < text.size() && text[i + 1] == '=';
+                tokens.push_back({text.substr(i, orEqual ? 2 : 1), true, glued});
+                i += orEqual ? 2 : 1;
+            } else {
+                size_t end = i;
+                while (end < text.size() && !isspace(static_cast<unsigned char>(text[end])) &&
+                       string(",:=<>\"()+-*/").find(text[end]) == string::npos)
+                    ++end;
+                tokens.push_back({text.substr(i, end - i), false, glued});
+                i = end;
+            }
+            glued = true;
+        }
+    }
+
+    static string lower(string s) {
+        transform(s.begin(), s.end(), s.begin(), ::tolower);
+        return s;
+    }
+
+    static bool isColumn(const string &word) {
+        return find(begin(QUERY_COLUMN_NAMES), end(QUERY_COLUMN_NAMES), word) != end(QUERY_COLUMN_NAMES);
+    }
+
+    static bool isFlag(const string &word) {
+        return find(begin(VIDEO_FLAG_NAMES), end(VIDEO_FLAG_NAMES), word) != end(VIDEO_FLAG_NAMES);
+    }
+
+    static int flagOf(const string &word) {
+        return static_cast<int>(find(begin(VIDEO_FLAG_NAMES), end(VIDEO_FLAG_NAMES), word) - begin(VIDEO_FLAG_NAMES));
+    }
+
+    static QueryColumn columnOf(const string &word) {
+        return static_cast<QueryColumn>(find(begin(QUERY_COLUMN_NAMES), end(QUERY_COLUMN_NAMES), word) -
+                                        begin(QUERY_COLUMN_NAMES));
+    }
+
+    string expectValue(const string &what) {
+        if (pos >= tokens.size() || tokens[pos].symbol)
+            throw runtime_error("expected " + what + (pos < tokens.size() ? " before '" + tokens[pos].text + "'" : " at end"));
+        return tokens[pos++].text;
+    }
+
+    void expectSymbol(const string &a, const string &b) {
+        if (pos >= tokens.size() || !tokens[pos].symbol || (tokens[pos].text != a && tokens[pos].text != b))
+            throw runtime_error("expected '" + a + "'");
+        ++pos;
+    }
+
+    // A list value or number: arithmetic characters written without
+    // spaces stay part of it, as in hip-hop or 1e-6.
+    string expectWord(const string &what) {
+        string word;
+        if (pos < tokens.size() && tokens[pos].symbol && tokens[pos].text == "-") word = tokens[pos++].text;
+        word += expectValue(what);
+        while (pos < tokens.size() && tokens[pos].glued && (!tokens[pos].symbol || isArithmetic(tokens[pos].text)))
+            word += tokens[pos++].text;
+        return word;
+    }
+
+    // A file name: every token up to the next space, so paths keep
+    // their '/', ':' and '-'.
+    string parsePath() {
+        if (pos >= tokens.size()) throw runtime_error("expected a file name at end");
+        string path = tokens[pos++].text;
+        while (pos < tokens.size() && tokens[pos].glued) path += tokens[pos++].text;
+        return path;
+    }
+
+    vector<string> parseList() {
+        vector<string> values = {expectWord("a value")};
+        while (pos < tokens.size() && tokens[pos].symbol && tokens[pos].text == ",") {
+            ++pos;
+            values.push_back(expectWord("a value after ','"));
+        }
+        return values;
+    }
+
+    QueryColumn parseColumn() {
+        string word = lower(expectValue("a column"));
+        if (!isColumn(word)) throw runtime_error("unknown column '" + word + "' (use views, likes, dislikes, comments, ratio or hours_to_trend)");
+        return columnOf(word);
+    }
+
+    bool nextIsSymbol(const char *symbol) const {
+        return pos < tokens.size() && tokens[pos].symbol && tokens[pos].text == symbol;
+    }
+
+    // score := term (('+' | '-') term)*
+    // term := factor (('*' | '/') factor)*
+    // factor := number | column | built-in score | '(' score ')' | '-' factor
+    ScoreProgram parseScore() {
+        ScoreProgram left = parseTerm();
+        while (nextIsSymbol("+") || nextIsSymbol("-")) {
+            ScoreOp op = tokens[pos++].text == "+" ? SCORE_ADD : SCORE_SUB;
+            left = ScoreProgram::binary(op, left, parseTerm());
+        }
+        return left;
+    }
+
+    ScoreProgram parseTerm() {
+        ScoreProgram left = parseFactor();
+        while (nextIsSymbol("*") || nextIsSymbol("/")) {
+            ScoreOp op = tokens[pos++].text == "*" ? SCORE_MUL : SCORE_DIV;
+            left = ScoreProgram::binary(op, left, parseFactor());
+        }
+        return left;
+    }
+
+    ScoreProgram parseFactor() {
+        if (nextIsSymbol("-")) {
+            ++pos;
+            return ScoreProgram::negate(parseFactor());
+        }
+        if (nextIsSymbol("(")) {
+            ++pos;
+            ScoreProgram inner = parseScore();
+            if (!nextIsSymbol(")")) throw runtime_error("expected ')'");
+            ++pos;
+            return inner;
+        }
+        string word = lower(expectValue("a score"));
+        if (isColumn(word)) return ScoreProgram::column(columnOf(word));
+        for (const auto &s : compiledScores())
+            if (word == s.name) return QueryParser(s.formula).parseFormula();
+        try {
+            size_t used = 0;
+            double value = stod(word, &used);
+            if (used == word.size()) return ScoreProgram::constant(value);
+        } catch (...) {
+        }
+        throw runtime_error("unknown score '" + word + "' (use a column, engagement, discussion or approval)");
+    }
+
+    CompareOp parseOp() {
+        if (pos >= tokens.size() || !tokens[pos].symbol) throw runtime_error("expected a comparison");
+        const string &op = tokens[pos++].text;
+        for (int i = 0; i <= OP_EQ; ++i)
+            if (op == COMPARE_OP_NAMES[i]) return static_cast<CompareOp>(i);
+        throw runtime_error("unexpected '" + op + "'");
+    }
+
+    double parseNumber() {
+        string text = expectWord("a number");
+        try {
+            size_t used = 0;
+            double value = stod(text, &used);
+            if (used == text.size()) return value;
+        } catch (...) {
+        }
+        throw runtime_error("'" + text + "' is not a number");
+    }
+};
+
+Query parseQuery(const string &text) { return QueryParser(text).parse(); }
+
+// How an ordered query gets its rows.
+enum OrderStrategy { ORDER_TOPK, ORDER_SORT, ORDER_CACHED, ORDER_IMPACT, ORDER_TITLE_RATIO, ORDER_WAND };
+
+// Bounded-heap top-K is used while offset + limit stays below
+// this; deeper pages sort the selection once and cache it.
+const size_t TOPK_MAX_ROWS = 1000;
+
+// Lookup and filter stages, as shown to the user. `bitmaps` is the
+// index when the selection is built from bitmaps (selectRows), or
+// nullptr when the filters are applied row by row.
+string describeSelection(const Query &q, const VideoIndex *bitmaps) {
+    auto joined = [](const vector<string> &values) {
+        string out;
+        for (const auto &v : values) out += (out.empty() ? "" : ",") + v;
+        return out;
+    };
+    string plan = q.tags.empty() ? "" : "IndexLookup(tags: " + joined(q.tags) + ")";
+    if (!q.titleTerms.empty()) plan += (plan.empty() ? "" : " & ") + string("TitleLookup(title: ") + joined(q.titleTerms) + ")";
+    if (!q.descriptions.empty())
+        plan += (plan.empty() ? "" : " & ") + string("DescriptionScan(description: ") + joined(q.descriptions) + ")";
+    vector<string> flags, ranges, filters;
+    for (int f = 0; f < VIDEO_FLAG_COUNT; ++f)
+        if (((q.flagsSet | q.flagsClear) >> f) & 1) flags.push_back(VIDEO_FLAG_NAMES[f] + string((q.flagsSet >> f) & 1 ? "=true" : "=false"));
+    if (!q.countries.empty()) filters.push_back("country in " + joined(q.countries));
+    for (const auto &p : q.filters) {
+        ostringstream f;
+        f.precision(15);
+        f << QUERY_COLUMN_NAMES[p.column] << " " << COMPARE_OP_NAMES[p.op] << " " << p.value;
+        (bitmaps && bitmaps->ranges[p.column].indexed ? ranges : filters).push_back(f.str());
+    }
+    if (!bitmaps) filters.insert(filters.begin(), flags.begin(), flags.end());
+    else if (!flags.empty()) plan += (plan.empty() ? "" : " & ") + string("FlagMask(") + joined(flags) + ")";
+    if (!ranges.empty()) plan += (plan.empty() ? "" : " & ") + string("RangeIndex(") + joined(ranges) + ")";
+    if (plan.empty()) plan = "Scan(all rows)";
+    if (!filters.empty()) plan += " -> Filter(" + joined(filters) + ")";
+    return plan;
+}
+
+// Cache key of an ordered query: everything except offset and limit.
+string orderSignature(const VideoIndex &index, const Query &q) {
+    return describeSelection(q, &index) + " order by " + q.order.text + (q.descending ? " desc" : " asc");
+}
+
+// Operator pipeline, as shown to the user.
+string describePlan(const VideoIndex &index, const Query &q, OrderStrategy strategy) {
+    string limit = q.limit == SIZE_MAX ? "all" : to_string(q.limit);
+    string page = q.offset ? "Slice(" + to_string(q.offset) + ", " + limit + ")" : "Limit(" + limit + ")";
+    if (!q.aggregate && q.ordered && strategy == ORDER_CACHED)
+        return "CachedSort(" + q.order.text + (q.descending ? " desc" : " asc") + ") -> " + page;
+
+    bool perRow = q.ordered && !q.aggregate && (strategy == ORDER_IMPACT || strategy == ORDER_TITLE_RATIO || strategy == ORDER_WAND);
+    string plan = describeSelection(q, perRow ? nullptr : &index);
+    if (q.aggregate) {
+        plan += string(" -> Aggregate(avg ") + QUERY_COLUMN_NAMES[q.aggregateColumn] + (q.aggregateByTag ? " by tag)" : ")");
+    } else if (q.ordered) {
+        string score = q.order.text +
+                       (q.order.isColumn() ? "" : findCompiledScore(q.order) ? " [compiled]" : " [interpreted]") +
+                       (q.descending ? " desc" : " asc");
+        const char *merge = strategy == ORDER_IMPACT ? "ImpactMerge" : strategy == ORDER_TITLE_RATIO ? "BlockMaxScan"
+                          : strategy == ORDER_WAND ? "BlockMaxWAND" : nullptr;
+        if (q.orderByRelevance) score = "relevance desc";
+        if (merge)
+            plan = merge + ("(" + plan) + ", " + score + ", " + to_string(q.offset + q.limit) + ")" +
+                   (q.offset ? " -> " + page : "");
+        else if (strategy == ORDER_TOPK)
+            plan += " -> TopK(" + score + ", " + to_string(q.offset + q.limit) + ")" + (q.offset ? " -> " + page : "");
+        else
+            plan += " -> RadixSort(" + score + ") -> " + page;
+    } else {
+        plan += " -> " + page;
+    }
+    return plan;
+}
+
+// ------------------------------------------------------------
+// Vectorized filtering over selection vectors
+//
+// Candidate rows are processed in cache-sized batches. Each
+// predicate compacts the batch's selection vector in one
+// branch-free pass over a single column.
+// ------------------------------------------------------------
+template <typename Cmp>
+size_t filterSelection(const double *column, uint32_t *sel, size_t n, double value, Cmp cmp) {
+    size_t out = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t row = sel[i];
+        sel[out] = row;
+        out += cmp(column[row], value) ? 1 : 0;
+    }
+    return out;
+}
+
+size_t applyPredicate(const VideoIndex &index, const Predicate &p, uint32_t *sel, size_t n) {
+    const double *column = queryColumn(index, p.column).data();
+    switch (p.op) {
+        case OP_GT:
+            return filterSelection(column, sel, n, p.value, greater<double>());
+        case OP_GE:
+            return filterSelection(column, sel, n, p.value, greater_equal<double>());
+        case OP_LT:
+            return filterSelection(column, sel, n, p.value, less<double>());
+        case OP_LE:
+            return filterSelection(column, sel, n, p.value, less_equal<double>());
+        default:
+            return filterSelection(column, sel, n, p.value, equal_to<double>());
+    }
+}
+
+size_t filterCountries(const VideoIndex &index, const vector<uint8_t> &allowed, uint32_t *sel, size_t n) {
+    const uint16_t *country = index.country.data();
+    size_t out = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t row = sel[i];
+        sel[out] = row;
+        out += allowed[country[row]];
+    }
+    return out;
+}
+
+// allowed[countryId] for the query's country clause.
+vector<uint8_t> countryMask(const VideoIndex &index, const Query &q) {
+    vector<uint8_t> allowed(index.countryNames.size(), q.countries.empty() ? 1 : 0);
+    for (const auto &c : q.countries)
+        for (size_t id = 0; id < index.countryNames.size(); ++id)
+            if (index.countryNames[id] == c) allowed[id] = 1;
+    return allowed;
+}
+
+// ------------------------------------------------------------
+// Status flag masks
+//
+// Each flag is a bitmap over rows, so a flag clause costs one
+// AND (flag required) or AND-NOT (flag excluded) per 64 rows,
+// applied to the lookup bitmaps before any row is materialized.
+// ------------------------------------------------------------
+vector<uint64_t> allRowsBitmap(size_t rows) {
+    vector<uint64_t> bitmap((rows + 63) / 64, ~0ULL);
+    if (rows % 64) bitmap.back() = (1ULL << (rows % 64)) - 1;
+    return bitmap;
+}
+
+vector<uint64_t> flagBitmap(const VideoIndex &index, const Query &q) {
+    vector<uint64_t> bitmap = allRowsBitmap(index.rows);
+    size_t words = bitmap.size();
+    for (int f = 0; f < VIDEO_FLAG_COUNT; ++f) {
+        const uint64_t *flag = index.flagBitmaps[f].data();
+        if ((q.flagsSet >> f) & 1)
+            for (size_t w = 0; w < words; ++w) bitmap[w] &= flag[w];
+        else if ((q.flagsClear >> f) & 1)
+            for (size_t w = 0; w < words; ++w) bitmap[w] &= ~flag[w];
+    }
+    return bitmap;
+}
+
+bool flagsPass(const VideoIndex &index, const Query &q, uint32_t row) {
+    for (int f = 0; f < VIDEO_FLAG_COUNT; ++f) {
+        bool set = (index.flagBitmaps[f][row / 64] >> (row % 64)) & 1;
+        if ((((set ? q.flagsClear : q.flagsSet) >> f) & 1) != 0) return false;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Range predicates over bit-sliced columns
+//
+// The constant is compared with every row at once, from the top
+// slice down (O'Neil & Quass): `greater` collects rows already
+// known to be larger, `equal` those whose bits so far all match.
+// views >= 1000000 thus costs two or three word operations per
+// slice per 64 rows, a few dozen for a count column, and leaves
+// a row bitmap that ANDs straight into the lookup bitmaps.
+// ------------------------------------------------------------
+void bitSliceCompare(const BitSlicedColumn &column, size_t rows, uint64_t value, vector<uint64_t> &greater,
+                     vector<uint64_t> &equal) {
+    equal = allRowsBitmap(rows);
+    greater.assign(equal.size(), 0);
+    size_t bits = column.slices;
+    if (bits < 64 && (value >> bits) != 0) { // above every stored value
+        equal.assign(equal.size(), 0);
+        return;
+    }
+    for (size_t i = bits; i-- > 0;) {
+        const uint64_t *slice = column.slice(i);
+        if ((value >> i) & 1) {
+            for (size_t w = 0; w < equal.size(); ++w) equal[w] &= slice[w];
+        } else {
+            for (size_t w = 0; w < equal.size(); ++w) {
+                greater[w] |= equal[w] & slice[w];
+                equal[w] &= ~slice[w];
+            }
+        }
+    }
+}
+
+// Rows whose value is at least `threshold` (a whole number).
+vector<uint64_t> bitSliceAtLeast(const BitSlicedColumn &column, size_t rows, double threshold) {
+    if (threshold <= 0.0) return allRowsBitmap(rows);
+    if (threshold >= 1.8e19) return vector<uint64_t>((rows + 63) / 64, 0);
+    vector<uint64_t> greater, equal;
+    bitSliceCompare(column, rows, static_cast<uint64_t>(threshold), greater, equal);
+    for (size_t w = 0; w < greater.size(); ++w) greater[w] |= equal[w];
+    return greater;
+}
+
+// Row bitmap of a predicate on a column with index.ranges[column].indexed.
+// Values are whole numbers, so every comparison becomes one "at
+// least" test on a rounded constant, or its complement.
+vector<uint64_t> bitSlicePredicate(const VideoIndex &index, const Predicate &p) {
+    const BitSlicedColumn &column = index.ranges[p.column];
+    if (std::isnan(p.value)) return vector<uint64_t>((index.rows + 63) / 64, 0);
+    auto complement = [&](vector<uint64_t> bitmap) {
+        vector<uint64_t> all = allRowsBitmap(index.rows);
+        for (size_t w = 0; w < bitmap.size(); ++w) bitmap[w] = all[w] & ~bitmap[w];
+        return bitmap;
+    };
+    switch (p.op) {
+        case OP_GT:
+            return bitSliceAtLeast(column, index.rows, floor(p.value) + 1);
+        case OP_GE:
+            return bitSliceAtLeast(column, index.rows, ceil(p.value));
+        case OP_LT:
+            return complement(bitSliceAtLeast(column, index.rows, ceil(p.value)));
+        case OP_LE:
+            return complement(bitSliceAtLeast(column, index.rows, floor(p.value) + 1));
+        default: {
+            vector<uint64_t> greater, equal((index.rows + 63) / 64, 0);
+            if (p.value >= 0.0 && p.value < 1.8e19 && p.value == floor(p.value))
+                bitSliceCompare(column, index.rows, static_cast<uint64_t>(p.value), greater, equal);
+            return equal;
+        }
+    }
+}
+
+// The filter stage for a single row.
+bool rowPasses(const VideoIndex &index, const Query &q, const vector<uint8_t> &allowed, uint32_t row) {
+    if ((q.flagsSet | q.flagsClear) && !flagsPass(index, q, row)) return false;
+    size_t n = 1;
+    if (!q.countries.empty()) n = filterCountries(index, allowed, &row, n);
+    for (size_t i = 0; n && i < q.filters.size(); ++i) n = applyPredicate(index, q.filters[i], &row, n);
+    return n == 1;
+}
+
+// Runs the lookup and filter stages; returns the surviving rows in table
+// order and sets `candidates` to the number the lookup produced.
+vector<uint32_t> selectRows(const VideoIndex &index, const Query &q, size_t &candidates) {
+    vector<uint32_t> sel;
+    {
+        TraceSpan span("index_lookup");
+        // Lookups and flag masks combine as bitmaps, a word at a time.
+        vector<uint64_t> rows = flagBitmap(index, q);
+        auto intersect = [&](const vector<uint64_t> &lookup) {
+            for (size_t w = 0; w < rows.size(); ++w) rows[w] &= lookup[w];
+        };
+        if (!q.tags.empty()) intersect(tagBitmap(index, q.tags));
+        if (!q.titleTerms.empty()) intersect(titleBitmap(index, q.titleTerms));
+        if (!q.descriptions.empty()) intersect(descriptionBitmap(index, q.descriptions));
+        for (const auto &p : q.filters)
+            if (index.ranges[p.column].indexed) intersect(bitSlicePredicate(index, p));
+        sel = bitmapRows(rows);
     }
-    return elems;
+
+    candidates = sel.size();
+
+    TraceSpan span("filter");
+    vector<uint8_t> allowed = countryMask(index, q);
+
+    size_t out = 0;
+    for (size_t begin = 0; begin < sel.size(); begin += QUERY_BATCH_ROWS) {
+        uint32_t *batch = sel.data() + begin;
+        size_t n = min(QUERY_BATCH_ROWS, sel.size() - begin);
+        if (!q.countries.empty()) n = filterCountries(index, allowed, batch, n);
+        for (const auto &p : q.filters)
+            if (!index.ranges[p.column].indexed) n = applyPredicate(index, p, batch, n);
+        memmove(sel.data() + out, batch, n * sizeof(uint32_t));
+        out += n;
+    }
+    sel.resize(out);
+    return sel;
 }
 
 // ------------------------------------------------------------
-// Parse a CSV line safely (handles quoted commas)
+// Early-terminating top-K by ratio over impact-ordered postings
+//
+// Every list matching a selected tag is already sorted best
+// first, so a K-way merge over their heads yields rows in
+// global (ratio desc, row) order; a row listed under several
+// tags comes out as consecutive duplicates. Because a row's
+// score is the same in every list, the threshold-algorithm stop
+// rule reduces to: once k distinct rows passing the filters have
+// come out, no unread posting can beat the k-th. The work is one
+// head per matching list plus the postings actually consumed,
+// independent of how many rows carry the tag.
 // ------------------------------------------------------------
-vector<string> parseCSVLine(const string &line) {
-    vector<string> result;
-    string current;
-    bool inQuotes = false;
+RankedRows impactTopK(const VideoIndex &index, const Query &q, size_t k, size_t &postingsRead) {
+    TraceSpan span("impact_merge");
+    const Column<double> &ratio = index.numeric[QCOL_RATIO];
+    const uint32_t *postings = index.impactPostings.data();
 
-    for (char c : line) {
-        if (c == '"') {
-            inQuotes = !inQuotes;
-        } else if (c == ',' && !inQuotes) {
-            result.push_back(current);
-            current.clear();
-        } else {
-            current += c;
-        }
+    struct Cursor {
+        uint32_t pos, end;
+    };
+    auto behind = [&](const Cursor &a, const Cursor &b) {
+        uint32_t x = postings[a.pos], y = postings[b.pos];
+        return ratio[x] != ratio[y] ? ratio[x] < ratio[y] : x > y;
+    };
+    priority_queue<Cursor, vector<Cursor>, decltype(behind)> heads(behind);
+    for (const auto &selTag : q.tags)
+        for (uint32_t t : matchingTagIds(index, selTag))
+            if (index.postingOffsets[t] < index.postingOffsets[t + 1])
+                heads.push({index.postingOffsets[t], index.postingOffsets[t + 1]});
+
+    vector<uint8_t> allowed = countryMask(index, q);
+    RankedRows ranked;
+    uint32_t last = UINT32_MAX;
+    postingsRead = 0;
+    while (ranked.size() < k && !heads.empty()) {
+        Cursor c = heads.top();
+        heads.pop();
+        uint32_t row = postings[c.pos];
+        ++postingsRead;
+        if (++c.pos < c.end) heads.push(c);
+        if (row == last) continue;
+        last = row;
+        if (rowPasses(index, q, allowed, row)) ranked.push_back({ratio[row], row});
     }
-    result.push_back(current);
-    return result;
+    return ranked;
 }
 
 // ------------------------------------------------------------
-// Load one dataset
+// Top-K title search
+//
+// Both plans visit candidate rows one at a time and keep the
+// best k in a heap, so RowFilter applies the query's filters and
+// its tag and description clauses per row. Scores are compared
+// as in topKRows: higher first, equal scores by row.
+//
+// By relevance, a Block-Max WAND over the title terms' lists:
+// cursors are kept ordered by row, the pivot is the first row
+// whose summed per-term maxima could beat the current k-th
+// score, and before a pivot is scored the maxima of the blocks
+// holding it are checked, so runs of rows that cannot enter the
+// top k are skipped a block at a time.
+//
+// By ratio, a row scores the same under every term, so terms are
+// taken best-first and any block whose best ratio is below the
+// k-th is skipped unread.
 // ------------------------------------------------------------
-vector<Video> loadSingleDataset(const string &filename) {
-    vector<Video> videos;
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Error: Could not open " << filename << endl;
-        return videos;
+class RowFilter {
+public:
+    RowFilter(const VideoIndex &index, const Query &q)
+        : index(index), q(q), allowed(countryMask(index, q)), tags(q.tags.empty() ? vector<uint64_t>() : tagBitmap(index, q.tags)),
+          descriptions(q.descriptions.empty() ? vector<uint64_t>() : descriptionBitmap(index, q.descriptions)) {}
+
+    bool operator()(uint32_t row) const {
+        if (!tags.empty() && !((tags[row / 64] >> (row % 64)) & 1)) return false;
+        if (!descriptions.empty() && !((descriptions[row / 64] >> (row % 64)) & 1)) return false;
+        return rowPasses(index, q, allowed, row);
     }
 
-    string line;
-    getline(file, line); // skip header
+private:
+    const VideoIndex &index;
+    const Query &q;
+    vector<uint8_t> allowed;
+    vector<uint64_t> tags;
+    vector<uint64_t> descriptions;
+};
 
-    while (getline(file, line)) {
-        if (line.empty()) continue;
-        vector<string> fields = parseCSVLine(line);
-        if (fields.size() < 16) continue;
+class TopKHeap {
+public:
+    explicit TopKHeap(size_t k) : k(k) {}
 
-        string title = fields[2];
-        string tagsStr = fields[6];
-        double views = 0.0, likes = 0.0;
+    bool full() const { return heap.size() >= k; }
+    // Whether (score, row) would enter the heap.
+    bool admits(double score, uint32_t row) const {
+        return k > 0 && (!full() || better(make_pair(score, row), heap.front()));
+    }
+    // Scores at or below this cannot enter (rows only grow in WAND).
+    double threshold() const { return full() ? heap.front().first : -HUGE_VAL; }
 
-        try {
-            views = stod(fields[7]);
-            likes = stod(fields[8]);
-        } catch (...) {
-            continue;
+    void push(double score, uint32_t row) {
+        if (!admits(score, row)) return;
+        if (full()) {
+            pop_heap(heap.begin(), heap.end(), better);
+            heap.pop_back();
         }
+        heap.push_back({score, row});
+        push_heap(heap.begin(), heap.end(), better);
+    }
 
-        double ratio = (views == 0.0) ? 0.0 : likes / views;
-        vector<string> tags = split(tagsStr, '|');
+    RankedRows sorted() const {
+        RankedRows ranked = heap;
+        sort(ranked.begin(), ranked.end(), better);
+        return ranked;
+    }
+
+    const RankedRows &entries() const { return heap; }
 
-        videos.push_back({title, tags, views, likes, ratio});
+private:
+    static bool better(const pair<double, uint32_t> &a, const pair<double, uint32_t> &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
     }
+    size_t k;
+    RankedRows heap; // heap front is the worst entry kept
+};
 
-    file.close();
-    return videos;
+class TitleCursor {
+public:
+    TitleCursor(const TitleIndex &index, uint32_t term)
+        : index(&index), term(term), first(index.termOffsets[term]), pos(first), end(index.termOffsets[term + 1]),
+          firstBlock(index.blockOffsets[term]), block(firstBlock), blockEnd(index.blockOffsets[term + 1]) {}
+
+    uint32_t row() const { return pos < end ? index->rows[pos] : UINT32_MAX; }
+    float score() const { return index->bm25(term, pos); }
+    float maxScore() const { return index->termMaxBm25[term]; }
+
+    // Best score in the block that holds `target` or the first row
+    // after it; `last` receives that block's last row.
+    float blockMax(uint32_t target, uint32_t &last) {
+        while (block < blockEnd && index->blockLastRow[block] < target) ++block;
+        if (block == blockEnd) {
+            last = UINT32_MAX;
+            return 0.0f;
+        }
+        last = index->blockLastRow[block];
+        return index->blockMaxBm25[block];
+    }
+
+    // Moves to the first posting with row >= target.
+    void seek(uint32_t target) {
+        if (row() >= target) return;
+        uint32_t last;
+        blockMax(target, last);
+        if (block == blockEnd) {
+            pos = end;
+            return;
+        }
+        pos = max(pos, first + (block - firstBlock) * TITLE_BLOCK_POSTINGS);
+        while (index->rows[pos] < target) ++pos;
+    }
+
+    void next() { ++pos; }
+
+private:
+    const TitleIndex *index;
+    uint32_t term, first, pos, end, firstBlock, block, blockEnd;
+};
+
+RankedRows titleTopKByRelevance(const VideoIndex &index, const Query &q, size_t k, size_t &postingsScored) {
+    TraceSpan span("block_max_wand");
+    RowFilter accept(index, q);
+    vector<TitleCursor> cursors;
+    for (uint32_t t : titleTermIds(index, q.titleTerms)) cursors.emplace_back(index.titles, t);
+    vector<TitleCursor *> order;
+    for (auto &c : cursors) order.push_back(&c);
+
+    TopKHeap top(k);
+    postingsScored = 0;
+    while (k > 0) {
+        sort(order.begin(), order.end(), [](const TitleCursor *a, const TitleCursor *b) { return a->row() < b->row(); });
+
+        // Pivot: first cursor at which the summed maxima could beat the k-th score.
+        double theta = top.threshold(), bound = 0.0;
+        size_t p = order.size();
+        for (size_t i = 0; i < order.size() && order[i]->row() != UINT32_MAX; ++i) {
+            bound += order[i]->maxScore();
+            if (bound > theta) {
+                p = i;
+                break;
+            }
+        }
+        if (p == order.size()) break;
+        uint32_t pivot = order[p]->row();
+        while (p + 1 < order.size() && order[p + 1]->row() == pivot) ++p;
+
+        // Block-max check: rows up to the end of the shortest current block
+        // can only hold terms 0..p, so they are skipped together when their
+        // block maxima cannot beat the k-th score.
+        double blockBound = 0.0;
+        uint64_t skipTo = UINT32_MAX;
+        for (size_t i = 0; i <= p; ++i) {
+            uint32_t last;
+            blockBound += order[i]->blockMax(pivot, last);
+            skipTo = min<uint64_t>(skipTo, static_cast<uint64_t>(last) + 1);
+        }
+        if (blockBound <= theta) {
+            if (p + 1 < order.size()) skipTo = min<uint64_t>(skipTo, order[p + 1]->row());
+            for (size_t i = 0; i <= p; ++i) order[i]->seek(static_cast<uint32_t>(skipTo));
+            continue;
+        }
+
+        if (order[0]->row() == pivot) {
+            double score = 0.0;
+            for (size_t i = 0; i <= p; ++i) {
+                score += order[i]->score();
+                order[i]->next();
+            }
+            ++postingsScored;
+            if (top.admits(score, pivot) && accept(pivot)) top.push(score, pivot);
+        } else {
+            for (size_t i = 0; i < p; ++i) order[i]->seek(pivot);
+        }
+    }
+    return top.sorted();
 }
 
-// ------------------------------------------------------------
-// Load and combine all datasets
-// ------------------------------------------------------------
-vector<Video> loadAllDatasets(const string &folderPath) {
-    vector<Video> allVideos;
-    for (const auto &entry : fs::directory_iterator(folderPath)) {
-        if (entry.path().extension() == ".csv") {
-            cout << "Loading: " << entry.path().filename().string() << " ...\n";
-            vector<Video> vids = loadSingleDataset(entry.path().string());
-            cout << "  -> Loaded " << vids.size() << " videos.\n";
-            allVideos.insert(allVideos.end(), vids.begin(), vids.end());
+RankedRows titleTopKByRatio(const VideoIndex &index, const Query &q, size_t k, size_t &postingsRead) {
+    TraceSpan span("block_max_scan");
+    const TitleIndex &titles = index.titles;
+    const Column<double> &ratio = index.numeric[QCOL_RATIO];
+    RowFilter accept(index, q);
+    vector<uint32_t> terms = titleTermIds(index, q.titleTerms);
+    sort(terms.begin(), terms.end(), [&](uint32_t a, uint32_t b) { return titles.termMaxRatio[a] > titles.termMaxRatio[b]; });
+
+    TopKHeap top(k);
+    postingsRead = 0;
+    for (uint32_t t : terms) {
+        if (top.full() && titles.termMaxRatio[t] < top.threshold()) break;
+        for (uint32_t b = titles.blockOffsets[t]; b < titles.blockOffsets[t + 1]; ++b) {
+            if (top.full() && titles.blockMaxRatio[b] < top.threshold()) continue;
+            uint32_t begin = titles.termOffsets[t] + (b - titles.blockOffsets[t]) * TITLE_BLOCK_POSTINGS;
+            uint32_t end = min(begin + TITLE_BLOCK_POSTINGS, titles.termOffsets[t + 1]);
+            for (uint32_t p = begin; p < end; ++p) {
+                uint32_t row = titles.rows[p];
+                ++postingsRead;
+                if (!top.admits(ratio[row], row)) continue;
+                // A row under several terms is already in the heap from the first.
+                bool present = any_of(top.entries().begin(), top.entries().end(),
+                                      [&](const pair<double, uint32_t> &e) { return e.second == row; });
+                if (!present && accept(row)) top.push(ratio[row], row);
+            }
         }
     }
-    cout << "\nTotal videos loaded from all datasets: " << allVideos.size() << "\n";
-    return allVideos;
+    return top.sorted();
 }
 
 // ------------------------------------------------------------
-// Heap-based analysis (returns runtime)
+// Buffered result output
+//
+// A query can return every row of the table, and formatting that
+// through iostreams (and syncing with stdio) costs more than the
+// query. Results are instead formatted into one large buffer,
+// numbers with to_chars, and handed to the OS with one write per
+// flush. The buffer is kept per thread and reused by the next
+// writer. Listings look exactly like cout printed them; CSV (RFC
+// 4180) and JSON exports escape titles and print numbers exactly.
 // ------------------------------------------------------------
-long long analyzeWithHeap(const vector<Video> &videos, const vector<string> &selectedTags, bool showOutput = true) {
-    struct Compare {
-        bool operator()(const pair<double, string> &a, const pair<double, string> &b) {
-            return a.first < b.first;
+enum ResultFormat { RESULT_TEXT, RESULT_CSV, RESULT_JSON };
+
+// Format of an output file, from its extension.
+ResultFormat resultFormatOf(const string &path) {
+    if (endsWith(path, ".csv")) return RESULT_CSV;
+    if (endsWith(path, ".json")) return RESULT_JSON;
+    return RESULT_TEXT;
+}
+
+class ResultWriter {
+public:
+    static const size_t BUFFER_BYTES = 1 << 20;
+
+    // Standard output, after anything already sent to cout.
+    ResultWriter() {
+        cout.flush();
+        fflush(stdout);
+#ifdef _WIN32
+        file = stdout;
+#else
+        fd = STDOUT_FILENO;
+#endif
+        takeBuffer();
+    }
+
+    // Creates or truncates `path` (see isOpen()).
+    explicit ResultWriter(const string &path) : ownsOutput(true) {
+#ifdef _WIN32
+        file = fopen(path.c_str(), "wb");
+        if (file) setvbuf(file, nullptr, _IONBF, 0);
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+        takeBuffer();
+    }
+
+    ~ResultWriter() { close(); }
+
+    ResultWriter(const ResultWriter &) = delete;
+    ResultWriter &operator=(const ResultWriter &) = delete;
+
+    bool isOpen() const {
+#ifdef _WIN32
+        return file != nullptr;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    ResultWriter &operator<<(string_view text) {
+        if (text.size() > BUFFER_BYTES - used) {
+            flush();
+            if (text.size() > BUFFER_BYTES) {
+                writeOut(text.data(), text.size());
+                return *this;
+            }
         }
-    };
+        memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+        return *this;
+    }
 
-    auto start = high_resolution_clock::now();
+    ResultWriter &operator<<(const char *text) { return *this << string_view(text); }
+
+    ResultWriter &operator<<(char c) {
+        if (used == BUFFER_BYTES) flush();
+        buffer[used++] = c;
+        return *this;
+    }
 
-    priority_queue<pair<double, string>, vector<pair<double, string>>, Compare> heap;
+    template <typename T, typename = enable_if_t<is_integral_v<T>>>
+    ResultWriter &operator<<(T value) {
+        room(24);
+        used = to_chars(buffer.data() + used, buffer.data() + BUFFER_BYTES, value).ptr - buffer.data();
+        return *this;
+    }
 
-    for (const auto &v : videos) {
-        for (const auto &tag : v.tags) {
-            for (const auto &selTag : selectedTags) {
-                if (tag.find(selTag) != string::npos) {
-                    heap.push({v.ratio, v.title});
-                }
+    // As cout prints it: %g with 6 significant digits.
+    ResultWriter &operator<<(double value) {
+        room(32);
+        used = to_chars(buffer.data() + used, buffer.data() + BUFFER_BYTES, value, chars_format::general, 6).ptr - buffer.data();
+        return *this;
+    }
+
+    // The shortest text that reads back as `value`, whole numbers
+    // without exponent; JSON null for NaN and infinities.
+    void exactNumber(double value) {
+        if (!isfinite(value)) {
+            *this << "null";
+        } else if (value == trunc(value) && fabs(value) < 9007199254740992.0) {
+            *this << static_cast<long long>(value);
+        } else {
+            room(32);
+            used = to_chars(buffer.data() + used, buffer.data() + BUFFER_BYTES, value).ptr - buffer.data();
+        }
+    }
+
+    // One CSV field, quoted only when it holds a comma, quote or line break.
+    void csvField(string_view text) {
+        if (text.find_first_of(",\"\r\n") == string_view::npos) {
+            *this << text;
+            return;
+        }
+        *this << '"';
+        for (size_t begin = 0;;) {
+            size_t quote = text.find('"', begin);
+            *this << text.substr(begin, quote == string_view::npos ? string_view::npos : quote + 1 - begin);
+            if (quote == string_view::npos) break;
+            *this << '"';
+            begin = quote + 1;
+        }
+        *this << '"';
+    }
+
+    // A JSON string literal; control characters are escaped, other
+    // bytes (UTF-8) are copied as they are.
+    void jsonString(string_view text) {
+        static const char HEX[] = "0123456789abcdef";
+        *this << '"';
+        size_t begin = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            *this << text.substr(begin, i - begin);
+            begin = i + 1;
+            switch (c) {
+            case '"': *this << "\\\""; break;
+            case '\\': *this << "\\\\"; break;
+            case '\n': *this << "\\n"; break;
+            case '\r': *this << "\\r"; break;
+            case '\t': *this << "\\t"; break;
+            default: *this << "\\u00" << HEX[c >> 4] << HEX[c & 15];
             }
         }
+        *this << text.substr(begin) << '"';
     }
 
-    auto end = high_resolution_clock::now();
-    auto duration = duration_cast<milliseconds>(end - start).count();
+    // Hands the buffer to the OS; false once any write has failed.
+    bool flush() {
+        if (used) writeOut(buffer.data(), used);
+        used = 0;
+        return !failed;
+    }
 
-    if (showOutput) {
-        cout << "\n[Heap Analysis Completed in " << duration << " ms]\n";
-        cout << "Top 10 videos by like/view ratio:\n";
-        for (int i = 0; i < 10 && !heap.empty(); ++i) {
-            auto top = heap.top();
-            heap.pop();
-            cout << i + 1 << ". " << top.second << " (ratio: " << top.first << ")\n";
+    // Flushes and closes a file; false if anything was lost.
+    bool close() {
+        if (!buffer.empty()) {
+            flush();
+            spareBuffer() = move(buffer);
+            buffer.clear();
         }
+        if (ownsOutput && isOpen()) {
+#ifdef _WIN32
+            failed |= fclose(file) != 0;
+            file = nullptr;
+#else
+            failed |= ::close(fd) != 0;
+            fd = -1;
+#endif
+        }
+        return !failed;
     }
 
-    return duration;
+private:
+    static vector<char> &spareBuffer() {
+        thread_local vector<char> spare;
+        return spare;
+    }
+
+    // Reuses this thread's buffer unless another writer holds it.
+    void takeBuffer() {
+        buffer = move(spareBuffer());
+        buffer.resize(BUFFER_BYTES);
+    }
+
+    void room(size_t bytes) {
+        if (BUFFER_BYTES - used < bytes) flush();
+    }
+
+    void writeOut(const char *data, size_t size) {
+        if (failed || !isOpen()) {
+            failed = true;
+            return;
+        }
+#ifdef _WIN32
+        failed = fwrite(data, 1, size, file) != size;
+#else
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                failed = true;
+                return;
+            }
+            data += n;
+            size -= n;
+        }
+#endif
+    }
+
+    vector<char> buffer;
+    size_t used = 0;
+    bool ownsOutput = false;
+    bool failed = false;
+#ifdef _WIN32
+    FILE *file = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Writes ranked rows, numbered from `firstRank`, in `format`.
+void writeRankedRows(ResultWriter &out, ResultFormat format, const VideoTable &videos, const RankedRows &ranked,
+                     size_t firstRank, bool withScore) {
+    string scratch;
+    if (format == RESULT_CSV)
+        out << "rank,title,country,views,likes,dislikes,comments,ratio,hours_to_trend" << (withScore ? ",score\n" : "\n");
+    else if (format == RESULT_JSON)
+        out << "[\n";
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        const Video &v = videos[ranked[i].second];
+        string_view title = titlePool.view(v.title, scratch);
+        if (format == RESULT_TEXT) {
+            out << firstRank + i << ". " << title << " [" << countryCodes.name(v.country) << "] (views: " << v.views
+                << ", likes: " << v.likes << ", ratio: " << v.ratio;
+            if (withScore) out << ", score: " << ranked[i].first;
+            out << ")\n";
+            continue;
+        }
+        double numbers[] = {v.views, v.likes, v.dislikes, v.comments, v.ratio, v.hoursToTrend, ranked[i].first};
+        const char *const names[] = {"views", "likes", "dislikes", "comments", "ratio", "hours_to_trend", "score"};
+        size_t count = withScore ? 7 : 6;
+        if (format == RESULT_CSV) {
+            out << firstRank + i << ',';
+            out.csvField(title);
+            out << ',';
+            out.csvField(countryCodes.name(v.country));
+            for (size_t k = 0; k < count; ++k) {
+                out << ',';
+                out.exactNumber(numbers[k]);
+            }
+            out << '\n';
+        } else {
+            out << (i ? ",\n" : "") << "{\"rank\":" << firstRank + i << ",\"title\":";
+            out.jsonString(title);
+            out << ",\"country\":";
+            out.jsonString(countryCodes.name(v.country));
+            for (size_t k = 0; k < count; ++k) {
+                out << ",\"" << names[k] << "\":";
+                out.exactNumber(numbers[k]);
+            }
+            out << '}';
+        }
+    }
+    if (format == RESULT_JSON) out << (ranked.empty() ? "]\n" : "\n]\n");
+}
+
+// Writes "avg <column> [by tag]" results: label -> (average, rows).
+void writeAverages(ResultWriter &out, ResultFormat format, QueryColumn column,
+                   const vector<pair<string, pair<double, size_t>>> &averages) {
+    const char *name = QUERY_COLUMN_NAMES[column];
+    if (format == RESULT_TEXT) out << "Average " << name << ":\n";
+    else if (format == RESULT_CSV) out << "label,average_" << name << ",videos\n";
+    else out << "[\n";
+    for (size_t i = 0; i < averages.size(); ++i) {
+        const auto &a = averages[i];
+        if (format == RESULT_TEXT) {
+            out << " - " << a.first << ": " << a.second.first << " (" << a.second.second << " videos)\n";
+        } else if (format == RESULT_CSV) {
+            out.csvField(a.first);
+            out << ',';
+            out.exactNumber(a.second.first);
+            out << ',' << a.second.second << '\n';
+        } else {
+            out << (i ? ",\n" : "") << "{\"label\":";
+            out.jsonString(a.first);
+            out << ",\"average_" << name << "\":";
+            out.exactNumber(a.second.first);
+            out << ",\"videos\":" << a.second.second << '}';
+        }
+    }
+    if (format == RESULT_JSON) out << (averages.empty() ? "]\n" : "\n]\n");
 }
 
 // ------------------------------------------------------------
-// Hash Table-based analysis (returns runtime)
+// How an ordered query returning the first `wanted` rows gets
+// them; `cached` if its sorted selection is in the OrderCache.
+// Top rows by ratio come straight off the impact-ordered tag
+// lists or the title blocks, and relevance only exists as a WAND
+// top-K; the full match count is never computed for these. A
+// description clause scans every row anyway, so it takes the
+// ordinary path rather than the impact merge.
+// ------------------------------------------------------------
+OrderStrategy planOrder(const Query &q, size_t wanted, bool cached) {
+    if (q.orderByRelevance) return ORDER_WAND;
+    if (cached) return ORDER_CACHED;
+    if (wanted > TOPK_MAX_ROWS) return ORDER_SORT;
+    bool byRatio = q.order.isColumn() && q.order.program[0].column == QCOL_RATIO && q.descending;
+    if (byRatio && !q.titleTerms.empty()) return ORDER_TITLE_RATIO;
+    if (byRatio && !q.tags.empty() && q.descriptions.empty()) return ORDER_IMPACT;
+    return ORDER_TOPK;
+}
+
+// ------------------------------------------------------------
+// Run a query and print its results (returns runtime)
 // ------------------------------------------------------------
-long long analyzeWithHashTable(const vector<Video> &videos, const vector<string> &selectedTags, bool showOutput = true) {
+long long runQuery(const VideoIndex &index, OrderCache &cache, const VideoTable &videos, const Query &q) {
+    MemoryScope scope(MEM_QUERY);
     auto start = high_resolution_clock::now();
 
-    unordered_map<string, vector<double>> tagRatios;
+    // A cached ordering already holds the filtered rows, so a
+    // repeated query skips lookup and filtering altogether.
+    bool ordered = q.ordered && !q.aggregate;
+    size_t wanted = q.limit > SIZE_MAX - q.offset ? SIZE_MAX : q.offset + q.limit;
+    const OrderCache::Entry *sorted = ordered && !q.orderByRelevance ? cache.find(orderSignature(index, q)) : nullptr;
+    OrderStrategy strategy = ordered ? planOrder(q, wanted, sorted != nullptr) : wanted <= TOPK_MAX_ROWS ? ORDER_TOPK : ORDER_SORT;
+    bool earlyExit = ordered && (strategy == ORDER_IMPACT || strategy == ORDER_TITLE_RATIO || strategy == ORDER_WAND);
 
-    for (const auto &v : videos) {
-        for (const auto &tag : v.tags) {
-            for (const auto &selTag : selectedTags) {
-                if (tag.find(selTag) != string::npos) {
-                    tagRatios[selTag].push_back(v.ratio);
+    size_t candidates = 0;
+    vector<uint32_t> sel;
+    if (sorted) candidates = sorted->candidates;
+    else if (!earlyExit) sel = selectRows(index, q, candidates);
+    size_t matching = sorted ? sorted->rows.size() : sel.size();
+    size_t pageBegin = min(q.offset, matching), pageEnd = min(wanted, matching);
+
+    RankedRows ranked;
+    vector<pair<string, pair<double, size_t>>> averages; // label -> (average, rows)
+    {
+        TraceSpan span(q.aggregate ? "aggregate" : "rank");
+        if (q.aggregate) {
+            const Column<double> &column = queryColumn(index, q.aggregateColumn);
+            auto average = [&](const vector<uint32_t> &rows) {
+                double sum = 0.0;
+                for (uint32_t row : rows) sum += column[row];
+                return make_pair(rows.empty() ? 0.0 : sum / rows.size(), rows.size());
+            };
+            if (q.aggregateByTag) {
+                for (const auto &tag : q.tags) {
+                    vector<uint32_t> tagRows = lookupTags(index, {tag}), both;
+                    set_intersection(tagRows.begin(), tagRows.end(), sel.begin(), sel.end(), back_inserter(both));
+                    averages.push_back({tag, average(both)});
                 }
+            } else {
+                averages.push_back({"all", average(sel)});
             }
+        } else if (earlyExit) {
+            if (strategy == ORDER_IMPACT) ranked = impactTopK(index, q, wanted, candidates);
+            else if (strategy == ORDER_TITLE_RATIO) ranked = titleTopKByRatio(index, q, wanted, candidates);
+            else ranked = titleTopKByRelevance(index, q, wanted, candidates);
+            pageBegin = min(q.offset, ranked.size());
+            ranked.erase(ranked.begin(), ranked.begin() + pageBegin);
+        } else if (ordered && strategy == ORDER_TOPK) {
+            ranked = rankRows(index, sel, q.order, wanted, q.descending);
+            ranked.erase(ranked.begin(), ranked.begin() + pageBegin);
+        } else if (ordered) {
+            if (!sorted) sorted = &cache.insert({orderSignature(index, q), sortRows(index, sel, q.order, q.descending), candidates});
+            vector<uint32_t> page(sorted->rows.begin() + pageBegin, sorted->rows.begin() + pageEnd);
+            vector<double> scores = q.order.isColumn() ? vector<double>(page.size()) : scoreRows(index, q.order, page);
+            for (size_t i = 0; i < page.size(); ++i) ranked.push_back({scores[i], page[i]});
+        } else {
+            for (size_t i = pageBegin; i < pageEnd; ++i) ranked.push_back({0.0, sel[i]});
         }
     }
 
-    unordered_map<string, double> tagAverages;
-    for (const auto &entry : tagRatios) {
-        double sum = 0;
-        for (double r : entry.second) sum += r;
-        tagAverages[entry.first] = (entry.second.empty() ? 0.0 : sum / entry.second.size());
-    }
-
     auto end = high_resolution_clock::now();
     auto duration = duration_cast<milliseconds>(end - start).count();
+    recordAnalysis(metrics.query, duration_cast<microseconds>(end - start).count(),
+                   strategy == ORDER_CACHED ? ranked.size() : candidates,
+                   earlyExit ? ranked.size() : matching);
 
-    if (showOutput) {
-        cout << "\n[Hash Table Analysis Completed in " << duration << " ms]\n";
-        cout << "Average like/view ratio for selected tags:\n";
-        for (const auto &tag : selectedTags) {
-            if (tagAverages.find(tag) != tagAverages.end())
-                cout << " - " << tag << ": " << tagAverages[tag] << "\n";
-            else
-                cout << " - " << tag << ": (no data)\n";
-        }
-    }
+    if (earlyExit)
+        cout << "\n[Query Completed in " << duration << " ms, " << candidates << " postings "
+             << (strategy == ORDER_WAND ? "scored" : "read") << "]\n";
+    else
+        cout << "\n[Query Completed in " << duration << " ms, " << matching << " matching videos]\n";
+    cout << "Plan: " << describePlan(index, q, strategy) << "\n";
 
+    // Rows go to the console, or to the `into` file in the format of its extension.
+    ResultFormat format = q.outputPath.empty() ? RESULT_TEXT : resultFormatOf(q.outputPath);
+    unique_ptr<ResultWriter> out(q.outputPath.empty() ? new ResultWriter() : new ResultWriter(q.outputPath));
+    if (!out->isOpen()) {
+        cerr << "Error: Could not create " << q.outputPath << endl;
+        return duration;
+    }
+    if (q.aggregate)
+        writeAverages(*out, format, q.aggregateColumn, averages);
+    else
+        writeRankedRows(*out, format, videos, ranked, pageBegin + 1, ordered && (!q.order.isColumn() || q.orderByRelevance));
+    if (!out->close())
+        cerr << "Error: Could not write " << (q.outputPath.empty() ? "the results" : q.outputPath) << endl;
+    else if (!q.outputPath.empty())
+        cout << "Wrote " << (q.aggregate ? averages.size() : ranked.size()) << " rows to " << q.outputPath << ".\n";
     return duration;
 }
 
 // ------------------------------------------------------------
-// Run both analyses multiple times and compare average time
+// Benchmark mode with a regression baseline
+//
+// Times each phase (load, heap analysis, hash table analysis)
+// over several runs. With --record the samples are stored in a
+// baseline file under this machine's fingerprint; otherwise they
+// are compared to the stored samples with a one-sided
+// Mann-Whitney U test. A phase regresses when it is significantly
+// slower (p < 0.05) and its median is more than the threshold
+// slower than the baseline median.
 // ------------------------------------------------------------
-void compareDataStructures(const vector<Video> &videos, const vector<string> &selectedTags) {
-    const int runs = 3;
-    long long totalHeap = 0, totalHash = 0;
+struct BenchmarkOptions {
+    string baselineFile = "benchmark_baseline.txt";
+    vector<string> tags = {"music", "gaming"};
+    int runs = 5;
+    double thresholdPercent = 10.0;
+    bool record = false;
+};
 
-    cout << "\nRunning both analyses " << runs << " times each to calculate average runtime...\n";
+// CPU model, core count, NUMA nodes and compiler, so baselines are
+// only compared on the machine and build that recorded them.
+string machineFingerprint() {
+    string cpu = "unknown-cpu";
+#ifdef __linux__
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0 && line.find(':') != string::npos) {
+            cpu = line.substr(line.find(':') + 2);
+            break;
+        }
+    }
+#endif
+    string compiler =
+#if defined(__clang__)
+        "clang-" + to_string(__clang_major__);
+#elif defined(__GNUC__)
+        "gcc-" + to_string(__GNUC__);
+#elif defined(_MSC_VER)
+        "msvc-" + to_string(_MSC_VER);
+#else
+        string("unknown-compiler");
+#endif
+    string fingerprint = cpu + "|" + to_string(thread::hardware_concurrency()) + " threads|" +
+                         to_string(numaNodes().size()) + " nodes|" + compiler;
+    replace(fingerprint.begin(), fingerprint.end(), '\t', ' ');
+    return fingerprint;
+}
 
-    for (int i = 1; i <= runs; ++i) {
-        cout << "\n--- Run #" << i << " ---\n";
-        long long heapTime = analyzeWithHeap(videos, selectedTags, false);
-        long long hashTime = analyzeWithHashTable(videos, selectedTags, false);
-        cout << "Heap: " << heapTime << " ms | Hash Table: " << hashTime << " ms\n";
-        totalHeap += heapTime;
-        totalHash += hashTime;
+double median(vector<double> samples) {
+    sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    return n == 0 ? 0.0 : (n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2.0);
+}
+
+// One-sided p-value that `current` tends to be larger than `baseline`
+// (normal approximation of the Mann-Whitney U statistic).
+double mannWhitneyGreaterP(const vector<double> &current, const vector<double> &baseline) {
+    vector<pair<double, int>> all;
+    for (double v : current) all.push_back({v, 0});
+    for (double v : baseline) all.push_back({v, 1});
+    sort(all.begin(), all.end());
+
+    double rankSum = 0.0, tieTerm = 0.0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) ++j;
+        double rank = (i + 1 + j) / 2.0; // average rank of the tie group
+        for (size_t k = i; k < j; ++k)
+            if (all[k].second == 0) rankSum += rank;
+        double t = j - i;
+        tieTerm += t * t * t - t;
+        i = j;
     }
 
-    double avgHeap = totalHeap / static_cast<double>(runs);
-    double avgHash = totalHash / static_cast<double>(runs);
+    double n1 = current.size(), n2 = baseline.size(), n = n1 + n2;
+    if (n1 == 0 || n2 == 0) return 1.0;
+    double u = rankSum - n1 * (n1 + 1) / 2.0;
+    double variance = n1 * n2 / 12.0 * ((n + 1) - tieTerm / (n * (n - 1)));
+    if (variance <= 0.0) return 1.0;
+    double z = (u - n1 * n2 / 2.0 - 0.5) / sqrt(variance);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
 
-    cout << "\n--------------------------------------------------\n";
-    cout << "Performance Comparison Summary (Average of " << runs << " runs)\n";
-    cout << "--------------------------------------------------\n";
-    cout << "Average Heap Time:       " << avgHeap << " ms\n";
-    cout << "Average Hash Table Time: " << avgHash << " ms\n";
+using PhaseSamples = vector<pair<string, vector<double>>>;
 
-    if (avgHeap < avgHash)
-        cout << "✅ Heap is faster on average.\n";
-    else if (avgHash < avgHeap)
-        cout << "✅ Hash Table is faster on average.\n";
-    else
-        cout << "⚖️ Both performed equally on average.\n";
+// Baseline lines: fingerprint <TAB> phase <TAB> comma-separated samples (ms).
+map<pair<string, string>, vector<double>> readBaseline(const string &filename) {
+    map<pair<string, string>, vector<double>> baseline;
+    ifstream in(filename);
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t a = line.find('\t'), b = line.find('\t', a + 1);
+        if (a == string::npos || b == string::npos) continue;
+        vector<double> samples;
+        for (const auto &value : split(line.substr(b + 1), ',')) {
+            try {
+                samples.push_back(stod(value));
+            } catch (...) {
+            }
+        }
+        baseline[{line.substr(0, a), line.substr(a + 1, b - a - 1)}] = samples;
+    }
+    return baseline;
+}
+
+bool writeBaseline(const string &filename, const map<pair<string, string>, vector<double>> &baseline) {
+    ofstream out(filename);
+    if (!out.is_open()) {
+        cerr << "Error: Could not write " << filename << endl;
+        return false;
+    }
+    out.precision(9);
+    out << "# fingerprint\tphase\tsamples (ms)\n";
+    for (const auto &entry : baseline) {
+        out << entry.first.first << "\t" << entry.first.second << "\t";
+        for (size_t i = 0; i < entry.second.size(); ++i) out << (i ? "," : "") << entry.second[i];
+        out << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+// Returns the process exit code: 0 when no phase regressed.
+int runBenchmarkMode(const string &folder, const BenchmarkOptions &options) {
+    PhaseSamples phases = {{"load", {}}, {"heap_analysis", {}}, {"hash_table_analysis", {}}};
+    auto elapsedMs = [](steady_clock::time_point start) {
+        return duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0;
+    };
+
+    cout << "Benchmarking " << options.runs << " runs of each phase...\n";
+    VideoTable videos;
+    for (int run = 0; run < options.runs; ++run) {
+        streambuf *saved = cout.rdbuf(nullptr); // silence the loader's progress output
+        videos = VideoTable();
+        resetLoadedText(); // so each run loads into empty arenas and pool
+        auto start = steady_clock::now();
+        videos = loadAllDatasets(folder);
+        placeOnNumaNodes(videos);
+        phases[0].second.push_back(elapsedMs(start));
+        cout.rdbuf(saved);
+    }
+    if (videos.empty()) {
+        cerr << "No data loaded. Exiting.\n";
+        return 1;
+    }
+    for (int run = 0; run < options.runs; ++run) {
+        auto start = steady_clock::now();
+        analyzeWithHeap(videos, options.tags, false);
+        phases[1].second.push_back(elapsedMs(start));
+        start = steady_clock::now();
+        analyzeWithHashTable(videos, options.tags, false);
+        phases[2].second.push_back(elapsedMs(start));
+    }
+
+    string fingerprint = machineFingerprint();
+    auto baseline = readBaseline(options.baselineFile);
+
+    if (options.record) {
+        for (const auto &phase : phases) baseline[{fingerprint, phase.first}] = phase.second;
+        if (!writeBaseline(options.baselineFile, baseline)) return 1;
+        cout << "Recorded baseline for " << fingerprint << " in " << options.baselineFile << ".\n";
+        for (const auto &phase : phases) cout << " - " << phase.first << ": median " << median(phase.second) << " ms\n";
+        return 0;
+    }
 
+    const double alpha = 0.05;
+    bool regressed = false, compared = false;
+    cout << "\n--------------------------------------------------\n";
+    cout << "Benchmark Comparison (" << options.baselineFile << ")\n";
+    cout << "Machine: " << fingerprint << "\n";
+    cout << "--------------------------------------------------\n";
+    for (const auto &phase : phases) {
+        auto it = baseline.find({fingerprint, phase.first});
+        double current = median(phase.second);
+        if (it == baseline.end() || it->second.empty()) {
+            cout << phase.first << ": " << current << " ms (no baseline)\n";
+            continue;
+        }
+        compared = true;
+        double base = median(it->second);
+        double change = base > 0.0 ? (current - base) / base * 100.0 : 0.0;
+        double p = mannWhitneyGreaterP(phase.second, it->second);
+        bool slower = p < alpha && change > options.thresholdPercent;
+        regressed = regressed || slower;
+        cout << phase.first << ": " << base << " ms -> " << current << " ms (" << (change >= 0 ? "+" : "") << change
+             << "%, p = " << p << ") " << (slower ? "REGRESSION" : "ok") << "\n";
+    }
     cout << "--------------------------------------------------\n";
+
+    if (!compared) {
+        cout << "No baseline for this machine; run with --record first.\n";
+        return 0;
+    }
+    if (regressed) {
+        cout << "FAILED: at least one phase is more than " << options.thresholdPercent
+             << "% slower than the baseline (p < " << alpha << ").\n";
+        return 1;
+    }
+    cout << "PASSED: no phase regressed beyond " << options.thresholdPercent << "%.\n";
+    return 0;
 }
 
 // ------------------------------------------------------------
 // Main Interactive Console
+//
+// Compiled out with -DYT_ANALYZER_NO_MAIN so other programs (the
+// benchmark suite in bench/) can include this file.
 // ------------------------------------------------------------
-int main() {
+#ifndef YT_ANALYZER_NO_MAIN
+int main(int argc, char *argv[]) {
     cout << "--------------------------------------------------\n";
     cout << "   YouTube Tag Correlation Analyzer (C++)\n";
     cout << "--------------------------------------------------\n";
 
+    // Metrics options are for batch runs (menu choices piped on
+    // stdin) or long-running sessions scraped by Prometheus.
+    bool benchmarkMode = false;
+    BenchmarkOptions benchmarkOptions;
+    string shareName, attachName;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--metrics-file" && hasValue) {
+            metricsFile = argv[++i];
+        } else if (arg == "--metrics-port" && hasValue) {
+            int port = atoi(argv[++i]);
+            if (port <= 0 || port > 65535 || !startMetricsServer(port)) return 1;
+        } else if (arg == "--benchmark") {
+            benchmarkMode = true;
+        } else if (arg == "--record") {
+            benchmarkOptions.record = true;
+        } else if (arg == "--baseline" && hasValue) {
+            benchmarkOptions.baselineFile = argv[++i];
+        } else if (arg == "--runs" && hasValue && atoi(argv[i + 1]) > 0) {
+            benchmarkOptions.runs = atoi(argv[++i]);
+        } else if (arg == "--threshold" && hasValue) {
+            benchmarkOptions.thresholdPercent = atof(argv[++i]);
+        } else if (arg == "--tags" && hasValue) {
+            benchmarkOptions.tags = split(argv[++i], ',');
+        } else if (arg == "--share" && hasValue) {
+            shareName = argv[++i];
+        } else if (arg == "--attach" && hasValue) {
+            attachName = argv[++i];
+        } else if (arg == "--unshare" && hasValue) {
+            return unshareDataset(argv[++i]) ? 0 : 1;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--metrics-file PATH] [--metrics-port PORT]"
+                 << " [--share NAME | --attach NAME]\n"
+                 << "       " << argv[0] << " --unshare NAME\n"
+                 << "       " << argv[0] << " --benchmark [--record] [--baseline FILE] [--runs N]"
+                 << " [--threshold PERCENT] [--tags a,b]\n";
+            return 1;
+        }
+    }
+
     string folder = "data";
-    if (!fs::exists(folder)) {
+    if (attachName.empty() && !fs::exists(folder)) {
         cerr << "Error: 'data/' folder not found.\n";
         return 1;
     }
 
-    vector<Video> videos = loadAllDatasets(folder);
+    if (benchmarkMode) return runBenchmarkMode(folder, benchmarkOptions);
+
+    VideoTable videos;
+    unique_ptr<VideoIndex> index;
+    MappedNumericColumns mappedNumeric; // of a lone Arrow file, viewed by the index
+    auto buildIndex = [&] {
+        if (!index) index.reset(new VideoIndex(buildVideoIndex(videos, &mappedNumeric)));
+    };
+    if (!attachName.empty()) {
+        auto start = steady_clock::now();
+        if (attachSharedDataset(attachName, videos, index)) {
+            long long micros = duration_cast<microseconds>(steady_clock::now() - start).count();
+            metrics.loadMicros.record(micros);
+            cout << "Attached to shared dataset " << attachName << " in " << micros / 1000.0 << " ms.\n";
+        }
+    } else {
+        videos = loadAllDatasets(folder, &mappedNumeric);
+        // A lone .ytc file brings its query index along.
+        vector<string> paths = datasetPaths(folder);
+        if (paths.size() == 1 && endsWith(paths[0], ".ytc") && !videos.empty()) loadIndexColumn(paths[0], videos, index);
+        placeOnNumaNodes(videos); // attached rows stay where the publisher put them
+    }
+    if (!shareName.empty() && !videos.empty()) {
+        buildIndex();
+        if (publishSharedDataset(videos, *index, shareName))
+            cout << "Shared " << videos.size() << " videos as " << shareName << " (attach with --attach " << shareName
+                 << ", remove with --unshare " << shareName << ").\n";
+    }
+    publishMetrics();
     cout << "Loaded " << videos.size() << " videos total.\n";
 
     if (videos.empty()) {
@@ -258,6 +7566,7 @@ int main() {
     }
 
     vector<string> selectedTags;
+    OrderCache orderCache;
     bool running = true;
 
     while (running) {
@@ -265,7 +7574,12 @@ int main() {
         cout << "\n2. Run Heap Analysis";
         cout << "\n3. Run Hash Table Analysis";
         cout << "\n4. Compare Both (Average Runtime)";
-        cout << "\n5. Exit";
+        cout << "\n5. Save Columnar File (videos.ytc)";
+        cout << "\n6. Export Arrow IPC File (videos.arrow)";
+        cout << "\n7. Export Memory Report (memory.json)";
+        cout << "\n8. Export Trace (trace.json)";
+        cout << "\n9. Run Query";
+        cout << "\n10. Exit";
         cout << "\n> ";
 
         int choice;
@@ -287,6 +7601,8 @@ int main() {
                     break;
                 }
                 analyzeWithHeap(videos, selectedTags);
+                printMemoryReport();
+                publishMetrics();
                 break;
             }
             case 3: {
@@ -295,6 +7611,8 @@ int main() {
                     break;
                 }
                 analyzeWithHashTable(videos, selectedTags);
+                printMemoryReport();
+                publishMetrics();
                 break;
             }
             case 4: {
@@ -303,9 +7621,48 @@ int main() {
                     break;
                 }
                 compareDataStructures(videos, selectedTags);
+                printMemoryReport();
+                publishMetrics();
+                break;
+            }
+            case 5: {
+                buildIndex();
+                if (saveColumnar(videos, "videos.ytc", encodeIndexColumn(videos, *index)))
+                    cout << "Saved " << videos.size() << " videos to videos.ytc.\n";
+                break;
+            }
+            case 6: {
+                if (exportArrow(videos, "videos.arrow"))
+                    cout << "Exported " << videos.size() << " videos to videos.arrow.\n";
+                break;
+            }
+            case 7: {
+                if (exportMemoryReport("memory.json"))
+                    cout << "Memory report written to memory.json.\n";
+                break;
+            }
+            case 8: {
+                if (exportTrace("trace.json"))
+                    cout << "Trace written to trace.json (open in Perfetto or chrome://tracing).\n";
+                break;
+            }
+            case 9: {
+                string queryText;
+                cout << "Enter query (e.g., tags:music,gaming views>1000000 order by ratio desc limit 10): ";
+                getline(cin, queryText);
+                try {
+                    Query query = parseQuery(queryText);
+                    buildIndex();
+                    runQuery(*index, orderCache, videos, query);
+                } catch (const exception &e) {
+                    cerr << "Query error: " << e.what() << "\n";
+                    break;
+                }
+                printMemoryReport();
+                publishMetrics();
                 break;
             }
-            case 5:
+            case 10:
                 running = false;
                 break;
             default:
@@ -316,4 +7673,4 @@ int main() {
     cout << "\nExiting... Goodbye!\n";
     return 0;
 }
-
+#endif
@@ -0,0 +1,1115 @@
+// ------------------------------------------------------------
+// Checks of the analyzer's fast paths against naive equivalents
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 tests/tests.cpp -lpthread -o yt_tests && ./yt_tests
+// (add -DWITH_ZLIB -lz / -DWITH_ZSTD -lzstd to cover the decompressors, see README.md)
+//
+// Every input is generated from a fixed seed, so a failure is
+// reproducible. Failed checks are printed with their line and
+// the exit status is 1 if there were any.
+// ------------------------------------------------------------
+#define YT_ANALYZER_NO_MAIN
+#include "../src/main.cpp"
+
+#include <cfloat>
+#include <random>
+#include <set>
+
+int failedChecks = 0;
+
+#define CHECK(condition, context)                                                                      \
+    do {                                                                                               \
+        if (!(condition)) {                                                                            \
+            ++failedChecks;                                                                            \
+            cerr << "tests.cpp:" << __LINE__ << ": " #condition " failed (" << (context) << ")" << endl; \
+        }                                                                                              \
+    } while (0)
+
+// ------------------------------------------------------------
+// Fixture: a synthetic dataset in the Kaggle CSV layout
+//
+// Titles and tags are drawn from a small vocabulary so they
+// repeat as in the real files; the numbers include zero views,
+// ties, fractional comment counts (no bit slices for that
+// column) and dates that do not parse.
+// ------------------------------------------------------------
+const size_t FIXTURE_US_ROWS = 40000, FIXTURE_GB_ROWS = 30000; // together above RADIX_PARALLEL_MIN_ROWS
+
+const vector<string> WORDS = {"music", "Gaming", "comedy", "news",   "sports", "vlog",     "funny", "trailer", "official",
+                              "video", "live",   "cover",  "remix",  "review", "tutorial", "2018",  "café",    "Naïve",
+                              "ДОМ",   "the",    "of",     "Ελλάδα", "東京",   "best"};
+
+string csvQuote(const string &text) {
+    string out = "\"";
+    for (char c : text) out += c == '"' ? string("\"\"") : string(1, c);
+    return out + "\"";
+}
+
+string twoDigitField(unsigned n) { return string(1, static_cast<char>('0' + n / 10 % 10)) + static_cast<char>('0' + n % 10); }
+
+string fixtureRecord(mt19937 &rng, size_t i) {
+    auto word = [&] { return WORDS[rng() % WORDS.size()]; };
+    auto flag = [&] { return rng() % 10 == 0 ? "True" : "False"; };
+
+    string title = word() + " " + word();
+    if (rng() % 3 == 0) title += ", \"" + word() + "\" " + word();
+    title += " " + to_string(rng() % 400);
+
+    string tags;
+    for (unsigned n = rng() % 5; n > 0; --n) tags += (tags.empty() ? "" : "|") + word() + (rng() % 2 ? " " + word() : "");
+    if (tags.empty() && rng() % 2) tags = "[none]";
+
+    string description;
+    if (rng() % 8) {
+        for (unsigned n = 1 + rng() % 12; n > 0; --n) {
+            string w = word();
+            if (rng() % 3 == 0) transform(w.begin(), w.end(), w.begin(), ::toupper);
+            description += w + (rng() % 6 ? " " : ", ");
+        }
+        if (rng() % 4 == 0) description += "\\nhttps://example.com/" + to_string(rng() % 50);
+    }
+
+    double views = rng() % 50 == 0 ? 0 : rng() % 4 == 0 ? 1000 * (rng() % 100) : rng() % 5000000;
+    double likes = views ? rng() % static_cast<unsigned>(views / 20 + 1) : 0;
+    double dislikes = rng() % 3 == 0 ? likes : rng() % 5000;
+    string comments = to_string(rng() % 20000) + (rng() % 25 == 0 ? ".5" : "");
+
+    unsigned year = 15 + rng() % 4, month = 1 + rng() % 12, day = 1 + rng() % 28;
+    string publish = rng() % 40 == 0 ? string("unknown")
+                                     : "20" + twoDigitField(year) + "-" + twoDigitField(month) + "-" + twoDigitField(day) + "T" +
+                                           twoDigitField(rng() % 24) + ":" + twoDigitField(rng() % 60) + ":" +
+                                           twoDigitField(rng() % 60) + ".000Z";
+    unsigned trendDay = min(28u, day + static_cast<unsigned>(rng() % 3));
+    string trending = rng() % 40 == 0 ? string("xx.yy.zz") : twoDigitField(year) + "." + twoDigitField(trendDay) + "." + twoDigitField(month);
+
+    return "v" + to_string(i) + "," + trending + "," + csvQuote(title) + ",channel " + to_string(rng() % 100) + ",10," + publish +
+           "," + csvQuote(tags) + "," + to_string(static_cast<long long>(views)) + "," + to_string(static_cast<long long>(likes)) + "," +
+           to_string(static_cast<long long>(dislikes)) + "," + comments + ",https://i.ytimg.com/vi/x/default.jpg," + flag() + "," +
+           flag() + "," + flag() + "," + csvQuote(description);
+}
+
+VideoTable fixtureCountry(const string &country, size_t rows, unsigned seed) {
+    mt19937 rng(seed);
+    string text = "video_id,trending_date,title,channel_title,category_id,publish_time,tags,views,likes,dislikes,"
+                  "comment_count,thumbnail_link,comments_disabled,ratings_disabled,video_error_or_removed,description\n";
+    for (size_t i = 0; i < rows; ++i) text += fixtureRecord(rng, i) + "\n";
+    return parseDatasetBuffer(text.data(), text.size(), country);
+}
+
+const VideoTable &fixtureVideos() {
+    static VideoTable videos = [] {
+        VideoTable table = fixtureCountry("US", FIXTURE_US_ROWS, 2018);
+        for (const Video &v : fixtureCountry("GB", FIXTURE_GB_ROWS, 2019)) table.push_back(v);
+        return table;
+    }();
+    return videos;
+}
+
+const VideoIndex &fixtureIndex() {
+    static VideoIndex index = buildVideoIndex(fixtureVideos());
+    return index;
+}
+
+vector<uint32_t> allRows(size_t n) {
+    vector<uint32_t> rows(n);
+    iota(rows.begin(), rows.end(), 0u);
+    return rows;
+}
+
+// ------------------------------------------------------------
+// Naive query evaluation: one pass over the rows, one stable sort
+// ------------------------------------------------------------
+double columnValue(const Video &v, QueryColumn column) {
+    switch (column) {
+        case QCOL_VIEWS: return v.views;
+        case QCOL_LIKES: return v.likes;
+        case QCOL_DISLIKES: return v.dislikes;
+        case QCOL_COMMENTS: return v.comments;
+        case QCOL_RATIO: return v.ratio;
+        default: return v.hoursToTrend;
+    }
+}
+
+string foldedAscii(string text) {
+    for (char &c : text)
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    return text;
+}
+
+bool naivePasses(const Video &v, const Query &q) {
+    if (!q.tags.empty()) {
+        vector<string> tags = decodeTags(v.tags);
+        bool any = false;
+        for (const auto &tag : tags)
+            for (const auto &wanted : q.tags) any |= tag.find(wanted) != string::npos;
+        if (!any) return false;
+    }
+    if (!q.titleTerms.empty()) {
+        vector<string> tokens = tokenizeTitle(titlePool.str(v.title));
+        bool any = false;
+        for (const auto &term : q.titleTerms) any |= find(tokens.begin(), tokens.end(), term) != tokens.end();
+        if (!any) return false;
+    }
+    if (!q.descriptions.empty()) {
+        string text = foldedAscii(descriptionArenas.str(v.description));
+        bool any = false;
+        for (const auto &pattern : q.descriptions) any |= text.find(foldedAscii(pattern)) != string::npos;
+        if (!any) return false;
+    }
+    if (!q.countries.empty() && find(q.countries.begin(), q.countries.end(), countryCodes.name(v.country)) == q.countries.end())
+        return false;
+    for (const auto &p : q.filters) {
+        double x = columnValue(v, p.column);
+        bool pass = p.op == OP_GT ? x > p.value : p.op == OP_GE ? x >= p.value : p.op == OP_LT ? x < p.value
+                  : p.op == OP_LE ? x <= p.value : x == p.value;
+        if (!pass) return false;
+    }
+    for (int f = 0; f < VIDEO_FLAG_COUNT; ++f) {
+        bool set = (v.flags >> f) & 1;
+        if (((q.flagsSet >> f) & 1) && !set) return false;
+        if (((q.flagsClear >> f) & 1) && set) return false;
+    }
+    return true;
+}
+
+vector<uint32_t> naiveSelect(const Query &q) {
+    const VideoTable &videos = fixtureVideos();
+    vector<uint32_t> rows;
+    for (uint32_t row = 0; row < videos.size(); ++row)
+        if (naivePasses(videos[row], q)) rows.push_back(row);
+    return rows;
+}
+
+// Rows sorted by `scores` (parallel to `rows`), ties in the given order.
+vector<uint32_t> naiveSort(const vector<uint32_t> &rows, const vector<double> &scores, bool descending) {
+    vector<size_t> order(rows.size());
+    iota(order.begin(), order.end(), size_t(0));
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return descending ? scores[a] > scores[b] : scores[a] < scores[b];
+    });
+    vector<uint32_t> sorted;
+    for (size_t i : order) sorted.push_back(rows[i]);
+    return sorted;
+}
+
+vector<uint32_t> rankedRowIds(const RankedRows &ranked) {
+    vector<uint32_t> rows;
+    for (const auto &entry : ranked) rows.push_back(entry.second);
+    return rows;
+}
+
+vector<uint32_t> page(const vector<uint32_t> &rows, size_t begin, size_t count) {
+    begin = min(begin, rows.size());
+    return vector<uint32_t>(rows.begin() + begin, rows.begin() + begin + min(count, rows.size() - begin));
+}
+
+// ------------------------------------------------------------
+// Query parser and planner
+// ------------------------------------------------------------
+void testQueryParser() {
+    Query q = parseQuery("tags:music,\"live cover\" title:\"Café NEWS\" country=us,gb views>=1000 likes<50.5 "
+                         "comments_disabled=false ratings_disabled:true order by likes asc limit 20 offset 5 into out.csv");
+    CHECK((q.tags == vector<string>{"music", "live cover"}), "tags");
+    CHECK((q.titleTerms == vector<string>{"café", "news"}), "title terms are tokenized and folded");
+    CHECK((q.countries == vector<string>{"US", "GB"}), "countries are uppercased");
+    CHECK(q.filters.size() == 2, "filters");
+    if (q.filters.size() == 2) {
+        CHECK(q.filters[0].column == QCOL_VIEWS && q.filters[0].op == OP_GE && q.filters[0].value == 1000, "views>=1000");
+        CHECK(q.filters[1].column == QCOL_LIKES && q.filters[1].op == OP_LT && q.filters[1].value == 50.5, "likes<50.5");
+    }
+    CHECK(q.flagsClear == FLAG_COMMENTS_DISABLED && q.flagsSet == FLAG_RATINGS_DISABLED, "flags");
+    CHECK(q.ordered && !q.orderByRelevance && !q.descending, "order");
+    CHECK(q.order.isColumn() && q.order.program[0].column == QCOL_LIKES, "order by likes");
+    CHECK(q.limit == 20 && q.offset == 5, "limit and offset");
+    CHECK(q.outputPath == "out.csv", "into");
+
+    Query defaults = parseQuery("tags:music");
+    CHECK(!defaults.ordered && defaults.limit == 10 && defaults.offset == 0 && defaults.descending, "defaults");
+    CHECK(parseQuery("title:music order by relevance limit all").limit == SIZE_MAX, "limit all");
+    CHECK(parseQuery("description:\"Official Video\"").descriptions == vector<string>{"Official Video"}, "description keeps case");
+    Query aggregate = parseQuery("tags:music avg views by tag");
+    CHECK(aggregate.aggregate && aggregate.aggregateByTag && aggregate.aggregateColumn == QCOL_VIEWS, "avg by tag");
+
+    for (const char *bad : {"limit 0", "limit 2.5", "offset -1", "views >", "views > abc", "tags:\"music", "order views",
+                            "order by relevance", "title:music order by relevance asc", "avg views by tag", "title:!!!",
+                            "comments_disabled=maybe", "description:\"\"", "frobnicate"}) {
+        bool threw = false;
+        try {
+            parseQuery(bad);
+        } catch (const runtime_error &) {
+            threw = true;
+        }
+        CHECK(threw, bad);
+    }
+}
+
+void testQueryPlanner() {
+    auto plan = [](const string &text, bool cached = false) {
+        Query q = parseQuery(text);
+        return planOrder(q, q.offset + q.limit, cached);
+    };
+    CHECK(plan("title:music order by relevance limit 10") == ORDER_WAND, "relevance");
+    CHECK(plan("title:music order by relevance limit 10", true) == ORDER_WAND, "relevance is never cached");
+    CHECK(plan("tags:music order by views desc limit 10", true) == ORDER_CACHED, "cached");
+    CHECK(plan("tags:music order by views desc limit 10 offset 5000") == ORDER_SORT, "deep page");
+    CHECK(plan("title:music order by ratio desc limit 10") == ORDER_TITLE_RATIO, "title ratio");
+    CHECK(plan("tags:music views>100 order by ratio desc limit 10") == ORDER_IMPACT, "impact");
+    CHECK(plan("tags:music description:live order by ratio desc limit 10") == ORDER_TOPK, "descriptions need a scan");
+    CHECK(plan("tags:music order by ratio asc limit 10") == ORDER_TOPK, "ascending ratio");
+    CHECK(plan("tags:music order by likes / views desc limit 10") == ORDER_TOPK, "formula");
+    CHECK(plan("views>100 order by views desc") == ORDER_TOPK, "top-k");
+}
+
+// Every selection and ordering strategy against a naive filter and stable sort.
+void testQueryResults() {
+    const VideoIndex &index = fixtureIndex();
+    const VideoTable &videos = fixtureVideos();
+    for (const char *text : {
+             "tags:music",
+             "tags:music views>100000 order by views desc limit 25",
+             "tags:gam,remix country=gb order by ratio desc limit 40",
+             "tags:\"live cover\" order by ratio desc limit 10 offset 30",
+             "tags:music,news ratings_disabled=false views>=250000 order by ratio desc limit 100",
+             "title:café order by ratio desc limit 30",
+             "title:the,東京 comments<10000.5 order by ratio desc limit 15 offset 5",
+             "title:дом order by ratio desc limit all",
+             "description:OFFICIAL,example.com order by likes asc limit 50",
+             "description:\"naïve video\" country=US order by comments desc limit 20",
+             "views>1000 views<=1000000 likes=0 order by dislikes asc limit 100",
+             "views=50000 order by views asc limit all",
+             "comments>=100.5 comments_disabled=true order by comments desc limit 30",
+             "hours_to_trend>24 order by hours_to_trend desc limit 60 offset 2000",
+             "country=GB,US video_error_or_removed=false order by views desc limit 30 offset 1200",
+             "dislikes<100 order by likes - dislikes desc limit 40",
+             "views>0 order by (likes - dislikes) / views desc limit 40",
+             "views>0 order by likes / views * 2 - comments / (views + 1) asc limit 40 offset 20",
+         }) {
+        Query q = parseQuery(text);
+        size_t candidates = 0;
+        vector<uint32_t> selected = selectRows(index, q, candidates);
+        vector<uint32_t> expected = naiveSelect(q);
+        CHECK(selected == expected, text);
+        CHECK(candidates >= selected.size(), text);
+        if (!q.ordered) continue;
+
+        vector<double> scores = scoreRows(index, q.order, expected);
+        if (q.order.isColumn())
+            for (size_t i = 0; i < expected.size(); ++i)
+                CHECK(scores[i] == columnValue(videos[expected[i]], q.order.program[0].column), text);
+        vector<uint32_t> sorted = naiveSort(expected, scores, q.descending);
+        size_t wanted = q.limit == SIZE_MAX ? SIZE_MAX : q.offset + q.limit;
+        vector<uint32_t> best = page(sorted, 0, wanted);
+
+        CHECK(sortRows(index, selected, q.order, q.descending) == sorted, text);
+        if (wanted <= TOPK_MAX_ROWS)
+            CHECK(rankedRowIds(rankRows(index, selected, q.order, wanted, q.descending)) == best, text);
+
+        size_t read = 0;
+        switch (planOrder(q, wanted, false)) {
+            case ORDER_IMPACT: CHECK(rankedRowIds(impactTopK(index, q, wanted, read)) == best, text); break;
+            case ORDER_TITLE_RATIO: CHECK(rankedRowIds(titleTopKByRatio(index, q, wanted, read)) == best, text); break;
+            default: break;
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// Columnar (.ytc) round trip
+//
+// Saved with its query index, which loading adopts in place;
+// queries through it must return what the built index returns.
+// ------------------------------------------------------------
+string tempPath(const string &name) { return (fs::temp_directory_path() / ("yt_tests_" + to_string(getpid()) + "_" + name)).string(); }
+
+void checkSameVideos(const VideoTable &loaded, const VideoTable &original, const string &what) {
+    CHECK(loaded.size() == original.size(), what);
+    if (loaded.size() != original.size()) return;
+    for (size_t i = 0; i < original.size(); ++i) {
+        const Video &a = loaded[i], &b = original[i];
+        bool same = titlePool.str(a.title) == titlePool.str(b.title) && decodeTags(a.tags) == decodeTags(b.tags) &&
+                    descriptionArenas.str(a.description) == descriptionArenas.str(b.description) &&
+                    countryCodes.name(a.country) == countryCodes.name(b.country) && a.views == b.views && a.likes == b.likes &&
+                    a.dislikes == b.dislikes && a.comments == b.comments && a.ratio == b.ratio && a.flags == b.flags &&
+                    a.publishTime == b.publishTime && a.trendingDay == b.trendingDay && a.hoursToTrend == b.hoursToTrend;
+        CHECK(same, what + " row " + to_string(i));
+        if (!same) return;
+    }
+}
+
+// Runs `load` with stderr silenced; damaged files are reported there.
+template <typename F>
+auto quietly(F load) -> decltype(load()) {
+    streambuf *saved = cerr.rdbuf(nullptr);
+    auto result = load();
+    cerr.rdbuf(saved);
+    return result;
+}
+
+string readFile(const string &path) {
+    ifstream in(path, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+template <typename T>
+void patch(string &image, uint64_t offset, T value) {
+    if (offset + sizeof(T) <= image.size()) memcpy(&image[offset], &value, sizeof(T));
+}
+
+const char *const SAMPLE_QUERIES[] = {"tags:music views>100000 order by views desc limit 25",
+                                      "title:café,дом country=GB order by ratio desc limit 20",
+                                      "title:live,best order by relevance limit 15",
+                                      "description:official comments_disabled=false order by likes asc limit 30",
+                                      "views>=50000 views<60000 order by (likes - dislikes) / views desc limit 20"};
+
+// Every query's top rows, with their text, one line per row.
+string sampleQueryResults(const VideoTable &videos, const VideoIndex &index) {
+    ostringstream out;
+    for (const char *text : SAMPLE_QUERIES) {
+        Query q = parseQuery(text);
+        size_t candidates = 0, scored = 0;
+        RankedRows ranked = q.orderByRelevance ? titleTopKByRelevance(index, q, q.limit, scored)
+                                               : rankRows(index, selectRows(index, q, candidates), q.order, q.limit, q.descending);
+        out << text << ": " << ranked.size() << " rows\n";
+        for (const auto &entry : ranked) {
+            const Video &v = videos[entry.second];
+            out << entry.second << ' ' << entry.first << ' ' << titlePool.str(v.title) << " [" << countryCodes.name(v.country) << "] "
+                << v.views << ' ' << v.likes << ' ' << v.hoursToTrend << ' ' << int(v.flags) << ' ' << descriptionArenas.str(v.description);
+            for (const auto &tag : decodeTags(v.tags)) out << '|' << tag;
+            out << '\n';
+        }
+    }
+    return out.str();
+}
+
+void testColumnarRoundTrip() {
+    const VideoTable &videos = fixtureVideos();
+    // Encoding swaps index.descriptions out and back.
+    VideoIndex &index = const_cast<VideoIndex &>(fixtureIndex());
+    string path = tempPath("videos.ytc");
+    CHECK(saveColumnar(videos, path, encodeIndexColumn(videos, index)), "save");
+    VideoTable loaded = loadColumnar(path);
+    checkSameVideos(loaded, videos, ".ytc");
+
+    unique_ptr<VideoIndex> adopted;
+    CHECK(loadIndexColumn(path, loaded, adopted), "index column");
+    if (adopted) {
+        CHECK(adopted->postings.isView() && adopted->numeric[QCOL_VIEWS].isView() && adopted->titles.rows.isView() &&
+                  adopted->ranges[QCOL_VIEWS].words.isView(),
+              "arrays are adopted in place");
+        CHECK(sampleQueryResults(loaded, *adopted) == sampleQueryResults(videos, index), "query results through the adopted index");
+    }
+
+    // Damaged or mismatched indexes are refused, and the rows still load.
+    string image = readFile(path);
+    ColumnEntry entry = readRaw<ColumnEntry>(image.data() + 16 + COL_QUERY_INDEX * sizeof(ColumnEntry));
+    auto directory = [&](size_t i) { return entry.offset + sizeof(IndexColumnHeader) + i * sizeof(SharedArray); };
+    const size_t POSTINGS = 3; // see forEachIndexColumn
+    const vector<pair<const char *, function<void(string &)>>> damages = {
+        {"rows", [&](string &d) { patch<uint64_t>(d, entry.offset + offsetof(IndexColumnHeader, rows), videos.size() - 1); }},
+        {"arrays", [&](string &d) { patch<uint64_t>(d, entry.offset + offsetof(IndexColumnHeader, arrays), 3); }},
+        {"offset", [&](string &d) { patch<uint64_t>(d, directory(POSTINGS), entry.size); }},
+        {"count", [&](string &d) { patch<uint64_t>(d, directory(POSTINGS) + 8, 1); }},
+        {"width", [&](string &d) { patch<uint64_t>(d, directory(POSTINGS) + 16, 8); }},
+        {"posting", [&](string &d) {
+             SharedArray postings = readRaw<SharedArray>(d.data() + directory(POSTINGS));
+             patch<uint32_t>(d, entry.offset + postings.offset, static_cast<uint32_t>(videos.size()));
+         }},
+    };
+    string damagedPath = tempPath("damaged.ytc");
+    for (const auto &damage : damages) {
+        string damaged = image;
+        damage.second(damaged);
+        ofstream(damagedPath, ios::binary | ios::trunc) << damaged;
+        unique_ptr<VideoIndex> refused;
+        CHECK(!quietly([&] { return loadIndexColumn(damagedPath, loaded, refused); }) && !refused, damage.first);
+        CHECK(quietly([&] { return loadColumnar(damagedPath); }).size() == videos.size(), damage.first);
+    }
+    fs::remove(damagedPath);
+    VideoTable fewer = loaded;
+    fewer.resize(loaded.size() - 1);
+    CHECK(!quietly([&] { return loadIndexColumn(path, fewer, adopted); }), "rows of another file");
+    CHECK(saveColumnar(videos, path), "save without an index");
+    CHECK(!loadIndexColumn(path, loadColumnar(path), adopted), "no index column");
+
+    // A second load resolves titles to the same pool ids.
+    VideoTable again = loadColumnar(path);
+    CHECK(again.size() == videos.size() && again[123].title == videos[123].title, "titles are interned");
+
+    // Truncated files are rejected as a whole.
+    uintmax_t size = fs::file_size(path);
+    for (uintmax_t keep : {uintmax_t(0), uintmax_t(16), size / 2, size - 1}) {
+        fs::resize_file(path, keep);
+        CHECK(quietly([&] { return loadColumnar(path); }).empty(), "truncated to " + to_string(keep));
+    }
+    fs::remove(path);
+}
+
+// ------------------------------------------------------------
+// Arrow IPC round trip
+//
+// The float64 columns come back as views of the mapping, and an
+// index viewing them answers queries as the built one does.
+// ------------------------------------------------------------
+void testArrowRoundTrip() {
+    const VideoTable &videos = fixtureVideos();
+    for (const char *name : {"videos.arrow", "videos.arrows"}) {
+        string path = tempPath(name);
+        CHECK(exportArrow(videos, path), name);
+        MappedNumericColumns numeric;
+        VideoTable loaded = importArrow(path, &numeric);
+        checkSameVideos(loaded, videos, name);
+        CHECK(numeric.views && numeric.likes && numeric.dislikes && numeric.comments && numeric.ratio, name);
+        VideoIndex index = buildVideoIndex(loaded, &numeric);
+        CHECK(index.numeric[QCOL_VIEWS].isView() && index.numeric[QCOL_RATIO].isView() && !index.numeric[QCOL_HOURS_TO_TREND].isView(),
+              string(name) + " columns viewed in place");
+        CHECK(sampleQueryResults(loaded, index) == sampleQueryResults(videos, fixtureIndex()), string(name) + " query results");
+
+        // A ratio other than likes / views is not viewed; the rows recompute it.
+        string image = readFile(path);
+        string ratios(reinterpret_cast<const char *>(&videos[0].ratio), sizeof(double));
+        for (size_t i = 1; i < 4; ++i) ratios.append(reinterpret_cast<const char *>(&videos[i].ratio), sizeof(double));
+        size_t at = image.find(ratios);
+        CHECK(at != string::npos && image.find(ratios, at + 1) == string::npos, string(name) + " ratio buffer");
+        patch<double>(image, at + 8, videos[1].ratio + 1.0);
+        ofstream(path, ios::binary | ios::trunc) << image;
+        MappedNumericColumns damaged;
+        checkSameVideos(importArrow(path, &damaged), videos, name);
+        CHECK(damaged.views && !damaged.ratio, string(name) + " ratio differs");
+
+        fs::resize_file(path, fs::file_size(path) / 2);
+        CHECK(quietly([&] { return importArrow(path); }).size() < videos.size(), string(name) + " truncated");
+        fs::remove(path);
+    }
+}
+
+// ------------------------------------------------------------
+// Radix sort
+// ------------------------------------------------------------
+void testRadixSort() {
+    const VideoIndex &index = fixtureIndex();
+    vector<uint32_t> everything = allRows(index.rows), sample;
+    for (uint32_t row = 0; row < index.rows; row += 7) sample.push_back(row);
+    reverse(sample.begin(), sample.end()); // ties must keep the given order, not the table's
+
+    // Columns and formulas with ties, zeros, negative scores and -0.
+    for (const char *formula : {"views", "ratio", "comments", "hours_to_trend", "likes - dislikes", "(0 - 1) * likes",
+                                "dislikes / (views + 1) - 0.001"}) {
+        ScoreProgram order = QueryParser(formula).parseFormula();
+        for (const vector<uint32_t> *rows : {&everything, &sample})
+            for (bool descending : {true, false}) {
+                vector<double> scores = scoreRows(index, order, *rows);
+                string what = string(formula) + (descending ? " desc" : " asc") + " over " + to_string(rows->size()) + " rows";
+                CHECK(sortRows(index, *rows, order, descending) == naiveSort(*rows, scores, descending), what);
+            }
+    }
+    CHECK(sortRows(index, {}, ScoreProgram::column(QCOL_VIEWS), true).empty(), "no rows");
+}
+
+// ------------------------------------------------------------
+// Impact-ordered postings
+// ------------------------------------------------------------
+void testImpactTopK() {
+    const VideoIndex &index = fixtureIndex();
+    for (const char *text : {"tags:music", "tags:news,remix country=GB views>=100000", "tags:gam", "tags:live likes>10 dislikes<4000",
+                             "tags:[none] comments_disabled=true", "tags:\"no such tag\""})
+        for (size_t k : {size_t(1), size_t(10), size_t(77), TOPK_MAX_ROWS}) {
+            Query q = parseQuery(text);
+            size_t candidates = 0, read = 0;
+            RankedRows expected = rankRows(index, selectRows(index, q, candidates), ScoreProgram::column(QCOL_RATIO), k, true);
+            CHECK(impactTopK(index, q, k, read) == expected, string(text) + " k=" + to_string(k));
+        }
+}
+
+// ------------------------------------------------------------
+// Block-max WAND
+// ------------------------------------------------------------
+// BM25 of every row from its tokenized title, in the index's float arithmetic.
+RankedRows bruteForceBm25(const Query &q, size_t k) {
+    const VideoIndex &index = fixtureIndex();
+    const TitleIndex &titles = index.titles;
+    vector<uint32_t> terms = titleTermIds(index, q.titleTerms);
+    const VideoTable &videos = fixtureVideos();
+    RankedRows scored;
+    for (uint32_t row = 0; row < videos.size(); ++row) {
+        if (!naivePasses(videos[row], q)) continue;
+        vector<string> tokens = tokenizeTitle(titlePool.str(videos[row].title));
+        double score = 0;
+        for (uint32_t t : terms) {
+            float tf = static_cast<float>(count(tokens.begin(), tokens.end(), string(titles.terms[t])));
+            if (tf > 0) score += titles.termIdf[t] * tf * (BM25_K1 + 1) / (tf + titles.lengthNorm[row]);
+        }
+        scored.emplace_back(score, row);
+    }
+    stable_sort(scored.begin(), scored.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    scored.resize(min(k, scored.size()));
+    return scored;
+}
+
+void testTitleRelevance() {
+    const VideoTable &videos = fixtureVideos();
+    for (const char *text : {"title:music order by relevance limit 10",
+                             "title:the,of,best order by relevance limit 50",
+                             "title:café,live,2018 views>100000 order by relevance limit 25",
+                             "title:дом,ελλάδα country=GB order by relevance limit 100",
+                             "title:東京 description:official order by relevance limit 1000",
+                             "title:music,news,vlog,cover,remix ratings_disabled=false order by relevance limit 5"}) {
+        Query q = parseQuery(text);
+        size_t scoredPostings = 0;
+        RankedRows wand = titleTopKByRelevance(fixtureIndex(), q, q.limit, scoredPostings);
+        RankedRows brute = bruteForceBm25(q, q.limit);
+        CHECK(wand.size() == brute.size(), text);
+        if (wand.size() != brute.size()) continue;
+
+        // Sums may be taken in another order, so rows with (nearly)
+        // equal scores can swap; scores by rank must agree and every
+        // row returned must really have its score.
+        map<uint32_t, double> bruteScore;
+        for (const auto &entry : bruteForceBm25(q, SIZE_MAX)) bruteScore[entry.second] = entry.first;
+        set<uint32_t> distinct;
+        for (size_t i = 0; i < wand.size(); ++i) {
+            uint32_t row = wand[i].second;
+            distinct.insert(row);
+            CHECK(fabs(wand[i].first - brute[i].first) <= 1e-9 * brute[i].first, string(text) + " rank " + to_string(i));
+            CHECK(bruteScore.count(row) && fabs(bruteScore[row] - wand[i].first) <= 1e-9 * wand[i].first && naivePasses(videos[row], q),
+                  string(text) + " row " + to_string(row));
+        }
+        CHECK(distinct.size() == wand.size(), text);
+    }
+}
+
+// ------------------------------------------------------------
+// Bit-sliced range comparison
+// ------------------------------------------------------------
+bool rowBit(const vector<uint64_t> &bitmap, size_t row) { return (bitmap[row / 64] >> (row % 64)) & 1; }
+
+void testBitSliceCompare() {
+    // A hand-made column: zero, powers of two and their neighbours,
+    // a row count that is not a multiple of 64.
+    Column<double> small;
+    for (double v : {0.0, 1.0, 2.0, 3.0, 63.0, 64.0, 65.0, 1023.0, 1024.0, 4294967296.0, 4294967297.0, 7.0, 7.0})
+        for (int copy = 0; copy < 11; ++copy) small.push_back(v);
+    const VideoIndex &index = fixtureIndex();
+
+    auto checkColumn = [](const Column<double> &values, const BitSlicedColumn &column, const string &what) {
+        CHECK(column.indexed, what);
+        vector<double> probes = {0, 1, 2, 5, 63, 64, 65, 999, 1000, 1024, 123456, 4294967296.0, 4294967297.0, 1e15};
+        for (size_t i = 0; i < values.size(); i += 997) probes.insert(probes.end(), {values[i], values[i] + 1, max(0.0, values[i] - 1)});
+        for (double probe : probes) {
+            vector<uint64_t> greater, equal;
+            bitSliceCompare(column, values.size(), static_cast<uint64_t>(probe), greater, equal);
+            bool ok = true;
+            for (size_t row = 0; row < values.size(); ++row)
+                ok &= rowBit(greater, row) == (values[row] > probe) && rowBit(equal, row) == (values[row] == probe);
+            for (size_t row = values.size(); row < greater.size() * 64; ++row) ok &= !rowBit(greater, row) && !rowBit(equal, row);
+            CHECK(ok, what + " against " + to_string(probe));
+        }
+    };
+    checkColumn(small, buildBitSlices(small), "hand-made column");
+    for (QueryColumn c : {QCOL_VIEWS, QCOL_LIKES, QCOL_DISLIKES})
+        checkColumn(index.numeric[c], index.ranges[c], QUERY_COLUMN_NAMES[c]);
+
+    Column<double> fractional = small;
+    fractional.push_back(2.5);
+    CHECK(!buildBitSlices(fractional).indexed, "fractional values are not sliced");
+    Column<double> negative = small;
+    negative.push_back(-1.0);
+    CHECK(!buildBitSlices(negative).indexed, "negative values are not sliced");
+
+    // Every operator, with whole and fractional constants.
+    const Column<double> &views = index.numeric[QCOL_VIEWS];
+    for (int op = OP_GT; op <= OP_EQ; ++op)
+        for (double value : {-5.0, 0.0, 0.5, 1000.0, 1000.5, 50000.0, 4999999.0, 1e12, nan("")}) {
+            Predicate p{QCOL_VIEWS, static_cast<CompareOp>(op), value};
+            vector<uint64_t> bitmap = bitSlicePredicate(index, p);
+            bool ok = true;
+            for (size_t row = 0; row < views.size(); ++row) {
+                double x = views[row];
+                bool pass = op == OP_GT ? x > value : op == OP_GE ? x >= value : op == OP_LT ? x < value : op == OP_LE ? x <= value : x == value;
+                ok &= rowBit(bitmap, row) == pass;
+            }
+            CHECK(ok, string("views ") + COMPARE_OP_NAMES[op] + " " + to_string(value));
+        }
+}
+
+// ------------------------------------------------------------
+// Date parsers
+// ------------------------------------------------------------
+
+// Days since 1970-01-01, counted a year and a month at a time.
+int64_t naiveDays(unsigned year, unsigned month, unsigned day) {
+    auto leap = [](unsigned y) { return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0; };
+    const unsigned lengths[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int64_t days = 0;
+    for (unsigned y = 1970; y < year; ++y) days += leap(y) ? 366 : 365;
+    for (unsigned y = year; y < 1970; ++y) days -= leap(y) ? 366 : 365;
+    for (unsigned m = 1; m < month; ++m) days += lengths[m - 1] + (m == 2 && leap(year));
+    return days + day - 1;
+}
+
+string digits(unsigned value, int width) {
+    string text = to_string(value);
+    return string(width - min<int>(width, static_cast<int>(text.size())), '0') + text;
+}
+
+void testDateParsers() {
+    const unsigned lengths[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    mt19937 rng(1970);
+    size_t wrong = 0;
+    for (unsigned year : {1900u, 1969u, 1970u, 1999u}) {
+        int64_t seconds = 0;
+        bool ok = parsePublishTime(digits(year, 4) + "-03-01T12:00:00.000Z", seconds);
+        CHECK(ok && seconds == naiveDays(year, 3, 1) * 86400 + 43200, year);
+    }
+    for (unsigned year = 2000; year < 2100; ++year)
+        for (unsigned month = 1; month <= 12; ++month) {
+            bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+            for (unsigned day = 1; day <= lengths[month - 1] + (month == 2 && leap); ++day) {
+                unsigned hour = rng() % 24, minute = rng() % 60, second = rng() % 60;
+                string stamp = digits(year, 4) + "-" + digits(month, 2) + "-" + digits(day, 2) + "T" + digits(hour, 2) + ":" +
+                               digits(minute, 2) + ":" + digits(second, 2) + (rng() % 2 ? ".000Z" : "");
+                int64_t seconds = 0;
+                int32_t trending = 0;
+                wrong += !parsePublishTime(stamp, seconds) ||
+                         seconds != naiveDays(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+                wrong += !parseTrendingDate(digits(year - 2000, 2) + "." + digits(day, 2) + "." + digits(month, 2), trending) ||
+                         trending != naiveDays(year, month, day);
+            }
+        }
+    CHECK(wrong == 0, to_string(wrong) + " dates misparsed");
+
+    // Days past the end of their month, e.g. 2017-02-29 or 17.31.04.
+    size_t accepted = 0;
+    for (unsigned year = 2000; year < 2100; ++year)
+        for (unsigned month = 1; month <= 12; ++month) {
+            bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+            for (unsigned day = lengths[month - 1] + (month == 2 && leap) + 1; day <= 31; ++day) {
+                int64_t seconds = 0;
+                int32_t trending = 0;
+                accepted += parsePublishTime(digits(year, 4) + "-" + digits(month, 2) + "-" + digits(day, 2) + "T00:00:00.000Z", seconds);
+                accepted += parseTrendingDate(digits(year - 2000, 2) + "." + digits(day, 2) + "." + digits(month, 2), trending);
+            }
+        }
+    CHECK(accepted == 0, to_string(accepted) + " days past the end of their month accepted");
+
+    for (const char *bad : {"", "2017-11-13", "2017-11-13T17:13", "2017-13-01T00:00:00.000Z", "2017-00-10T00:00:00.000Z",
+                            "2017-01-00T00:00:00.000Z", "2017-01-32T00:00:00.000Z", "2017-01-01 00:00:00.000Z",
+                            "2017-01-01T24:00:00.000Z", "2017-01-01T00:60:00.000Z", "2017-01-01T00:00:61.000Z",
+                            "2017/01/01T00:00:00.000Z", "20a7-01-01T00:00:00.000Z", "2017-1-01T00:00:00.000Z",
+                            "2017-02-29T00:00:00.000Z", "1900-02-29T00:00:00.000Z", "2017-02-31T00:00:00.000Z",
+                            "2017-04-31T00:00:00.000Z", "2017-11-31T00:00:00.000Z"}) {
+        int64_t seconds = 42;
+        CHECK(!parsePublishTime(bad, seconds) && seconds == 42, bad);
+    }
+    for (const char *bad : {"", "17.13.1", "17.32.01", "17.00.01", "17.01.13", "17.01.00", "17-01-01", "170101xx", "17.01.011",
+                            "1x.01.01", " 7.01.01", "17.31.04", "17.29.02", "17.30.02", "18.31.06", "17.31.09"}) {
+        int32_t day = 42;
+        CHECK(!parseTrendingDate(bad, day) && day == 42, bad);
+    }
+}
+
+// ------------------------------------------------------------
+// Result output: CSV and JSON escaping, exact numbers
+// ------------------------------------------------------------
+string naiveCsvField(const string &text) {
+    if (text.find_first_of(",\"\r\n") == string::npos) return text;
+    string out = "\"";
+    for (char c : text) out += c == '"' ? string("\"\"") : string(1, c);
+    return out + "\"";
+}
+
+string naiveJsonString(const string &text) {
+    string out = "\"";
+    for (unsigned char c : text) {
+        char escape[8];
+        if (c == '"') out += "\\\"";
+        else if (c == '\\') out += "\\\\";
+        else if (c == '\n') out += "\\n";
+        else if (c == '\r') out += "\\r";
+        else if (c == '\t') out += "\\t";
+        else if (c < 0x20) snprintf(escape, sizeof escape, "\\u%04x", c), out += escape;
+        else out += static_cast<char>(c);
+    }
+    return out + "\"";
+}
+
+void testResultWriter() {
+    vector<string> fields = {"plain", "", "a,b", "say \"hi\"", "\"", "line\nbreak", "cr\rhere", "tab\there", "back\\slash",
+                             string("nul\0byte", 8), "\x01\x1f\x7f", "café ДОМ 東京 😀", "trailing,", ",\"\n\r"};
+    mt19937 rng(75);
+    const string alphabet = string("ab,\"\n\r\t\\ \x01\x1f", 12) + "é";
+    for (int i = 0; i < 200; ++i) {
+        string random;
+        for (unsigned n = rng() % 40; n > 0; --n) random += alphabet[rng() % alphabet.size()];
+        fields.push_back(random);
+    }
+
+    // Repeated past the writer's buffer so fields straddle flushes.
+    string path = tempPath("results.txt"), expected;
+    {
+        ResultWriter out(path);
+        CHECK(out.isOpen(), path);
+        while (expected.size() < 3 * ResultWriter::BUFFER_BYTES)
+            for (const auto &field : fields) {
+                out.csvField(field);
+                out << '\t';
+                out.jsonString(field);
+                out << '\n';
+                expected += naiveCsvField(field) + "\t" + naiveJsonString(field) + "\n";
+            }
+        string big(ResultWriter::BUFFER_BYTES + 5, ',');
+        out.csvField(big);
+        expected += naiveCsvField(big);
+        CHECK(out.close(), path);
+    }
+    CHECK(readFile(path) == expected, "csvField / jsonString");
+
+    vector<double> numbers = {0.0, -0.0, 1.0, -1.0, 0.1, 1.0 / 3, 2.5e-8, -123456.789, 1e21, 1e300, 5e-324, 9007199254740991.0,
+                              9007199254740992.0, 9007199254740993.0, -9007199254740994.0, 4294967296.5, DBL_MAX, DBL_MIN};
+    for (int i = 0; i < 2000; ++i) {
+        uint64_t bits = (static_cast<uint64_t>(rng()) << 32) | rng();
+        double value;
+        memcpy(&value, &bits, sizeof value);
+        numbers.push_back(value);
+    }
+    numbers.insert(numbers.end(), {nan(""), HUGE_VAL, -HUGE_VAL});
+    {
+        ResultWriter out(path);
+        for (double value : numbers) {
+            out.exactNumber(value);
+            out << '\n';
+        }
+        CHECK(out.close(), path);
+    }
+    istringstream lines(readFile(path));
+    string line;
+    size_t i = 0;
+    for (; getline(lines, line) && i < numbers.size(); ++i) {
+        double value = numbers[i];
+        if (!isfinite(value)) {
+            CHECK(line == "null", line);
+            continue;
+        }
+        CHECK(strtod(line.c_str(), nullptr) == value, line);
+        if (value == trunc(value) && fabs(value) < 9007199254740992.0) CHECK(line.find_first_of(".eE") == string::npos, line);
+    }
+    CHECK(i == numbers.size(), "one line per number");
+    fs::remove(path);
+}
+
+// ------------------------------------------------------------
+// CSV records
+// ------------------------------------------------------------
+void testOptionalCounts() {
+    const string header = "video_id,trending_date,title,channel_title,category_id,publish_time,tags,views,likes,dislikes,"
+                          "comment_count,thumbnail_link,comments_disabled,ratings_disabled,video_error_or_removed,description\n";
+    auto record = [](const string &views, const string &likes, const string &dislikes, const string &comments) {
+        return "id,17.14.11,Title,Channel,10,2017-11-13T17:13:01.000Z,tag," + views + "," + likes + "," + dislikes + "," +
+               comments + ",https://i.ytimg.com/vi/x/default.jpg,False,False,False,text\n";
+    };
+    string text = header + record("100", "10", "", "") + record("200", "20", "n/a", "7") + record("300", "30", "3", "") +
+                  record("", "40", "4", "4") + record("500", "x", "5", "5");
+    VideoTable videos = parseDatasetBuffer(text.data(), text.size(), "US");
+    CHECK(videos.size() == 3, "rows without views or likes are dropped, others kept");
+    if (videos.size() != 3) return;
+    CHECK(videos[0].views == 100 && videos[0].dislikes == 0 && videos[0].comments == 0, "blank dislikes and comments");
+    CHECK(videos[1].dislikes == 0 && videos[1].comments == 7, "malformed dislikes");
+    CHECK(videos[2].dislikes == 3 && videos[2].comments == 0 && videos[2].ratio == 0.1, "blank comments");
+}
+
+// ------------------------------------------------------------
+// Title pool
+// ------------------------------------------------------------
+
+// Titles interned while every byte is escaped (before the first
+// loader trains stringSymbols) must keep their ids once a table is
+// loaded.
+void testInterningAcrossSymbolTables() {
+    fixtureVideos(); // trains stringSymbols
+    SymbolTable trained = stringSymbols;
+    CHECK(trained.size() > 0, "the fixture trained a table");
+    vector<uint64_t> symbols(trained.size());
+    vector<uint8_t> lengths(trained.size());
+    for (unsigned c = 0; c < trained.size(); ++c) {
+        memcpy(&symbols[c], trained.symbol(static_cast<uint8_t>(c)), 8);
+        lengths[c] = static_cast<uint8_t>(trained.length(static_cast<uint8_t>(c)));
+    }
+
+    const vector<string> titles = {"official music video premiere 2018", "the best live cover of the year",
+                                   "Ελλάδα 東京 café review", "funny vlog, \"Gaming\" remix"};
+    stringSymbols = SymbolTable();
+    vector<uint32_t> untrained;
+    for (const auto &title : titles) untrained.push_back(titlePool.intern(title));
+    stringSymbols.load(symbols.data(), lengths.data(), static_cast<unsigned>(symbols.size()));
+    for (size_t i = 0; i < titles.size(); ++i) {
+        CHECK(titlePool.intern(titles[i]) == untrained[i], titles[i]);
+        CHECK(titlePool.str(untrained[i]) == titles[i], titles[i]);
+    }
+
+    const Video &row = fixtureVideos()[12345];
+    CHECK(titlePool.intern(titlePool.str(row.title)) == row.title, "a title interned during the fixture load");
+    CHECK(stringSymbols.sameSymbols(trained), "table restored");
+}
+
+// ------------------------------------------------------------
+// Shared-memory datasets
+//
+// An instance can only attach before it loads anything, so the
+// attaching side runs in a fresh copy of this program (see
+// attachedChild) and reports on stdout.
+// ------------------------------------------------------------
+#ifdef __linux__
+// The attaching side: "failed" and whether global state is still
+// untouched, then the error; or the query results.
+int attachedChild(const string &name) {
+    ostringstream errors;
+    streambuf *saved = cerr.rdbuf(errors.rdbuf());
+    VideoTable videos;
+    unique_ptr<VideoIndex> index;
+    bool attached = attachSharedDataset(name, videos, index);
+    cerr.rdbuf(saved);
+    if (!attached) {
+        bool untouched = titlePool.size() == 1 && countryCodes.size() == 1 && tagArenas.count() == 0 &&
+                         titleArenas.count() == 0 && descriptionArenas.count() == 0;
+        cout << "failed " << (untouched ? "untouched" : "changed") << '\n' << errors.str();
+        return 0;
+    }
+    cout << sampleQueryResults(videos, *index);
+    return 0;
+}
+
+string runAttachedChild(const string &name) {
+    string output;
+    string self = fs::read_symlink("/proc/self/exe").string();
+    FILE *child = popen(("'" + self + "' --attach " + name).c_str(), "r");
+    if (!child) return output;
+    char buffer[4096];
+    for (size_t n; (n = fread(buffer, 1, sizeof buffer, child)) > 0;) output.append(buffer, n);
+    pclose(child);
+    return output;
+}
+
+void testSharedDataset() {
+    const VideoTable &videos = fixtureVideos();
+    // Publishing swaps index.descriptions and swaps it back.
+    VideoIndex &index = const_cast<VideoIndex &>(fixtureIndex());
+    string name = "yt_tests_" + to_string(getpid()), path = "/dev/shm/" + name;
+    CHECK(publishSharedDataset(videos, index, name), name);
+    string expected = sampleQueryResults(videos, index);
+    CHECK(runAttachedChild(name) == expected, "query results through the attached dataset");
+
+    string image = readFile(path);
+    auto array = [&](size_t i) { return readRaw<SharedArray>(image.data() + sizeof(SharedHeader) + i * sizeof(SharedArray)); };
+    auto entry = [&](size_t i) { return sizeof(SharedHeader) + i * sizeof(SharedArray); };
+    const size_t ROWS = 0, TITLES = 4, COUNTRY_BYTES = 6; // see forEachSharedArray
+    string countryBytes = image.substr(array(COUNTRY_BYTES).offset, array(COUNTRY_BYTES).count);
+
+    const vector<pair<const char *, function<void(string &)>>> damages = {
+        {"not a shared dataset", [](string &d) { d[0] = 'X'; }},
+        {"published by a different build", [](string &d) { patch<uint32_t>(d, offsetof(SharedHeader, videoBytes), sizeof(Video) + 8); }},
+        {"bad array directory", [](string &d) { patch<uint64_t>(d, offsetof(SharedHeader, arrays), 3); }},
+        {"lies outside the object", [&](string &d) { patch<uint64_t>(d, entry(TITLES), d.size() + 64); }},
+        {"lies outside the object", [&](string &d) { patch<uint64_t>(d, entry(TITLES) + 8, array(TITLES).count + (1 << 20)); }},
+        {"lies outside the object", [&](string &d) { patch<uint64_t>(d, entry(ROWS) + 16, 1); }},
+        {"lies outside the object", [](string &d) { d.resize(d.size() / 2); }},
+        {"row count does not match", [&](string &d) { patch<uint64_t>(d, offsetof(SharedHeader, rows), videos.size() + 1); }},
+        {"row id out of range", [&](string &d) { patch<uint32_t>(d, array(ROWS).offset + offsetof(Video, title), UINT32_MAX); }},
+        {"title outside the object", [&](string &d) { patch<uint64_t>(d, array(TITLES).offset + sizeof(TextRef) + offsetof(TextRef, offset), d.size()); }},
+        {"repeated country code", [&](string &d) {
+             size_t gb = countryBytes.find("GB");
+             if (gb != string::npos) d.replace(array(COUNTRY_BYTES).offset + gb, 2, "US");
+         }},
+    };
+    string damagedName = name + "_damaged";
+    for (const auto &damage : damages) {
+        string damaged = image;
+        damage.second(damaged);
+        ofstream("/dev/shm/" + damagedName, ios::binary | ios::trunc) << damaged;
+        string output = runAttachedChild(damagedName);
+        CHECK(output.rfind("failed untouched\n", 0) == 0 && output.find(damage.first) != string::npos, damage.first + (" -> " + output));
+    }
+    fs::remove("/dev/shm/" + damagedName);
+    CHECK(unshareDataset(name), name);
+}
+#endif
+
+// ------------------------------------------------------------
+// Asynchronous file reader
+// ------------------------------------------------------------
+#ifndef _WIN32
+void testAsyncFileReader() {
+    // Empty, tiny, chunk-sized and multi-chunk files; a missing one;
+    // a directory (reads fail); and where available a sysfs file,
+    // whose size is larger than its text, so reads come up short
+    // and then hit end of file.
+    fs::path dir = tempPath("async");
+    fs::create_directories(dir);
+    mt19937 rng(54);
+    vector<string> paths, contents;
+    vector<bool> readable;
+    for (size_t size : {size_t(0), size_t(1), size_t(4095), ASYNC_CHUNK_BYTES, ASYNC_CHUNK_BYTES + 1, 3 * ASYNC_CHUNK_BYTES + 12345}) {
+        string text(size, '\0');
+        for (char &c : text) c = static_cast<char>(rng());
+        paths.push_back((dir / ("file" + to_string(paths.size()))).string());
+        ofstream(paths.back(), ios::binary) << text;
+        contents.push_back(text);
+        readable.push_back(true);
+    }
+    for (const string &path : {(dir / "missing").string(), dir.string(), string("/sys/kernel/mm/transparent_hugepage/enabled")}) {
+        if (!fs::exists(path) && path.rfind("/sys/", 0) == 0) continue;
+        paths.push_back(path);
+        contents.push_back(string());
+        readable.push_back(false);
+    }
+
+    AsyncFileReader reader;
+    for (bool ioUring : {true, false, true}) {
+        reader.ioUring = ioUring;
+        mutex lock;
+        vector<int> calls(paths.size(), 0);
+        vector<bool> ok(paths.size(), false), same(paths.size(), false);
+        reader.readAll(paths, [&](size_t i, ByteBuffer &&data, bool success) {
+            lock_guard<mutex> guard(lock);
+            ++calls[i];
+            ok[i] = success;
+            same[i] = success && string(data.data(), data.size()) == contents[i];
+        });
+        string mode = reader.ioUring ? "io_uring" : "pread threads";
+        for (size_t i = 0; i < paths.size(); ++i) {
+            CHECK(calls[i] == 1, mode + ": " + paths[i]);
+            CHECK(ok[i] == readable[i] && (!readable[i] || same[i]), mode + ": " + paths[i]);
+        }
+        if (ioUring && !reader.ioUring) cout << "      (io_uring is unavailable here, read with pread threads)" << endl;
+    }
+    fs::remove_all(dir);
+}
+#endif
+
+// ------------------------------------------------------------
+// Compressed inputs
+// ------------------------------------------------------------
+#ifdef GZIP_FRAMES
+void appendLittleEndian(string &out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>(value >> (8 * i));
+}
+
+// One gzip member holding `text`; a BGZF block if `bgzf`, whose
+// header records the member's size so the file splits into frames.
+string gzipMember(string_view text, bool bgzf) {
+    z_stream zs{};
+    deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    string body(deflateBound(&zs, static_cast<uLong>(text.size())), '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+    zs.avail_in = static_cast<uInt>(text.size());
+    zs.next_out = reinterpret_cast<Bytef *>(&body[0]);
+    zs.avail_out = static_cast<uInt>(body.size());
+    deflate(&zs, Z_FINISH);
+    body.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    string member = bgzf ? string("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0\0\0", 18) : string("\x1f\x8b\x08\0\0\0\0\0\0\xff", 10);
+    if (bgzf) {
+        size_t blockSize = member.size() + body.size() + 8 - 1;
+        member[16] = static_cast<char>(blockSize & 0xFF);
+        member[17] = static_cast<char>(blockSize >> 8);
+    }
+    member += body;
+    appendLittleEndian(member, static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef *>(text.data()), static_cast<uInt>(text.size()))));
+    appendLittleEndian(member, static_cast<uint32_t>(text.size()));
+    return member;
+}
+
+// `text` as bgzip writes it: 60000-byte blocks and an empty one at the end.
+string bgzf(const string &text) {
+    string out;
+    for (size_t pos = 0; pos < text.size(); pos += 60000) out += gzipMember(string_view(text).substr(pos, 60000), true);
+    return out + gzipMember("", true);
+}
+
+// Everything `path` decodes to; `ok` is false if decoding failed.
+string decodeAll(const string &path, bool &ok) {
+    FrameDecoder decoder(path);
+    string text, piece;
+    while (decoder.isOpen() && decoder.next(piece)) text += piece;
+    ok = decoder.isOpen() && decoder.finish() && decoder.problem().empty();
+    return text;
+}
+
+void testGzipFrames() {
+    mt19937 rng(51);
+    string text = "video_id,trending_date,title,channel_title,category_id,publish_time,tags,views,likes,dislikes,"
+                  "comment_count,thumbnail_link,comments_disabled,ratings_disabled,video_error_or_removed,description\n";
+    for (size_t i = 0; i < 6000; ++i) text += fixtureRecord(rng, i) + "\n"; // > DECODED_PIECE_BYTES
+    string third = text.substr(0, text.size() / 3), rest = text.substr(third.size());
+
+    fs::path dir = tempPath("gzip");
+    fs::create_directories(dir);
+    string blocks = bgzf(text);
+    string damaged = blocks;
+    damaged[blocks.size() / 2] ^= 0x55;
+    const vector<tuple<string, string, bool>> files = {
+        {"bgzf", blocks, true},
+        {"members", gzipMember(string_view(text).substr(0, 1), false) + gzipMember(third.substr(1), false) + gzipMember(rest, false), true},
+        {"single", gzipMember(text, false), true},
+        {"trailing bytes", gzipMember(text, false) + "not gzip", true},
+        {"truncated bgzf", blocks.substr(0, blocks.size() / 2), false},
+        {"damaged bgzf", damaged, false},
+        {"truncated member", gzipMember(text, false).substr(0, 5000), false},
+    };
+    for (const auto &file : files) {
+        string path = (dir / (get<0>(file) + ".csv.gz")).string();
+        ofstream(path, ios::binary) << get<1>(file);
+        bool ok = false;
+        string decoded = decodeAll(path, ok);
+        CHECK(ok == get<2>(file), get<0>(file));
+        if (get<2>(file)) CHECK(decoded == text, get<0>(file));
+    }
+
+    // Through the loader: records straddle blocks and decoded pieces.
+    string path = (dir / "USvideos.csv.gz").string();
+    ofstream(path, ios::binary) << blocks;
+    VideoTable expected = parseDatasetBuffer(text.data(), text.size(), "US");
+    checkSameVideos(loadDatasetFile(path), expected, "USvideos.csv.gz");
+    fs::remove_all(dir);
+}
+#endif
+
+int main(int argc, char **argv) {
+#ifdef __linux__
+    if (argc == 3 && string(argv[1]) == "--attach") return attachedChild(argv[2]);
+#else
+    (void)argc;
+    (void)argv;
+#endif
+    const pair<const char *, void (*)()> tests[] = {
+        {"query parser", testQueryParser},
+        {"query planner", testQueryPlanner},
+        {"query results", testQueryResults},
+        {".ytc round trip", testColumnarRoundTrip},
+        {"arrow round trip", testArrowRoundTrip},
+        {"radix sort", testRadixSort},
+        {"impact top-k", testImpactTopK},
+        {"title relevance (WAND)", testTitleRelevance},
+        {"bit-sliced compare", testBitSliceCompare},
+        {"date parsers", testDateParsers},
+        {"result writer", testResultWriter},
+        {"optional counts", testOptionalCounts},
+        {"title interning across symbol tables", testInterningAcrossSymbolTables},
+#ifdef __linux__
+        {"shared dataset", testSharedDataset},
+#endif
+#ifndef _WIN32
+        {"async file reader", testAsyncFileReader},
+#endif
+#ifdef GZIP_FRAMES
+        {"gzip frames", testGzipFrames},
+#endif
+    };
+    for (const auto &test : tests) {
+        int before = failedChecks;
+        test.second();
+        cout << (failedChecks == before ? "ok    " : "FAIL  ") << test.first << endl;
+    }
+    cout << failedChecks << " failed checks" << endl;
+    return failedChecks ? 1 : 0;
+}